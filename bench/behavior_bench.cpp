@@ -0,0 +1,95 @@
+#include <memory>
+#include <random>
+#include "benchmark.h"
+#include "fixtures.h"
+#include "simulation/behavior_system.h"
+#include "simulation/simulation.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    using BehaviorComponent = Schema::Component<ComponentType::behavior>;
+
+    // robot_count robots with a behavior on random free tiles; a quarter of them start idle
+    void add_robots(Simulation& simulation, int64_t robot_count) {
+        size_t side = simulation.get_scene().get_width();
+        auto& database = simulation.get_database();
+        auto& scene = simulation.get_scene();
+
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int32_t> random_step(-1, 1);
+        std::uniform_int_distribution<size_t> random_tile(0, side * side - 1);
+        for (int64_t robot_index = 0; robot_index < robot_count; ++robot_index) {
+            I32Vec3 position;
+            do {
+                size_t tile = random_tile(random);
+                position = I32Vec3{static_cast<int32_t>(tile % side), static_cast<int32_t>(tile / side), 0};
+            } while (scene.get_object(position));
+
+            I32Vec3 velocity{random_step(random), random_step(random), 0};
+            scene.add_object(database.add_entity(
+                ObjectTypeComponent{ObjectType::robot},
+                PositionComponent{position},
+                BodyComponent{velocity, I32Vec3{}},
+                BehaviorComponent{BehaviorSystem::robot_tree_index, {}}
+            ));
+        }
+    }
+
+    // a map that robot_count robots fill about half of
+    size_t get_side(int64_t robot_count) {
+        size_t side = 1;
+        while (static_cast<int64_t>(side * side) < robot_count * 2) {
+            side += 1;
+        }
+
+        return side;
+    }
+
+    // one BehaviorSystem update over range(0) robots
+    void behavior_tick(State& state) {
+        int64_t robot_count = state.range(0);
+        size_t side = get_side(robot_count);
+
+        Simulation simulation(side, side);
+        add_robots(simulation, robot_count);
+
+        BehaviorSystem behavior_system;
+        while (state.keep_running()) {
+            do_not_optimize(behavior_system.update(simulation));
+        }
+
+        state.set_items_processed(state.iterations() * robot_count);
+    }
+
+    // a simulation tick of range(0) robots with only a BehaviorSystem, updated under policy
+    // range(1): 0 every tick, 1 a round-robin eighth per tick, 2 every tick within 64 tiles of
+    // the middle of the map and every eighth tick further out
+    void behavior_policy_tick(State& state) {
+        int64_t robot_count = state.range(0);
+        int64_t policy_index = state.range(1);
+        size_t side = get_side(robot_count);
+
+        Simulation simulation(side, side);
+        add_robots(simulation, robot_count);
+
+        const UpdatePolicy policies[] = {
+            UpdatePolicy{},
+            UpdatePolicy::round_robin(8),
+            UpdatePolicy::distance_lod(64, 8),
+        };
+        simulation.add_system(std::make_unique<BehaviorSystem>(), policies[policy_index]);
+
+        while (state.keep_running()) {
+            do_not_optimize(simulation.tick());
+        }
+
+        state.set_items_processed(state.iterations() * robot_count);
+    }
+
+}
+
+ENTLER_BENCHMARK(behavior_tick)->args({1000})->args({100000});
+ENTLER_BENCHMARK(behavior_policy_tick)->ranges({100000, 1000000}, {0, 1, 2});
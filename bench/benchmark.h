@@ -0,0 +1,182 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+// A small Google Benchmark-style harness. Results are written in the same
+// JSON layout as Google Benchmark so the output can be tracked with the
+// usual tooling (see compare.py).
+namespace entler::bench {
+
+    template<typename T>
+    inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static const volatile void* sink;
+        sink = &value;
+#endif
+    }
+
+    class State {
+    public:
+        State(std::vector<int64_t> arguments, int64_t max_iterations)
+            : arguments_(std::move(arguments))
+            , max_iterations_(max_iterations)
+        {
+        }
+
+        // runs the timed loop: while (state.keep_running()) { ... }
+        bool keep_running() {
+            if (iterations_ == 0 && !running_) {
+                running_ = true;
+                start_timing();
+                return true;
+            }
+
+            iterations_ += 1;
+            if (iterations_ < max_iterations_) {
+                return true;
+            }
+
+            stop_timing();
+            running_ = false;
+            return false;
+        }
+
+        int64_t range(size_t argument_index) const {
+            assert(argument_index < arguments_.size());
+            return arguments_[argument_index];
+        }
+
+        // excludes per-iteration setup from the measurement
+        void pause_timing() {
+            stop_timing();
+        }
+
+        void resume_timing() {
+            start_timing();
+        }
+
+        void set_items_processed(int64_t items_processed) {
+            items_processed_ = items_processed;
+        }
+
+        int64_t iterations() const {
+            return iterations_;
+        }
+
+        int64_t items_processed() const {
+            return items_processed_;
+        }
+
+        double real_time_ns() const {
+            return real_time_ns_;
+        }
+
+        double cpu_time_ns() const {
+            return cpu_time_ns_;
+        }
+
+    private:
+        void start_timing() {
+            real_start_ = std::chrono::steady_clock::now();
+            cpu_start_ = std::clock();
+        }
+
+        void stop_timing() {
+            auto real_end = std::chrono::steady_clock::now();
+            auto cpu_end = std::clock();
+            real_time_ns_ += std::chrono::duration<double, std::nano>(real_end - real_start_).count();
+            cpu_time_ns_ += 1e9 * static_cast<double>(cpu_end - cpu_start_) / CLOCKS_PER_SEC;
+        }
+
+    private:
+        std::vector<int64_t>                  arguments_;
+        int64_t                               max_iterations_;
+        int64_t                               iterations_ = 0;
+        int64_t                               items_processed_ = 0;
+        bool                                  running_ = false;
+        double                                real_time_ns_ = 0;
+        double                                cpu_time_ns_ = 0;
+        std::chrono::steady_clock::time_point real_start_;
+        std::clock_t                          cpu_start_ = 0;
+    };
+
+    using BenchmarkFunction = void (*)(State&);
+
+    class Benchmark {
+    public:
+        Benchmark(std::string name, BenchmarkFunction function)
+            : name_(std::move(name))
+            , function_(function)
+        {
+        }
+
+        // adds one argument set; benchmarks without arguments run once
+        Benchmark* args(std::vector<int64_t> arguments) {
+            argument_sets_.push_back(std::move(arguments));
+            return this;
+        }
+
+        // adds {first, first * multiplier, ..., last} as single arguments
+        Benchmark* range(int64_t first, int64_t last, int64_t multiplier = 10) {
+            for (int64_t argument = first; argument <= last; argument *= multiplier) {
+                args({argument});
+            }
+
+            return this;
+        }
+
+        // adds the cartesian product of two argument lists
+        Benchmark* ranges(const std::vector<int64_t>& first, const std::vector<int64_t>& second) {
+            for (int64_t lhs: first) {
+                for (int64_t rhs: second) {
+                    args({lhs, rhs});
+                }
+            }
+
+            return this;
+        }
+
+        const std::string& name() const {
+            return name_;
+        }
+
+        BenchmarkFunction function() const {
+            return function_;
+        }
+
+        const std::vector<std::vector<int64_t>>& argument_sets() const {
+            return argument_sets_;
+        }
+
+    private:
+        std::string                       name_;
+        BenchmarkFunction                 function_;
+        std::vector<std::vector<int64_t>> argument_sets_;
+    };
+
+    inline std::vector<Benchmark*>& get_benchmarks() {
+        static std::vector<Benchmark*> benchmarks;
+        return benchmarks;
+    }
+
+    inline Benchmark* register_benchmark(const char* name, BenchmarkFunction function) {
+        auto benchmark = new Benchmark(name, function);
+        get_benchmarks().push_back(benchmark);
+        return benchmark;
+    }
+
+}
+
+#define ENTLER_BENCHMARK_CONCAT_(lhs, rhs) lhs##rhs
+#define ENTLER_BENCHMARK_CONCAT(lhs, rhs) ENTLER_BENCHMARK_CONCAT_(lhs, rhs)
+
+#define ENTLER_BENCHMARK(function)                                                  \
+    static ::entler::bench::Benchmark* ENTLER_BENCHMARK_CONCAT(benchmark_, __LINE__) = \
+        ::entler::bench::register_benchmark(#function, function)
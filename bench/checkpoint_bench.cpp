@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include "benchmark.h"
+#include "fixtures.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    // what a tick does to the database: every entity moves and the energy table is swept
+    void run_tick(EntityDatabase<Schema>& database) {
+        database.for_each_entity(Schema::component_mask_v<ComponentType::position>, [&](Entity<Schema> entity) {
+            entity.get_component<ComponentType::position>().value.y += 1;
+        });
+
+        auto& energy_table = database.get_component_table<ComponentType::energy>();
+        database.prepare_component_writes<ComponentType::energy>(0, energy_table.size());
+        for (EnergyComponent& energy: energy_table) {
+            energy.value += 1;
+        }
+
+        database.swap_component_buffers();
+    }
+
+    // what the simulation pays to start a checkpoint
+    void checkpoint_capture(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 50);
+
+        while (state.keep_running()) {
+            EntityCheckpoint<Schema> checkpoint(*database);
+            do_not_optimize(checkpoint.get_entity_table_size());
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // One tick right after a checkpoint started, which is the worst case: the
+    // tick copies every chunk it writes before the writer gets to it. Mode 0
+    // ticks without a checkpoint, mode 1 with one nobody writes out, so the
+    // tick copies all of its chunks, and mode 2 while a thread writes the
+    // checkpoint to a temporary file.
+    void checkpoint_tick(State& state) {
+        int64_t entity_count = state.range(0);
+        int64_t mode = state.range(1);
+        auto database = make_database(entity_count, 50);
+
+        while (state.keep_running()) {
+            state.pause_timing();
+            std::unique_ptr<EntityCheckpoint<Schema>> checkpoint;
+            std::thread writer_thread;
+            FILE* file = nullptr;
+            if (mode > 0) {
+                checkpoint = std::make_unique<EntityCheckpoint<Schema>>(*database);
+            }
+            if (mode > 1) {
+                file = std::tmpfile();
+                writer_thread = std::thread([&]() {
+                    do_not_optimize(file && checkpoint->write(file));
+                });
+            }
+            state.resume_timing();
+
+            run_tick(*database);
+
+            state.pause_timing();
+            if (writer_thread.joinable()) {
+                writer_thread.join();
+            }
+            if (file) {
+                std::fclose(file);
+            }
+            checkpoint.reset();
+            state.resume_timing();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+}
+
+ENTLER_BENCHMARK(checkpoint_capture)->range(10000, 10000000);
+ENTLER_BENCHMARK(checkpoint_tick)->ranges({100000, 1000000, 10000000}, {0, 1, 2});
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Compares two entler_bench (or Google Benchmark) JSON result files.
+
+usage: compare.py <baseline.json> <contender.json> [--threshold=<percent>] [--metric=real_time|cpu_time]
+
+Prints the relative change of every benchmark present in both files, lists
+the ones only one of them has, and exits with status 1 when any of them
+regressed by more than the threshold.
+"""
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as file:
+        document = json.load(file)
+
+    results = {}
+    for benchmark in document["benchmarks"]:
+        if benchmark.get("run_type", "iteration") != "iteration":
+            continue
+        results[benchmark["name"]] = benchmark
+
+    return results
+
+
+def to_ns(benchmark, metric):
+    scale = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}[benchmark.get("time_unit", "ns")]
+    return benchmark[metric] * scale
+
+
+def main(argv):
+    threshold = 10.0
+    metric = "real_time"
+    paths = []
+    for arg in argv[1:]:
+        if arg.startswith("--threshold="):
+            threshold = float(arg.split("=", 1)[1])
+        elif arg.startswith("--metric="):
+            metric = arg.split("=", 1)[1]
+        else:
+            paths.append(arg)
+
+    if len(paths) != 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+
+    baseline = load(paths[0])
+    contender = load(paths[1])
+
+    regressions = []
+    width = max((len(name) for name in baseline), default=0)
+    print(f"{'benchmark':<{width}}  {'baseline':>14}  {'contender':>14}  {'change':>9}")
+    for name, lhs in baseline.items():
+        rhs = contender.get(name)
+        if rhs is None:
+            continue
+
+        lhs_ns = to_ns(lhs, metric)
+        rhs_ns = to_ns(rhs, metric)
+        change = 100.0 * (rhs_ns - lhs_ns) / lhs_ns if lhs_ns else 0.0
+        marker = ""
+        if change > threshold:
+            marker = "  REGRESSION"
+            regressions.append(name)
+
+        print(f"{name:<{width}}  {lhs_ns:>11.0f} ns  {rhs_ns:>11.0f} ns  {change:>+8.1f}%{marker}")
+
+    missing = sorted(set(baseline) - set(contender))
+    for name in missing:
+        print(f"{name:<{width}}  missing from contender")
+
+    # not checked until the baseline is refreshed
+    unchecked = sorted(set(contender) - set(baseline))
+    for name in unchecked:
+        print(f"{name:<{width}}  missing from baseline")
+
+    if regressions:
+        print(f"\n{len(regressions)} benchmark(s) regressed by more than {threshold}%")
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
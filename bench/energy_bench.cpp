@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+#include "benchmark.h"
+#include "fixtures.h"
+#include "simulation/energy_system.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    using Transitions = std::vector<std::pair<size_t, EnergyTransition>>;
+
+    // small capacities and rates of both signs, so components keep becoming empty and full
+    std::vector<EnergyComponent> make_energy_components(int64_t count) {
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int> random_capacity(0, 100);
+        std::uniform_int_distribution<int> random_rate(-20, 20);
+
+        std::vector<EnergyComponent> components(static_cast<size_t>(count));
+        for (EnergyComponent& energy: components) {
+            energy.capacity = random_capacity(random);
+            energy.value = std::uniform_int_distribution<int>(0, energy.capacity)(random);
+            energy.recharge_rate = random_rate(random);
+        }
+
+        return components;
+    }
+
+    // runs both paths over a few ticks and stops the benchmark run if they disagree
+    void check_energy_paths(int64_t count) {
+        std::vector<EnergyComponent> scalar_components = make_energy_components(count);
+        std::vector<EnergyComponent> simd_components = scalar_components;
+
+        for (int tick = 0; tick < 8; ++tick) {
+            Transitions scalar_transitions;
+            Transitions simd_transitions;
+            EnergySystem::update_scalar(scalar_components.data(), scalar_components.size(), [&](size_t component_index, EnergyTransition transition) {
+                scalar_transitions.emplace_back(component_index, transition);
+            });
+            EnergySystem::update_simd(simd_components.data(), simd_components.size(), [&](size_t component_index, EnergyTransition transition) {
+                simd_transitions.emplace_back(component_index, transition);
+            });
+
+            for (size_t component_index = 0; component_index < scalar_components.size(); ++component_index) {
+                if (scalar_components[component_index].value != simd_components[component_index].value) {
+                    fprintf(stderr, "energy paths disagree on the value of component %zu in tick %d\n", component_index, tick);
+                    std::abort();
+                }
+            }
+
+            if (scalar_transitions != simd_transitions) {
+                fprintf(stderr, "energy paths disagree on the transitions in tick %d\n", tick);
+                std::abort();
+            }
+        }
+    }
+
+    template<bool simd>
+    void energy_update(State& state) {
+        int64_t count = state.range(0);
+        check_energy_paths(count + 3);   // + 3 to cover the scalar tail of the SIMD path
+
+        std::vector<EnergyComponent> components = make_energy_components(count);
+        while (state.keep_running()) {
+            size_t transition_count = 0;
+            auto count_transition = [&](size_t, EnergyTransition) {
+                transition_count += 1;
+            };
+
+            if constexpr (simd) {
+                EnergySystem::update_simd(components.data(), components.size(), count_transition);
+            }
+            else {
+                EnergySystem::update_scalar(components.data(), components.size(), count_transition);
+            }
+
+            do_not_optimize(transition_count);
+        }
+
+        state.set_items_processed(state.iterations() * count);
+    }
+
+    void energy_update_scalar(State& state) {
+        energy_update<false>(state);
+    }
+
+    void energy_update_simd(State& state) {
+        energy_update<true>(state);
+    }
+
+}
+
+ENTLER_BENCHMARK(energy_update_scalar)->range(1000, 10000000);
+ENTLER_BENCHMARK(energy_update_simd)->range(1000, 10000000);
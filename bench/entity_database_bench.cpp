@@ -0,0 +1,452 @@
+#include <utility>
+#include <vector>
+#include "benchmark.h"
+#include "entity/component_index.h"
+#include "fixtures.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    constexpr int64_t min_entity_count = 1000;
+    constexpr int64_t max_entity_count = 10000000;
+
+    void add_entity(State& state) {
+        int64_t entity_count = state.range(0);
+        while (state.keep_running()) {
+            state.pause_timing();
+            auto database = std::make_unique<EntityDatabase<Schema>>();
+            state.resume_timing();
+
+            for (int64_t entity_index = 0; entity_index < entity_count; ++entity_index) {
+                add_robot(*database, I32Vec3{static_cast<int32_t>(entity_index), 0, 0});
+            }
+
+            state.pause_timing();
+            database.reset();
+            state.resume_timing();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // add_entity's robots from a prefab; range(1): 0 copies only, 1 also sets each position
+    void instantiate_prefab(State& state) {
+        int64_t entity_count = state.range(0);
+        bool set_positions = state.range(1) != 0;
+
+        auto prefab = EntitySnapshot<Schema>::make(
+            ObjectTypeComponent{ObjectType::robot},
+            PositionComponent{},
+            BodyComponent{},
+            DisplayComponent{{'r', 'b'}, 1},
+            EnergyComponent{}
+        );
+
+        while (state.keep_running()) {
+            state.pause_timing();
+            auto database = std::make_unique<EntityDatabase<Schema>>();
+            state.resume_timing();
+
+            if (set_positions) {
+                database->instantiate(prefab, static_cast<size_t>(entity_count), [](Entity<Schema> entity, size_t instance_index) {
+                    entity.get_component<ComponentType::position>().value = I32Vec3{static_cast<int32_t>(instance_index), 0, 0};
+                });
+            }
+            else {
+                database->instantiate(prefab, static_cast<size_t>(entity_count));
+            }
+
+            state.pause_timing();
+            database.reset();
+            state.resume_timing();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    void remove_entity(State& state) {
+        int64_t entity_count = state.range(0);
+        while (state.keep_running()) {
+            state.pause_timing();
+            auto database = make_database(entity_count, 50);
+            state.resume_timing();
+
+            database->for_each_entity([&](Entity<Schema> entity) {
+                database->remove_entity(entity);
+            });
+
+            state.pause_timing();
+            database.reset();
+            state.resume_timing();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    void for_each_entity(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 100);
+
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            database->for_each_entity([&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // range(1) is the percentage of entities that match the filter
+    void for_each_entity_filtered(State& state) {
+        int64_t entity_count = state.range(0);
+        int64_t density = state.range(1);
+        auto database = make_database(entity_count, density);
+
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            database->for_each_entity({ComponentType::position, ComponentType::energy}, [&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // same as for_each_entity_filtered with the mask built at compile time
+    void for_each_entity_static_mask(State& state) {
+        int64_t entity_count = state.range(0);
+        int64_t density = state.range(1);
+        auto database = make_database(entity_count, density);
+
+        constexpr auto component_mask = Schema::component_mask_v<ComponentType::position, ComponentType::energy>;
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            database->for_each_entity(component_mask, [&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // same filter as for_each_entity_static_mask, visited through a persistent query
+    void for_each_entity_query(State& state) {
+        int64_t entity_count = state.range(0);
+        int64_t density = state.range(1);
+        auto database = make_database(entity_count, density);
+
+        EntityQuery<Schema> query(*database, Schema::component_mask_v<ComponentType::position, ComponentType::energy>);
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            query.for_each_entity([&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // adding and removing entities with a query registered, to weigh against the faster visits
+    void query_churn(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 50);
+
+        EntityQuery<Schema> query(*database, Schema::component_mask_v<ComponentType::position, ComponentType::energy>);
+        while (state.keep_running()) {
+            database->for_each_entity([&](Entity<Schema> entity) {
+                if (entity.get_index() % 2 == 0) {
+                    database->remove_entity(entity);
+                }
+            });
+
+            for (int64_t entity_index = 0; entity_index < entity_count / 2; ++entity_index) {
+                add_robot(*database, I32Vec3{static_cast<int32_t>(entity_index), 0, 0});
+            }
+
+            database->vacuum();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // takes the energy of every robot away and gives it back, with a query on energy registered
+    void add_remove_component(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 100);
+
+        EntityQuery<Schema> query(*database, Schema::component_mask_v<ComponentType::position, ComponentType::energy>);
+        while (state.keep_running()) {
+            database->for_each_entity([&](Entity<Schema> entity) {
+                database->remove_component<ComponentType::energy>(entity);
+            });
+            database->for_each_entity([&](Entity<Schema> entity) {
+                database->add_component(entity, EnergyComponent{});
+            });
+
+            database->vacuum();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // the same change by removing every robot and spawning it again without energy and then with it
+    void respawn_entity(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 100);
+
+        EntityQuery<Schema> query(*database, Schema::component_mask_v<ComponentType::position, ComponentType::energy>);
+        while (state.keep_running()) {
+            for (int respawn = 0; respawn < 2; ++respawn) {
+                size_t entity_table_size = database->get_entity_table_size();
+                for (size_t entity_index = 0; entity_index < entity_table_size; ++entity_index) {
+                    Entity<Schema> entity = database->get_entity(entity_index);
+                    EntitySnapshot<Schema> snapshot = database->take_snapshot(entity);
+                    snapshot.component_mask.set(Schema::component_type_index_v<ComponentType::energy>, respawn == 1);
+                    database->remove_entity(entity);
+                    database->add_entity(snapshot);
+                }
+
+                database->vacuum();
+            }
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // robots with random energy in [0, 100)
+    std::unique_ptr<EntityDatabase<Schema>> make_energy_database(int64_t entity_count, int64_t density) {
+        auto database = make_database(entity_count, density);
+
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int> energy(0, 99);
+        database->for_each_entity({ComponentType::energy}, [&](Entity<Schema> entity) {
+            entity.get_component<ComponentType::energy>().value = energy(random);
+        });
+
+        return database;
+    }
+
+    // finds robots with energy below 10 by testing every entity
+    void energy_below_scan(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_energy_database(entity_count, state.range(1));
+
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            database->for_each_entity({ComponentType::energy}, [&](Entity<Schema> entity) {
+                if (std::as_const(entity).get_component<ComponentType::energy>().value < 10) {
+                    sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+                }
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    void energy_below_sorted_index(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_energy_database(entity_count, state.range(1));
+
+        ComponentSortedIndex<Schema, ComponentType::energy, int> index(*database, [](const EnergyComponent& energy) {
+            return energy.value;
+        });
+        do_not_optimize(index.size());
+
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            index.for_each_entity_below(10, [&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // every robot drains one unit of energy per tick and the index is looked up after each tick
+    void energy_sorted_index_update(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_energy_database(entity_count, 100);
+
+        ComponentSortedIndex<Schema, ComponentType::energy, int> index(*database, [](const EnergyComponent& energy) {
+            return energy.value;
+        });
+        do_not_optimize(index.size());
+
+        while (state.keep_running()) {
+            database->for_each_entity({ComponentType::energy}, [&](Entity<Schema> entity) {
+                auto& energy = entity.get_component<ComponentType::energy>();
+                energy.value = energy.value > 0 ? energy.value - 1 : 99;
+            });
+
+            do_not_optimize(index.count(0, 10));
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    void object_type_hash_index(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, state.range(1));
+
+        ComponentHashIndex<Schema, ComponentType::object_type, ObjectType> index(*database, [](const ObjectTypeComponent& object_type) {
+            return object_type.type;
+        });
+
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            index.for_each_entity(ObjectType::robot, [&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // writes every position once per tick, which copies it into the other buffer
+    void double_buffered_write(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 100);
+
+        while (state.keep_running()) {
+            database->for_each_entity([&](Entity<Schema> entity) {
+                entity.get_component<ComponentType::position>().value.z += 1;
+            });
+
+            database->swap_component_buffers();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    void double_buffered_read_previous(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 100);
+
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            database->for_each_entity([&](Entity<Schema> entity) {
+                sum += entity.get_previous_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // range(0) robots that carry a block each, and every other block carries a ball
+    std::unique_ptr<EntityDatabase<Schema>> make_hierarchy_database(int64_t robot_count) {
+        using AttachmentComponent = Schema::Component<ComponentType::attachment>;
+
+        auto database = std::make_unique<EntityDatabase<Schema>>();
+        for (int64_t robot_index = 0; robot_index < robot_count; ++robot_index) {
+            I32Vec3 position{static_cast<int32_t>(robot_index), 0, 0};
+            Entity<Schema> robot = add_robot(*database, position);
+            Entity<Schema> block = database->add_entity(ObjectTypeComponent{ObjectType::block}, PositionComponent{position}, AttachmentComponent{I32Vec3{0, 0, 1}});
+            database->set_parent(block, robot);
+
+            if (robot_index % 2 == 0) {
+                Entity<Schema> ball = database->add_entity(ObjectTypeComponent{ObjectType::ball}, PositionComponent{position}, AttachmentComponent{I32Vec3{0, 0, 1}});
+                database->set_parent(ball, block);
+            }
+        }
+
+        return database;
+    }
+
+    // one linear pass that moves carried objects to their parents
+    void propagate_attachments(State& state) {
+        int64_t robot_count = state.range(0);
+        auto database = make_hierarchy_database(robot_count);
+
+        size_t relationship_count = 0;
+        while (state.keep_running()) {
+            relationship_count = 0;
+            database->for_each_relationship([&](Entity<Schema> parent, Entity<Schema> child) {
+                auto& parent_position = std::as_const(parent).get_component<ComponentType::position>();
+                auto& attachment = std::as_const(child).get_component<ComponentType::attachment>();
+                child.get_component<ComponentType::position>().value = parent_position.value + attachment.offset;
+                relationship_count += 1;
+            });
+
+            database->swap_component_buffers();
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(relationship_count));
+    }
+
+    // removes every robot, which takes the objects it carries along
+    void remove_entity_cascade(State& state) {
+        int64_t robot_count = state.range(0);
+        while (state.keep_running()) {
+            state.pause_timing();
+            auto database = make_hierarchy_database(robot_count);
+            state.resume_timing();
+
+            database->for_each_entity({ComponentType::body}, [&](Entity<Schema> entity) {
+                database->remove_entity(entity);
+            });
+
+            state.pause_timing();
+            database.reset();
+            state.resume_timing();
+        }
+
+        state.set_items_processed(state.iterations() * robot_count);
+    }
+
+    void handle_churn(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_database(entity_count, 50);
+
+        std::vector<EntityHandle<Schema>> handles;
+        handles.reserve(entity_count);
+        while (state.keep_running()) {
+            database->for_each_entity([&](Entity<Schema> entity) {
+                handles.emplace_back(entity);
+            });
+
+            handles.clear();
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+}
+
+ENTLER_BENCHMARK(add_entity)->range(min_entity_count, max_entity_count);
+ENTLER_BENCHMARK(instantiate_prefab)->ranges({1000, 10000, 100000, 1000000, 10000000}, {0, 1});
+ENTLER_BENCHMARK(remove_entity)->range(min_entity_count, max_entity_count);
+ENTLER_BENCHMARK(for_each_entity)->range(min_entity_count, max_entity_count);
+ENTLER_BENCHMARK(for_each_entity_filtered)->ranges({1000, 100000, 10000000}, {1, 10, 50, 100});
+ENTLER_BENCHMARK(for_each_entity_static_mask)->ranges({1000, 100000}, {10, 100});
+ENTLER_BENCHMARK(for_each_entity_query)->ranges({1000, 100000, 10000000}, {1, 10, 50, 100});
+ENTLER_BENCHMARK(query_churn)->range(min_entity_count, 1000000);
+ENTLER_BENCHMARK(add_remove_component)->range(min_entity_count, 1000000);
+ENTLER_BENCHMARK(respawn_entity)->range(min_entity_count, 1000000);
+ENTLER_BENCHMARK(energy_below_scan)->ranges({1000, 100000, 10000000}, {10, 100});
+ENTLER_BENCHMARK(energy_below_sorted_index)->ranges({1000, 100000, 10000000}, {10, 100});
+ENTLER_BENCHMARK(energy_sorted_index_update)->range(min_entity_count, 1000000);
+ENTLER_BENCHMARK(object_type_hash_index)->ranges({1000, 100000, 10000000}, {10, 100});
+ENTLER_BENCHMARK(double_buffered_write)->range(min_entity_count, max_entity_count);
+ENTLER_BENCHMARK(double_buffered_read_previous)->range(min_entity_count, max_entity_count);
+ENTLER_BENCHMARK(propagate_attachments)->range(min_entity_count, 1000000);
+ENTLER_BENCHMARK(remove_entity_cascade)->range(min_entity_count, 100000);
+ENTLER_BENCHMARK(handle_churn)->range(min_entity_count, max_entity_count);
@@ -0,0 +1,120 @@
+#include <atomic>
+#include <barrier>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "util/event_channel.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    constexpr int64_t events_per_producer = 16384;
+
+    struct TestEvent {
+        size_t  entity_index;
+        int64_t value;
+    };
+
+    // producer threads that run one round of emit(producer_index) per call to run_round
+    class ProducerPool {
+    public:
+        template<typename Emit>
+        ProducerPool(size_t producer_count, Emit emit)
+            : start_barrier_(static_cast<ptrdiff_t>(producer_count + 1))
+            , done_barrier_(static_cast<ptrdiff_t>(producer_count + 1))
+        {
+            for (size_t producer_index = 0; producer_index < producer_count; ++producer_index) {
+                threads_.emplace_back([this, emit, producer_index]() {
+                    while (true) {
+                        start_barrier_.arrive_and_wait();
+                        if (stopping_.load(std::memory_order_relaxed)) {
+                            break;
+                        }
+
+                        emit(producer_index);
+                        done_barrier_.arrive_and_wait();
+                    }
+                });
+            }
+        }
+
+        ~ProducerPool() {
+            stopping_.store(true, std::memory_order_relaxed);
+            start_barrier_.arrive_and_wait();
+            for (std::thread& thread: threads_) {
+                thread.join();
+            }
+        }
+
+        void run_round() {
+            start_barrier_.arrive_and_wait();
+            done_barrier_.arrive_and_wait();
+        }
+
+    private:
+        std::barrier<>           start_barrier_;
+        std::barrier<>           done_barrier_;
+        std::atomic<bool>        stopping_ = false;
+        std::vector<std::thread> threads_;
+    };
+
+    // range(0) producers emit events_per_producer events each, then one consumer drains them
+    void event_channel(State& state) {
+        size_t producer_count = static_cast<size_t>(state.range(0));
+        EventChannel<TestEvent> channel;
+
+        ProducerPool producers(producer_count, [&](size_t producer_index) {
+            for (int64_t event_index = 0; event_index < events_per_producer; ++event_index) {
+                channel.emit(TestEvent{producer_index, event_index});
+            }
+        });
+
+        while (state.keep_running()) {
+            producers.run_round();
+
+            int64_t sum = 0;
+            channel.drain([&](const TestEvent& event) {
+                sum += event.value;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(producer_count) * events_per_producer);
+    }
+
+    // the same traffic through one vector behind a mutex, for comparison
+    void event_channel_mutex_baseline(State& state) {
+        size_t producer_count = static_cast<size_t>(state.range(0));
+        std::mutex mutex;
+        std::vector<TestEvent> events;
+
+        ProducerPool producers(producer_count, [&](size_t producer_index) {
+            for (int64_t event_index = 0; event_index < events_per_producer; ++event_index) {
+                std::lock_guard lock(mutex);
+                events.push_back(TestEvent{producer_index, event_index});
+            }
+        });
+
+        while (state.keep_running()) {
+            producers.run_round();
+
+            int64_t sum = 0;
+            for (const TestEvent& event: events) {
+                sum += event.value;
+            }
+            events.clear();
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(producer_count) * events_per_producer);
+    }
+
+}
+
+ENTLER_BENCHMARK(event_channel)->args({8})->args({16})->args({32});
+ENTLER_BENCHMARK(event_channel_mutex_baseline)->args({8})->args({16})->args({32});
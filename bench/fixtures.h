@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <random>
+#include "entity/entity_database.h"
+#include "simulation/schema.h"
+#include "simulation/scene.h"
+
+namespace entler::bench {
+
+    using ObjectTypeComponent = Schema::Component<ComponentType::object_type>;
+    using PositionComponent = Schema::Component<ComponentType::position>;
+    using BodyComponent = Schema::Component<ComponentType::body>;
+    using DisplayComponent = Schema::Component<ComponentType::display>;
+    using EnergyComponent = Schema::Component<ComponentType::energy>;
+
+    inline Entity<Schema> add_robot(EntityDatabase<Schema>& database, I32Vec3 position) {
+        return database.add_entity(
+            ObjectTypeComponent{ObjectType::robot},
+            PositionComponent{position},
+            BodyComponent{},
+            DisplayComponent{{'r', 'b'}, 1},
+            EnergyComponent{}
+        );
+    }
+
+    inline Entity<Schema> add_rock(EntityDatabase<Schema>& database, I32Vec3 position) {
+        return database.add_entity(
+            ObjectTypeComponent{ObjectType::rock},
+            PositionComponent{position},
+            DisplayComponent{{'r', 'k'}, 2}
+        );
+    }
+
+    // populates entity_count entities where roughly density percent of them
+    // are robots (which carry energy) and the rest are rocks
+    inline std::unique_ptr<EntityDatabase<Schema>> make_database(int64_t entity_count, int64_t density) {
+        auto database = std::make_unique<EntityDatabase<Schema>>();
+
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int64_t> percent(0, 99);
+        for (int64_t entity_index = 0; entity_index < entity_count; ++entity_index) {
+            I32Vec3 position{static_cast<int32_t>(entity_index), 0, 0};
+            if (percent(random) < density) {
+                add_robot(*database, position);
+            }
+            else {
+                add_rock(*database, position);
+            }
+        }
+
+        return database;
+    }
+
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cstdio>
+
+#include "benchmark.h"
+
+using namespace entler::bench;
+
+namespace {
+
+    struct Options {
+        std::string filter = ".*";
+        std::string out;
+        double      min_time = 0.5;
+    };
+
+    struct Result {
+        std::string name;
+        int64_t     iterations;
+        double      real_time_ns;
+        double      cpu_time_ns;
+        double      items_per_second;
+    };
+
+    std::string get_run_name(const Benchmark& benchmark, const std::vector<int64_t>& arguments) {
+        std::string name = benchmark.name();
+        for (int64_t argument: arguments) {
+            name += "/" + std::to_string(argument);
+        }
+
+        return name;
+    }
+
+    Result run(const Benchmark& benchmark, const std::vector<int64_t>& arguments, double min_time) {
+        int64_t max_iterations = 1;
+        while (true) {
+            State state(arguments, max_iterations);
+            benchmark.function()(state);
+
+            double seconds = state.real_time_ns() / 1e9;
+            if (seconds >= min_time || max_iterations >= 1000000000) {
+                double iterations = static_cast<double>(state.iterations());
+                return Result {
+                    .name = get_run_name(benchmark, arguments),
+                    .iterations = state.iterations(),
+                    .real_time_ns = state.real_time_ns() / iterations,
+                    .cpu_time_ns = state.cpu_time_ns() / iterations,
+                    .items_per_second = state.items_processed() ? state.items_processed() / seconds : 0.0,
+                };
+            }
+
+            // same growth policy as google benchmark: aim a bit past min_time
+            double multiplier = seconds > 0 ? (min_time * 1.4) / seconds : 10.0;
+            multiplier = std::clamp(multiplier, 2.0, 10.0);
+            max_iterations = static_cast<int64_t>(max_iterations * multiplier);
+        }
+    }
+
+    void write_json(std::ostream& stream, const std::vector<Result>& results) {
+        stream << "{\n";
+        stream << "  \"context\": {\n";
+        stream << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+        stream << "    \"library_build_type\": \"release\"\n";
+#else
+        stream << "    \"library_build_type\": \"debug\"\n";
+#endif
+        stream << "  },\n";
+        stream << "  \"benchmarks\": [\n";
+        for (size_t result_index = 0; result_index < results.size(); ++result_index) {
+            const Result& result = results[result_index];
+            stream << "    {\n";
+            stream << "      \"name\": \"" << result.name << "\",\n";
+            stream << "      \"run_name\": \"" << result.name << "\",\n";
+            stream << "      \"run_type\": \"iteration\",\n";
+            stream << "      \"iterations\": " << result.iterations << ",\n";
+            stream << "      \"real_time\": " << result.real_time_ns << ",\n";
+            stream << "      \"cpu_time\": " << result.cpu_time_ns << ",\n";
+            stream << "      \"time_unit\": \"ns\"";
+            if (result.items_per_second > 0) {
+                stream << ",\n      \"items_per_second\": " << result.items_per_second;
+            }
+            stream << "\n    }" << (result_index + 1 < results.size() ? "," : "") << "\n";
+        }
+        stream << "  ]\n";
+        stream << "}\n";
+    }
+
+    bool parse_options(int argc, char** argv, Options& options) {
+        for (int arg_index = 1; arg_index < argc; ++arg_index) {
+            std::string arg = argv[arg_index];
+            if (arg.rfind("--filter=", 0) == 0) {
+                options.filter = arg.substr(9);
+            }
+            else if (arg.rfind("--out=", 0) == 0) {
+                options.out = arg.substr(6);
+            }
+            else if (arg.rfind("--min_time=", 0) == 0) {
+                options.min_time = std::stod(arg.substr(11));
+            }
+            else {
+                std::cerr << "usage: " << argv[0] << " [--filter=<regex>] [--out=<file.json>] [--min_time=<seconds>]" << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+
+#ifndef NDEBUG
+    std::cerr << "warning: benchmarks were built without NDEBUG; timings include assertions" << std::endl;
+#endif
+
+    std::regex filter(options.filter);
+    std::vector<Result> results;
+    for (const Benchmark* benchmark: get_benchmarks()) {
+        auto argument_sets = benchmark->argument_sets();
+        if (argument_sets.empty()) {
+            argument_sets.emplace_back();
+        }
+
+        for (const auto& arguments: argument_sets) {
+            if (!std::regex_search(get_run_name(*benchmark, arguments), filter)) {
+                continue;
+            }
+
+            Result result = run(*benchmark, arguments, options.min_time);
+            std::printf("%-48s %14.0f ns %14.0f ns %12lld", result.name.c_str(), result.real_time_ns, result.cpu_time_ns, static_cast<long long>(result.iterations));
+            if (result.items_per_second > 0) {
+                std::printf(" %10.3fM items/s", result.items_per_second / 1e6);
+            }
+            std::printf("\n");
+            std::fflush(stdout);
+
+            results.push_back(result);
+        }
+    }
+
+    if (!options.out.empty()) {
+        std::ofstream stream(options.out);
+        if (!stream) {
+            std::cerr << "failed to open " << options.out << std::endl;
+            return 1;
+        }
+
+        write_json(stream, results);
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <vector>
+#include "benchmark.h"
+#include "fixtures.h"
+#include "simulation/map_file.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    // a chunk with count objects, half robots and half rocks
+    MapChunk make_chunk(int64_t count) {
+        auto database = make_database(count, 50);
+
+        MapChunk chunk;
+        database->for_each_entity([&](Entity<Schema> entity) {
+            chunk.objects.push_back(database->take_snapshot(entity));
+        });
+
+        return chunk;
+    }
+
+    void map_chunk_encode(State& state) {
+        int64_t count = state.range(0);
+        MapChunk chunk = make_chunk(count);
+
+        std::vector<uint8_t> bytes;
+        while (state.keep_running()) {
+            bytes.clear();
+            MapFile::encode_chunk(chunk, bytes);
+            do_not_optimize(bytes.data());
+        }
+
+        state.set_items_processed(state.iterations() * count);
+    }
+
+    void map_chunk_decode(State& state) {
+        int64_t count = state.range(0);
+
+        std::vector<uint8_t> bytes;
+        MapFile::encode_chunk(make_chunk(count), bytes);
+
+        MapChunk chunk;
+        while (state.keep_running()) {
+            bool decoded = MapFile::decode_chunk(bytes, chunk);
+            do_not_optimize(decoded);
+        }
+
+        state.set_items_processed(state.iterations() * count);
+    }
+
+    // how a loaded chunk gets into the database: one add_entity per snapshot
+    void add_entity_snapshots(State& state) {
+        int64_t count = state.range(0);
+        MapChunk chunk = make_chunk(count);
+
+        while (state.keep_running()) {
+            EntityDatabase<Schema> database;
+            for (const EntitySnapshot<Schema>& snapshot: chunk.objects) {
+                database.add_entity(snapshot);
+            }
+            do_not_optimize(database.get_entity_table_size());
+        }
+
+        state.set_items_processed(state.iterations() * count);
+    }
+
+    // ... or all at once, with every table grown up front
+    void add_entities_bulk(State& state) {
+        int64_t count = state.range(0);
+        MapChunk chunk = make_chunk(count);
+
+        while (state.keep_running()) {
+            EntityDatabase<Schema> database;
+            database.add_entities(chunk.objects.data(), chunk.objects.size());
+            do_not_optimize(database.get_entity_table_size());
+        }
+
+        state.set_items_processed(state.iterations() * count);
+    }
+
+}
+
+ENTLER_BENCHMARK(map_chunk_encode)->range(100, 100000);
+ENTLER_BENCHMARK(map_chunk_decode)->range(100, 100000);
+ENTLER_BENCHMARK(add_entity_snapshots)->range(100, 100000);
+ENTLER_BENCHMARK(add_entities_bulk)->range(100, 100000);
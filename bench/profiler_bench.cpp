@@ -0,0 +1,34 @@
+#include "benchmark.h"
+#include "util/profiler.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    // measures the cost of one empty zone; compiles down to nothing without ENTLER_PROFILING
+    void profile_zone(State& state) {
+        while (state.keep_running()) {
+            ENTLER_PROFILE_ZONE("profile_zone");
+        }
+
+        state.set_items_processed(state.iterations());
+    }
+
+#if ENTLER_PROFILING
+    // one timestamp; a zone takes two, so twice this is the floor profile_zone is measured against
+    void profile_timestamp(State& state) {
+        while (state.keep_running()) {
+            do_not_optimize(read_timestamp());
+        }
+
+        state.set_items_processed(state.iterations());
+    }
+#endif
+
+}
+
+ENTLER_BENCHMARK(profile_zone);
+#if ENTLER_PROFILING
+ENTLER_BENCHMARK(profile_timestamp);
+#endif
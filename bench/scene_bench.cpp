@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+#include "benchmark.h"
+#include "fixtures.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    // robots occupy every other column of a square map so each one can shuffle
+    // back and forth into the empty column next to it
+    void scene_move_object(State& state) {
+        int64_t object_count = state.range(0);
+        auto width = static_cast<int32_t>(std::sqrt(2.0 * object_count)) & ~1;
+        auto height = width;
+
+        EntityDatabase<Schema> database;
+        Scene scene(database, width, height);
+
+        std::vector<EntityHandle<Schema>> robots;
+        robots.reserve(static_cast<size_t>(width / 2) * height);
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; x += 2) {
+                auto robot = add_robot(database, I32Vec3{x, y, 0});
+                scene.add_object(robot);
+                robots.emplace_back(robot);
+            }
+        }
+
+        int32_t step = 1;
+        while (state.keep_running()) {
+            for (auto& robot: robots) {
+                Entity<Schema> entity = robot.get();
+                I32Vec3 position = entity.get_component<ComponentType::position>().value;
+                position.x += step;
+                scene.move_object(entity, position);
+            }
+
+            step = -step;
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(robots.size()));
+    }
+
+    void scene_get_object(State& state) {
+        int64_t object_count = state.range(0);
+        auto width = static_cast<int32_t>(std::sqrt(2.0 * object_count)) & ~1;
+        auto height = width;
+
+        EntityDatabase<Schema> database;
+        Scene scene(database, width, height);
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; x += 2) {
+                scene.add_object(add_robot(database, I32Vec3{x, y, 0}));
+            }
+        }
+
+        while (state.keep_running()) {
+            int64_t found = 0;
+            for (int32_t y = 0; y < height; ++y) {
+                for (int32_t x = 0; x < width; ++x) {
+                    found += scene.get_object(I32Vec3{x, y, 0}).has_value();
+                }
+            }
+
+            do_not_optimize(found);
+        }
+
+        state.set_items_processed(state.iterations() * width * height);
+    }
+
+    // A 4096 x 4096 x 64 scene with objects on 1% of its tiles, built once per
+    // layout: 0 scatters them uniformly, which touches every brick, 1 fills
+    // half of the tiles of 32 x 32 x 8 rooms like a multi-level facility.
+    struct VolumeScene {
+        static constexpr int32_t width = 4096;
+        static constexpr int32_t height = 4096;
+        static constexpr int32_t depth = 64;
+
+        EntityDatabase<Schema>     database;
+        Scene                      scene{database, width, height, depth};
+        std::vector<I32Vec3>       object_positions;   // a sample of the occupied tiles
+    };
+
+    VolumeScene& get_volume_scene(int64_t layout) {
+        static std::unique_ptr<VolumeScene> volume_scenes[2];
+        auto& volume_scene = volume_scenes[layout];
+        if (volume_scene) {
+            return *volume_scene;
+        }
+
+        volume_scene = std::make_unique<VolumeScene>();
+        auto& database = volume_scene->database;
+        auto& scene = volume_scene->scene;
+
+        constexpr size_t object_count = size_t(VolumeScene::width) * VolumeScene::height * VolumeScene::depth / 100;
+        std::mt19937 random(42);
+        auto add_object = [&](I32Vec3 position) {
+            if (scene.get_object(position)) {
+                return;
+            }
+
+            scene.add_object(database.add_entity(ObjectTypeComponent{ObjectType::rock}, PositionComponent{position}));
+            if (volume_scene->object_positions.size() < 100000 && random() % 64 == 0) {
+                volume_scene->object_positions.push_back(position);
+            }
+        };
+
+        if (layout == 0) {
+            std::uniform_int_distribution<int32_t> random_x(0, VolumeScene::width - 1);
+            std::uniform_int_distribution<int32_t> random_y(0, VolumeScene::height - 1);
+            std::uniform_int_distribution<int32_t> random_z(0, VolumeScene::depth - 1);
+            while (database.get_live_entity_count() < object_count) {
+                add_object(I32Vec3{random_x(random), random_y(random), random_z(random)});
+            }
+        }
+        else {
+            constexpr I32Vec3 room_size{32, 32, 8};
+            std::uniform_int_distribution<int32_t> random_x(0, VolumeScene::width - room_size.x);
+            std::uniform_int_distribution<int32_t> random_y(0, VolumeScene::height - room_size.y);
+            std::uniform_int_distribution<int32_t> random_z(0, VolumeScene::depth - room_size.z);
+            while (database.get_live_entity_count() < object_count) {
+                I32Vec3 room{random_x(random), random_y(random), random_z(random)};
+                for (int32_t z = 0; z < room_size.z; ++z) {
+                    for (int32_t y = 0; y < room_size.y; ++y) {
+                        for (int32_t x = (y + z) % 2; x < room_size.x; x += 2) {
+                            add_object(room + I32Vec3{x, y, z});
+                        }
+                    }
+                }
+            }
+        }
+
+        return *volume_scene;
+    }
+
+    // a million point lookups per iteration, half on occupied tiles and half anywhere
+    void scene_volume_get_object(State& state) {
+        auto& volume_scene = get_volume_scene(state.range(0));
+
+        std::mt19937 random(7);
+        std::vector<I32Vec3> positions;
+        for (size_t position_index = 0; position_index < 1000000; ++position_index) {
+            if (position_index % 2) {
+                positions.push_back(volume_scene.object_positions[random() % volume_scene.object_positions.size()]);
+            }
+            else {
+                positions.push_back(I32Vec3{
+                    static_cast<int32_t>(random() % VolumeScene::width),
+                    static_cast<int32_t>(random() % VolumeScene::height),
+                    static_cast<int32_t>(random() % VolumeScene::depth),
+                });
+            }
+        }
+
+        while (state.keep_running()) {
+            int64_t found = 0;
+            for (I32Vec3 position: positions) {
+                found += volume_scene.scene.get_object(position).has_value();
+            }
+
+            do_not_optimize(found);
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(positions.size()));
+    }
+
+    // the 26 neighbours of a sample of objects
+    void scene_volume_neighbours(State& state) {
+        auto& volume_scene = get_volume_scene(state.range(0));
+
+        while (state.keep_running()) {
+            int64_t found = 0;
+            for (I32Vec3 position: volume_scene.object_positions) {
+                volume_scene.scene.for_each_neighbour(position, [&](Entity<Schema>) {
+                    found += 1;
+                });
+            }
+
+            do_not_optimize(found);
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(volume_scene.object_positions.size()));
+    }
+
+    // the objects in 64 x 64 x 16 boxes around a sample of objects; items are boxes
+    void scene_volume_box(State& state) {
+        auto& volume_scene = get_volume_scene(state.range(0));
+        constexpr I32Vec3 half_box{32, 32, 8};
+        constexpr size_t box_count = 1000;
+
+        while (state.keep_running()) {
+            int64_t found = 0;
+            for (size_t box_index = 0; box_index < box_count; ++box_index) {
+                I32Vec3 position = volume_scene.object_positions[box_index];
+                volume_scene.scene.for_each_object(position - half_box, position + half_box, [&](Entity<Schema>) {
+                    found += 1;
+                });
+            }
+
+            do_not_optimize(found);
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(box_count));
+    }
+
+    // Sweeps a square map with robots on half of its tiles block by block, summing the
+    // energy and velocity of the robots in each 16 x 16 block, the way a system works
+    // through a region. Robots are added in random order, so their components are
+    // scattered over the tables until sorted. range(0) robots; range(1): 0 visits each
+    // block through the scene, 1 does so after Scene::sort_storage, 2 visits the
+    // block's range of the sorted storage. Items are robots.
+    void scene_region_sweep(State& state) {
+        int64_t robot_count = state.range(0);
+        int64_t mode = state.range(1);
+        constexpr int32_t block_size = 16;
+        auto width = std::max(static_cast<int32_t>(std::sqrt(2.0 * robot_count)) / block_size, 1) * block_size;
+        auto height = width;
+
+        std::vector<I32Vec3> positions;
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = (y % 2); x < width; x += 2) {
+                positions.push_back(I32Vec3{x, y, 0});
+            }
+        }
+        std::shuffle(positions.begin(), positions.end(), std::mt19937(42));
+
+        EntityDatabase<Schema> database;
+        Scene scene(database, width, height);
+        for (I32Vec3 position: positions) {
+            scene.add_object(add_robot(database, position));
+        }
+        if (mode != 0) {
+            scene.sort_storage();
+        }
+
+        auto component_mask = Schema::component_mask_v<ComponentType::energy, ComponentType::body>;
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            auto visit = [&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::energy>().value;
+                sum += std::as_const(entity).get_component<ComponentType::body>().velocity.x;
+            };
+
+            for (int32_t y = 0; y < height; y += block_size) {
+                for (int32_t x = 0; x < width; x += block_size) {
+                    I32Vec3 first{x, y, 0};
+                    I32Vec3 last{x + block_size, y + block_size, 1};
+                    if (mode == 2) {
+                        auto range = scene.get_storage_range(first, last);
+                        database.for_each_entity(range.first_entity_index, range.last_entity_index, component_mask, visit);
+                    }
+                    else {
+                        scene.for_each_object(first, last, visit);
+                    }
+                }
+            }
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * static_cast<int64_t>(positions.size()));
+    }
+
+}
+
+ENTLER_BENCHMARK(scene_move_object)->range(1000, 1000000);
+ENTLER_BENCHMARK(scene_get_object)->range(1000, 1000000);
+ENTLER_BENCHMARK(scene_volume_get_object)->args({0})->args({1});
+ENTLER_BENCHMARK(scene_volume_neighbours)->args({0})->args({1});
+ENTLER_BENCHMARK(scene_volume_box)->args({0})->args({1});
+ENTLER_BENCHMARK(scene_region_sweep)->ranges({10000, 100000, 1000000}, {0, 1, 2});
@@ -0,0 +1,71 @@
+#include <new>
+#include <vector>
+#include "benchmark.h"
+#include "fixtures.h"
+#include "simulation/script_system.h"
+#include "simulation/simulation.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    Script idle_script(EntityHandle<Schema>) {
+        while (true) {
+            co_await next_tick();
+        }
+    }
+
+    // range(0) frames of 256 bytes allocated and freed per iteration, the way
+    // scripts start and finish; range(1): 0 operator new and delete, 1 the script frame pool
+    void script_frame_allocation(State& state) {
+        int64_t frame_count = state.range(0);
+        bool pooled = state.range(1) != 0;
+        constexpr size_t frame_size = 256;
+
+        PoolAllocator pool;
+        std::vector<void*> frames(static_cast<size_t>(frame_count));
+        while (state.keep_running()) {
+            for (void*& frame: frames) {
+                frame = pooled ? pool.allocate(frame_size) : ::operator new(frame_size);
+                do_not_optimize(frame);
+            }
+
+            for (void* frame: frames) {
+                if (pooled) {
+                    pool.free(frame, frame_size);
+                }
+                else {
+                    ::operator delete(frame);
+                }
+            }
+        }
+
+        state.set_items_processed(state.iterations() * frame_count);
+    }
+
+    // one ScriptSystem update resuming a script on each of range(0) robots
+    void script_resume(State& state) {
+        int64_t robot_count = state.range(0);
+
+        Simulation simulation(16, 16);
+        auto& database = simulation.get_database();
+        ScriptSystem scripts(database);
+        for (int64_t robot_index = 0; robot_index < robot_count; ++robot_index) {
+            Entity<Schema> robot = add_robot(database, I32Vec3{static_cast<int32_t>(robot_index), 0, 0});
+            scripts.start(robot, ScriptSystem::get_robot_script_access(), &idle_script);
+        }
+
+        uint64_t tick = 0;
+        while (state.keep_running()) {
+            simulation.set_tick_count(tick++);
+            do_not_optimize(scripts.update(simulation));
+        }
+
+        state.set_items_processed(state.iterations() * robot_count);
+    }
+
+}
+
+ENTLER_BENCHMARK(script_frame_allocation)->ranges({1000, 100000}, {0, 1});
+ENTLER_BENCHMARK(script_resume)->range(1000, 100000);
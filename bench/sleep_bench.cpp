@@ -0,0 +1,89 @@
+#include <random>
+#include <utility>
+#include "benchmark.h"
+#include "fixtures.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    // entity_count robots of which active_percent stay awake; the sleeping ones
+    // are picked at random, which is the worst case for skipping them since
+    // hardly any 64 entity run sleeps as a whole
+    std::unique_ptr<EntityDatabase<Schema>> make_sleeping_database(int64_t entity_count, int64_t active_percent) {
+        auto database = make_database(entity_count, 100);
+
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int64_t> percent(0, 99);
+        database->for_each_entity([&](Entity<Schema> entity) {
+            if (percent(random) >= active_percent) {
+                database->sleep_entity(entity);
+            }
+        });
+
+        return database;
+    }
+
+    // the movement sweep over every robot, of which active_percent are awake
+    void sleeping_sweep(State& state) {
+        int64_t entity_count = state.range(0);
+        int64_t active_percent = state.range(1);
+        auto database = make_sleeping_database(entity_count, active_percent);
+
+        constexpr auto component_mask = Schema::component_mask_v<ComponentType::position, ComponentType::body>;
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            database->for_each_entity(component_mask, [&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // same as sleeping_sweep through a query, which holds only the awake robots
+    void sleeping_query(State& state) {
+        int64_t entity_count = state.range(0);
+        int64_t active_percent = state.range(1);
+        auto database = make_sleeping_database(entity_count, active_percent);
+
+        EntityQuery<Schema> query(*database, Schema::component_mask_v<ComponentType::position, ComponentType::body>);
+        while (state.keep_running()) {
+            int64_t sum = 0;
+            query.for_each_entity([&](Entity<Schema> entity) {
+                sum += std::as_const(entity).get_component<ComponentType::position>().value.x;
+            });
+
+            do_not_optimize(sum);
+        }
+
+        state.set_items_processed(state.iterations() * entity_count);
+    }
+
+    // writes to a sleeping robot and wakes it at the tick boundary, then puts it back to sleep
+    void sleeping_wake(State& state) {
+        int64_t entity_count = state.range(0);
+        auto database = make_sleeping_database(entity_count, 0);
+
+        EntityQuery<Schema> query(*database, Schema::component_mask_v<ComponentType::position, ComponentType::body>);
+        size_t entity_index = 0;
+        while (state.keep_running()) {
+            Entity<Schema> entity = database->get_entity(entity_index);
+            entity.get_component<ComponentType::body>().velocity.x += 1;
+            database->swap_component_buffers();
+            database->sleep_entity(entity);
+
+            entity_index = (entity_index + 1) % static_cast<size_t>(entity_count);
+        }
+
+        state.set_items_processed(state.iterations());
+    }
+
+}
+
+ENTLER_BENCHMARK(sleeping_sweep)->ranges({100000, 1000000, 10000000}, {5, 100});
+ENTLER_BENCHMARK(sleeping_query)->ranges({100000, 1000000, 10000000}, {5, 100});
+ENTLER_BENCHMARK(sleeping_wake)->range(1000, 1000000);
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <string>
+#include "benchmark.h"
+#include "fixtures.h"
+#include "simulation/world_export.h"
+
+using namespace entler;
+using namespace entler::bench;
+
+namespace {
+
+    // object_count robots and rocks spread over a square scene at 50% occupancy,
+    // exported with the columns main publishes
+    struct ExportFixture {
+        EntityDatabase<Schema> database;
+        Scene                  scene;
+        WorldExporter          exporter;
+        WorldExportReader      reader;
+
+        explicit ExportFixture(int64_t object_count)
+            : scene(database, get_side(object_count), get_side(object_count))
+            , exporter(database, scene)
+        {
+            int32_t side = static_cast<int32_t>(get_side(object_count));
+            for (int64_t object_index = 0; object_index < object_count; ++object_index) {
+                I32Vec3 position{static_cast<int32_t>((object_index * 2) % side), static_cast<int32_t>((object_index * 2) / side), 0};
+                scene.add_object(object_index % 2 ? add_rock(database, position) : add_robot(database, position));
+            }
+
+            std::string name = "entler_bench_" + std::to_string(object_count);
+            bool created = exporter.create(name, { ComponentType::object_type, ComponentType::position, ComponentType::display }, static_cast<size_t>(object_count));
+            bool opened = created && reader.open(name);
+            if (!opened) {
+                std::abort();
+            }
+        }
+
+        static size_t get_side(int64_t object_count) {
+            return static_cast<size_t>(std::ceil(std::sqrt(2.0 * static_cast<double>(object_count))));
+        }
+    };
+
+    // what a reader does with a frame: walks the position column
+    int64_t sum_positions(const WorldExportReader& reader) {
+        int64_t sum = 0;
+        bool consistent = reader.read([&](const WorldExportView& view) {
+            const auto* positions = view.get_column<ComponentType::position>();
+            sum = 0;
+            for (size_t row = 0; row < view.get_entity_count(); ++row) {
+                sum += positions[row].value.x + positions[row].value.y;
+            }
+        });
+
+        return consistent ? sum : -1;
+    }
+
+    // the writer's cost per tick
+    void world_export_publish(State& state) {
+        int64_t object_count = state.range(0);
+        ExportFixture fixture(object_count);
+
+        uint64_t tick = 0;
+        while (state.keep_running()) {
+            fixture.exporter.publish(++tick);
+        }
+
+        state.set_items_processed(state.iterations() * object_count);
+    }
+
+    // a reader scanning the latest frame in place
+    void world_export_read(State& state) {
+        int64_t object_count = state.range(0);
+        ExportFixture fixture(object_count);
+        fixture.exporter.publish(1);
+
+        while (state.keep_running()) {
+            do_not_optimize(sum_positions(fixture.reader));
+        }
+
+        state.set_items_processed(state.iterations() * object_count);
+    }
+
+    // from the state of a tick to a reader having scanned it
+    void world_export_latency(State& state) {
+        int64_t object_count = state.range(0);
+        ExportFixture fixture(object_count);
+
+        uint64_t tick = 0;
+        while (state.keep_running()) {
+            fixture.exporter.publish(++tick);
+            do_not_optimize(sum_positions(fixture.reader));
+        }
+
+        state.set_items_processed(state.iterations() * object_count);
+    }
+
+}
+
+ENTLER_BENCHMARK(world_export_publish)->range(1000, 1000000);
+ENTLER_BENCHMARK(world_export_read)->range(1000, 1000000);
+ENTLER_BENCHMARK(world_export_latency)->range(1000, 1000000);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <limits>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+namespace entler {
+
+    enum class BehaviorStatus : uint8_t {
+        success,
+        failure,
+        running,
+    };
+
+    enum class BehaviorNodeType : uint8_t {
+        sequence,
+        selector,
+        action,
+    };
+
+    // The per instance state of a tree; small and trivially copyable so it
+    // can live in a component table next to the other instances.
+    struct BehaviorState {
+        static constexpr uint16_t no_node = std::numeric_limits<uint16_t>::max();
+
+        uint16_t running_node = no_node;
+        uint32_t running_ticks = 0;   // ticks the running node returned running before
+    };
+
+    // A behavior tree definition shared by any number of instances. Nodes are
+    // stored flattened in depth first order, so the first child of a node
+    // directly follows it and its next sibling follows its subtree; evaluation
+    // walks one contiguous array. Trees are re-evaluated from the root every
+    // tick (sequences and selectors have no memory), and the state only
+    // remembers which action kept running and for how long.
+    //
+    // Actions (and conditions, which are actions that never run) are plain
+    // function pointers taking the caller's Context and the number of ticks
+    // the action has been running before.
+    template<typename Context>
+    class BehaviorTree {
+    public:
+        using Action = BehaviorStatus (*)(Context& context, uint32_t running_ticks);
+
+        // a node and its children, flattened by the constructor
+        struct Definition {
+            BehaviorNodeType        type;
+            Action                  action = nullptr;
+            std::vector<Definition> children;
+        };
+
+        // runs children in order until one does not succeed
+        static Definition sequence(std::vector<Definition> children) {
+            return Definition{BehaviorNodeType::sequence, nullptr, std::move(children)};
+        }
+
+        // runs children in order until one does not fail
+        static Definition selector(std::vector<Definition> children) {
+            return Definition{BehaviorNodeType::selector, nullptr, std::move(children)};
+        }
+
+        static Definition action(Action action) {
+            assert(action);
+            return Definition{BehaviorNodeType::action, action, {}};
+        }
+
+        explicit BehaviorTree(const Definition& root) {
+            flatten(root);
+            assert(nodes_.size() < BehaviorState::no_node);
+        }
+
+        BehaviorStatus evaluate(Context& context, BehaviorState& state) const {
+            BehaviorState next_state;
+            BehaviorStatus status = evaluate_node(0, context, state, next_state);
+            state = next_state;
+            return status;
+        }
+
+        size_t get_node_count() const {
+            return nodes_.size();
+        }
+
+    private:
+        struct Node {
+            BehaviorNodeType type;
+            uint16_t         subtree_size;   // this node and all of its descendants
+            Action           action;
+        };
+
+        void flatten(const Definition& definition) {
+            size_t node_index = nodes_.size();
+            nodes_.push_back(Node{definition.type, 1, definition.action});
+            for (const Definition& child: definition.children) {
+                flatten(child);
+            }
+
+            nodes_[node_index].subtree_size = static_cast<uint16_t>(nodes_.size() - node_index);
+        }
+
+        BehaviorStatus evaluate_node(size_t node_index, Context& context, const BehaviorState& state, BehaviorState& next_state) const {
+            const Node& node = nodes_[node_index];
+            if (node.type == BehaviorNodeType::action) {
+                uint32_t running_ticks = state.running_node == node_index ? state.running_ticks + 1 : 0;
+                BehaviorStatus status = node.action(context, running_ticks);
+                if (status == BehaviorStatus::running) {
+                    next_state.running_node = static_cast<uint16_t>(node_index);
+                    next_state.running_ticks = running_ticks;
+                }
+
+                return status;
+            }
+
+            // a sequence stops at the first child that does not succeed, a selector at the first that does not fail
+            BehaviorStatus continue_status = node.type == BehaviorNodeType::sequence ? BehaviorStatus::success : BehaviorStatus::failure;
+
+            size_t end_node_index = node_index + node.subtree_size;
+            for (size_t child_index = node_index + 1; child_index < end_node_index; child_index += nodes_[child_index].subtree_size) {
+                BehaviorStatus status = evaluate_node(child_index, context, state, next_state);
+                if (status != continue_status) {
+                    return status;
+                }
+            }
+
+            return continue_status;
+        }
+
+    private:
+        std::vector<Node> nodes_;
+    };
+
+}
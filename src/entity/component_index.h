@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include "entity_database.h"
+
+namespace entler {
+
+    // Groups the entities that have a component by a key taken from it, e.g.
+    // objects by ObjectType. Looking a key up visits its bucket, a dense array
+    // of entity indexes; writes move an entity between buckets the next time
+    // the index is used. Meant for enums and other keys with few values.
+    template<typename Schema, typename Schema::ComponentType component_type, typename Key>
+    class ComponentHashIndex : public ComponentIndex<Schema> {
+    public:
+        using ComponentMask = typename Schema::ComponentMask;
+        using Component = typename Schema::template Component<component_type>;
+        using KeyFunction = Key (*)(const Component& component);
+
+        ComponentHashIndex(EntityDatabase<Schema>& entity_database, KeyFunction key_function)
+                : ComponentIndex<Schema>(entity_database, component_type)
+                , key_function_(key_function)
+        {
+            entity_database.for_each_entity(Schema::template component_mask_v<component_type>, SleepingEntities::include, [&](Entity<Schema> entity) {
+                component_added(entity);
+            });
+        }
+
+        size_t count(Key key) {
+            this->update_component_indexes();
+
+            auto it = buckets_.find(key);
+            return it != buckets_.end() ? it->second.size() : 0;
+        }
+
+        // visits the entities whose component has key
+        template<typename Visitor>
+        void for_each_entity(Key key, Visitor&& visitor) {
+            for_each_entity(key, ComponentMask(), std::forward<Visitor>(visitor));
+        }
+
+        // visits the entities whose component has key and that have all of the components in component_mask
+        template<typename Visitor>
+        void for_each_entity(Key key, ComponentMask component_mask, Visitor&& visitor) {
+            ENTLER_PROFILE_ZONE("ComponentHashIndex::for_each_entity");
+
+            this->update_component_indexes();
+
+            auto it = buckets_.find(key);
+            if (it == buckets_.end()) {
+                return;
+            }
+
+            EntityDatabase<Schema>& database = this->get_database();
+            for (size_t entity_index: it->second) {
+                Entity<Schema> entity = database.get_entity(entity_index);
+                if (entity.has_components(component_mask)) {
+                    visitor(entity);
+                }
+            }
+        }
+
+    protected:
+        void component_added(Entity<Schema> entity) override {
+            size_t entity_index = entity.get_index();
+            if (entity_index >= entries_.size()) {
+                entries_.resize(entity_index + 1);
+            }
+
+            insert(entity_index, key_function_(std::as_const(entity).template get_component<component_type>()));
+        }
+
+        void component_removed(Entity<Schema> entity) override {
+            erase(entity.get_index());
+        }
+
+        void component_changed(Entity<Schema> entity) override {
+            size_t entity_index = entity.get_index();
+            Key key = key_function_(std::as_const(entity).template get_component<component_type>());
+            if (key != entries_[entity_index].key) {
+                erase(entity_index);
+                insert(entity_index, key);
+            }
+        }
+
+        void entities_moved(const std::vector<size_t>& live_entity_indexes, size_t entity_table_size) override {
+            std::vector<Entry> live_entries(entity_table_size);
+            for (auto& [key, bucket]: buckets_) {
+                for (size_t& entity_index: bucket) {
+                    size_t live_entity_index = live_entity_indexes[entity_index];
+                    live_entries[live_entity_index] = entries_[entity_index];
+                    entity_index = live_entity_index;
+                }
+            }
+
+            entries_ = std::move(live_entries);
+        }
+
+    private:
+        static constexpr size_t no_bucket_index = SIZE_MAX;
+
+        struct Entry {
+            Key    key{};
+            size_t bucket_index = no_bucket_index;   // position in the bucket of key
+        };
+
+        void insert(size_t entity_index, Key key) {
+            std::vector<size_t>& bucket = buckets_[key];
+
+            Entry& entry = entries_[entity_index];
+            assert(entry.bucket_index == no_bucket_index);
+            entry.key = key;
+            entry.bucket_index = bucket.size();
+            bucket.push_back(entity_index);
+        }
+
+        void erase(size_t entity_index) {
+            Entry& entry = entries_[entity_index];
+            assert(entry.bucket_index != no_bucket_index);
+
+            // move the last entity of the bucket into the hole
+            std::vector<size_t>& bucket = buckets_[entry.key];
+            size_t last_entity_index = bucket.back();
+            bucket[entry.bucket_index] = last_entity_index;
+            entries_[last_entity_index].bucket_index = entry.bucket_index;
+            bucket.pop_back();
+
+            entry.bucket_index = no_bucket_index;
+        }
+
+        KeyFunction                                  key_function_;
+        std::unordered_map<Key, std::vector<size_t>> buckets_;
+        std::vector<Entry>                           entries_;   // by entity index
+    };
+
+    // Keeps the entities that have a component sorted by an integer key taken
+    // from it, e.g. robots by energy, so range lookups are a binary search
+    // followed by a walk in key order. Changed entities are collected, sorted
+    // and merged into the array in one pass before the next lookup, so a tick
+    // that changes d of n keys costs O(n + d log d) instead of d moves in the
+    // array.
+    template<typename Schema, typename Schema::ComponentType component_type, typename Key>
+    class ComponentSortedIndex : public ComponentIndex<Schema> {
+        static_assert(std::is_integral_v<Key>, "Sorted indexes take integer keys");
+
+    public:
+        using ComponentMask = typename Schema::ComponentMask;
+        using Component = typename Schema::template Component<component_type>;
+        using KeyFunction = Key (*)(const Component& component);
+
+        ComponentSortedIndex(EntityDatabase<Schema>& entity_database, KeyFunction key_function)
+                : ComponentIndex<Schema>(entity_database, component_type)
+                , key_function_(key_function)
+        {
+            entity_database.for_each_entity(Schema::template component_mask_v<component_type>, SleepingEntities::include, [&](Entity<Schema> entity) {
+                component_added(entity);
+            });
+        }
+
+        size_t size() {
+            update();
+            return items_.size();
+        }
+
+        // counts the entities with a key in [first_key, last_key)
+        size_t count(Key first_key, Key last_key) {
+            update();
+
+            auto [first, last] = find_range(first_key, last_key);
+            return static_cast<size_t>(last - first);
+        }
+
+        // visits the entities with a key in [first_key, last_key) in key order
+        template<typename Visitor>
+        void for_each_entity(Key first_key, Key last_key, Visitor&& visitor) {
+            for_each_entity(first_key, last_key, ComponentMask(), std::forward<Visitor>(visitor));
+        }
+
+        // visits the entities with a key in [first_key, last_key) that have all of the components in component_mask
+        template<typename Visitor>
+        void for_each_entity(Key first_key, Key last_key, ComponentMask component_mask, Visitor&& visitor) {
+            ENTLER_PROFILE_ZONE("ComponentSortedIndex::for_each_entity");
+
+            update();
+
+            EntityDatabase<Schema>& database = this->get_database();
+            auto [first, last] = find_range(first_key, last_key);
+            for (auto it = first; it != last; ++it) {
+                Entity<Schema> entity = database.get_entity(it->entity_index);
+                if (entity.has_components(component_mask)) {
+                    visitor(entity);
+                }
+            }
+        }
+
+        // visits the entities with a key below key, e.g. robots that run low on energy
+        template<typename Visitor>
+        void for_each_entity_below(Key key, Visitor&& visitor) {
+            for_each_entity(std::numeric_limits<Key>::lowest(), key, std::forward<Visitor>(visitor));
+        }
+
+    protected:
+        void component_added(Entity<Schema> entity) override {
+            size_t entity_index = entity.get_index();
+            if (entity_index >= entries_.size()) {
+                entries_.resize(entity_index + 1);
+            }
+
+            Entry& entry = entries_[entity_index];
+            entry.key = key_function_(std::as_const(entity).template get_component<component_type>());
+            entry.indexed = true;
+            mark_changed(entity_index);
+        }
+
+        void component_removed(Entity<Schema> entity) override {
+            size_t entity_index = entity.get_index();
+            entries_[entity_index].indexed = false;
+            mark_changed(entity_index);
+        }
+
+        void component_changed(Entity<Schema> entity) override {
+            size_t entity_index = entity.get_index();
+            Key key = key_function_(std::as_const(entity).template get_component<component_type>());
+            if (key != entries_[entity_index].key) {
+                entries_[entity_index].key = key;
+                mark_changed(entity_index);
+            }
+        }
+
+        void entities_moved(const std::vector<size_t>& live_entity_indexes, size_t entity_table_size) override {
+            merge_changes();
+
+            std::vector<Entry> live_entries(entity_table_size);
+            for (Item& item: items_) {
+                live_entries[live_entity_indexes[item.entity_index]] = entries_[item.entity_index];
+                item.entity_index = live_entity_indexes[item.entity_index];
+            }
+
+            entries_ = std::move(live_entries);
+
+            // a plain vacuum keeps the entity order, so items only need sorting after a sorting one
+            if (!std::is_sorted(items_.begin(), items_.end())) {
+                std::sort(items_.begin(), items_.end());
+            }
+        }
+
+    private:
+        struct Item {
+            Key    key;
+            size_t entity_index;
+
+            bool operator<(const Item& rhs) const {
+                return key < rhs.key || (key == rhs.key && entity_index < rhs.entity_index);
+            }
+        };
+
+        struct Entry {
+            Key  key{};
+            bool indexed = false;   // has the component
+            bool changed = false;   // its item in items_ (if any) is out of date
+        };
+
+        void update() {
+            this->update_component_indexes();
+            merge_changes();
+        }
+
+        void mark_changed(size_t entity_index) {
+            Entry& entry = entries_[entity_index];
+            if (!entry.changed) {
+                entry.changed = true;
+                changed_entity_indexes_.push_back(entity_index);
+            }
+        }
+
+        std::pair<typename std::vector<Item>::const_iterator, typename std::vector<Item>::const_iterator> find_range(Key first_key, Key last_key) const {
+            if (!(first_key < last_key)) {
+                return {items_.end(), items_.end()};
+            }
+
+            auto first = std::lower_bound(items_.begin(), items_.end(), first_key, [](const Item& item, Key key) { return item.key < key; });
+            auto last = std::lower_bound(first, items_.end(), last_key, [](const Item& item, Key key) { return item.key < key; });
+            return {first, last};
+        }
+
+        // drops the items of changed entities and merges their new items back in
+        void merge_changes() {
+            if (changed_entity_indexes_.empty()) {
+                return;
+            }
+
+            ENTLER_PROFILE_ZONE("ComponentSortedIndex::merge_changes");
+
+            inserted_items_.clear();
+            for (size_t entity_index: changed_entity_indexes_) {
+                const Entry& entry = entries_[entity_index];
+                if (entry.indexed) {
+                    inserted_items_.push_back(Item{entry.key, entity_index});
+                }
+            }
+
+            std::sort(inserted_items_.begin(), inserted_items_.end());
+
+            merged_items_.clear();
+            merged_items_.reserve(items_.size() + inserted_items_.size());
+
+            auto inserted_it = inserted_items_.begin();
+            for (const Item& item: items_) {
+                if (entries_[item.entity_index].changed) {
+                    continue;
+                }
+
+                while (inserted_it != inserted_items_.end() && *inserted_it < item) {
+                    merged_items_.push_back(*inserted_it++);
+                }
+
+                merged_items_.push_back(item);
+            }
+
+            merged_items_.insert(merged_items_.end(), inserted_it, inserted_items_.end());
+            std::swap(items_, merged_items_);
+
+            for (size_t entity_index: changed_entity_indexes_) {
+                entries_[entity_index].changed = false;
+            }
+            changed_entity_indexes_.clear();
+        }
+
+        KeyFunction         key_function_;
+        std::vector<Item>   items_;                    // sorted by key, then entity index
+        std::vector<Entry>  entries_;                  // by entity index
+        std::vector<size_t> changed_entity_indexes_;   // not merged yet
+        std::vector<Item>   inserted_items_;           // kept to reuse their capacity
+        std::vector<Item>   merged_items_;
+    };
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+namespace entler {
+
+    // Component storage that keeps the value each component had at the last
+    // swap_buffers() next to its current value, so readers on other threads
+    // can see a consistent previous tick while writers update the current one.
+    //
+    // Every slot owns two copies and a state word holding the epoch it was
+    // last written in and which copy is current. The first mutable access in
+    // an epoch copies the current value into the other copy and flips the
+    // state, leaving the previous value untouched. Swapping is just starting
+    // a new epoch. A slot may be written by one thread at a time; any number
+    // of threads may call get_previous concurrently with that writer.
+    template<typename T>
+    class DoubleBufferedComponentTable {
+    public:
+        using value_type = T;
+
+        size_t size() const {
+            return states_.size();
+        }
+
+        size_t capacity() const {
+            return states_.capacity();
+        }
+
+        void reserve(size_t capacity) {
+            buffers_[0].reserve(capacity);
+            buffers_[1].reserve(capacity);
+            states_.reserve(capacity);
+        }
+
+        void push_back(T value) {
+            buffers_[0].push_back(value);
+            buffers_[1].push_back(std::move(value));
+            states_.emplace_back(make_state(unwritten_epoch, 0));
+        }
+
+        // grows the table with copies of value, like std::vector::resize
+        void resize(size_t size, const T& value) {
+            buffers_[0].resize(size, value);
+            buffers_[1].resize(size, value);
+            states_.resize(size, State(make_state(unwritten_epoch, 0)));
+        }
+
+        // mutable access to the current value
+        T& operator[](size_t index) {
+            assert(index < size());
+
+            uint64_t state = states_[index].value.load(std::memory_order_relaxed);
+            size_t current = get_current(state);
+            if (get_epoch(state) != epoch_) {
+                size_t next = current ^ 1;
+                buffers_[next][index] = buffers_[current][index];
+                states_[index].value.store(make_state(epoch_, next), std::memory_order_release);
+                current = next;
+            }
+
+            return buffers_[current][index];
+        }
+
+        // the current value; only safe to read while no thread writes the slot
+        const T& operator[](size_t index) const {
+            assert(index < size());
+
+            uint64_t state = states_[index].value.load(std::memory_order_acquire);
+            return buffers_[get_current(state)][index];
+        }
+
+        // the value as of the last swap_buffers()
+        const T& get_previous(size_t index) const {
+            assert(index < size());
+
+            uint64_t state = states_[index].value.load(std::memory_order_acquire);
+            size_t current = get_current(state);
+            if (get_epoch(state) == epoch_) {
+                return buffers_[current ^ 1][index];
+            }
+
+            return buffers_[current][index];
+        }
+
+        // publishes the current values as the previous ones; O(1)
+        void swap_buffers() {
+            epoch_ += 1;
+        }
+
+    private:
+        static constexpr uint64_t unwritten_epoch = 0;
+
+        static uint64_t make_state(uint64_t epoch, size_t current) {
+            return (epoch << 1) | current;
+        }
+
+        static uint64_t get_epoch(uint64_t state) {
+            return state >> 1;
+        }
+
+        static size_t get_current(uint64_t state) {
+            return static_cast<size_t>(state & 1);
+        }
+
+        // vector needs copyable elements to grow
+        struct State {
+            std::atomic<uint64_t> value;
+
+            explicit State(uint64_t value)
+                : value(value)
+            {
+            }
+
+            State(const State& other)
+                : value(other.value.load(std::memory_order_relaxed))
+            {
+            }
+
+            State& operator=(const State& other) {
+                value.store(other.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                return *this;
+            }
+        };
+
+    private:
+        std::vector<T>     buffers_[2];
+        std::vector<State> states_;
+        uint64_t           epoch_ = unwritten_epoch + 1;
+    };
+
+    // Storage for components without data (tags). A tag only exists as a bit
+    // in the entity's component mask, so the table holds no slots and every
+    // entity shares the one value.
+    template<typename T>
+    class TagComponentTable {
+        static_assert(std::is_empty_v<T>, "Tags have no data members");
+
+    public:
+        using value_type = T;
+
+        size_t size() const {
+            return 0;
+        }
+
+        size_t capacity() const {
+            return 0;
+        }
+
+        void reserve(size_t) {
+        }
+
+        void push_back(T) {
+        }
+
+        void resize(size_t, const T&) {
+        }
+
+        T& operator[](size_t) {
+            return value_;
+        }
+
+        const T& operator[](size_t) const {
+            return value_;
+        }
+
+    private:
+        T value_;
+    };
+
+}
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include "util/profiler.h"
+#include "entity_database.h"
+
+namespace entler {
+
+    // A point in time view of an EntityDatabase that is written out while the
+    // database keeps changing. Creating one only records the size of every
+    // table; the values are kept by copy on write in chunks of chunk_size
+    // slots. Every chunk of the entity table and of each component table starts
+    // out pending. Whoever gets to a pending chunk first claims it and copies
+    // the values it held at the capture: the thread writing the checkpoint
+    // before it writes the chunk out, or the database before it changes a slot
+    // in the chunk, a table reallocates or vacuum moves everything. Once a
+    // chunk is copied, writes to it cost one load of its state.
+    //
+    // Entity records keep their id, component mask, component indexes and
+    // parent; tombstones and the slots of removed components are written too,
+    // so the file is the tables as they were. Only one checkpoint can be taken
+    // of a database at a time. Create and destroy it on the thread that
+    // mutates the database; write() may run on any other thread meanwhile.
+    template<typename Schema>
+    class EntityCheckpoint {
+        template<typename> friend class EntityDatabase;
+
+    public:
+        static constexpr size_t chunk_size = 4096;   // slots
+
+        explicit EntityCheckpoint(EntityDatabase<Schema>& database)
+            : database_(database)
+        {
+            ENTLER_PROFILE_ZONE("EntityCheckpoint::capture");
+
+            assert(!database_.checkpoint_);
+
+            columns_[0].element_size = sizeof(SavedRecord);
+            columns_[0].captured_size = database_.entity_table_.size();
+            EntityDatabase<Schema>::for_each_component_table(database_.component_tables_, [&](auto component_type_index, const auto& component_table) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                Column& column = columns_[component_type_index + 1];
+                column.element_size = std::is_empty_v<Component> ? 0 : sizeof(Component);
+                column.captured_size = component_table.size();
+            });
+
+            for (Column& column: columns_) {
+                column.chunk_count = (column.captured_size + chunk_size - 1) / chunk_size;
+                column.chunks.reset(new Chunk[column.chunk_count]);
+            }
+
+            database_.checkpoint_ = this;
+        }
+
+        EntityCheckpoint(EntityCheckpoint&&) = delete;
+        EntityCheckpoint(const EntityCheckpoint&) = delete;
+        EntityCheckpoint& operator=(EntityCheckpoint&&) = delete;
+        EntityCheckpoint& operator=(const EntityCheckpoint&) = delete;
+
+        // the checkpoint must not be written anymore
+        ~EntityCheckpoint() {
+            database_.checkpoint_ = nullptr;
+        }
+
+        size_t get_entity_table_size() const {
+            return columns_[0].captured_size;
+        }
+
+        // the bytes write() produces
+        uint64_t get_byte_count() const {
+            uint64_t byte_count = sizeof(Header) + sizeof(uint32_t) * Schema::component_type_count() + sizeof(uint64_t) * Schema::component_type_count();
+            for (const Column& column: columns_) {
+                byte_count += static_cast<uint64_t>(column.captured_size) * column.element_size;
+            }
+
+            return byte_count;
+        }
+
+        // chunks the database had to copy before writing to them; safe to read from any thread
+        uint64_t get_preserved_chunk_count() const {
+            return preserved_chunk_count_.load(std::memory_order_relaxed);
+        }
+
+        // Writes the tables as they were at the capture to file, from its current
+        // position, in chunk order. Call at most once.
+        bool write(FILE* file) {
+            ENTLER_PROFILE_ZONE("EntityCheckpoint::write");
+
+            Header header {
+                .magic = magic,
+                .version = version,
+                .component_type_count = static_cast<uint32_t>(Schema::component_type_count()),
+                .component_slot_count = static_cast<uint32_t>(Schema::component_slot_count()),
+                .entity_table_size = columns_[0].captured_size,
+            };
+
+            uint32_t component_sizes[Schema::component_type_count()];
+            uint64_t table_sizes[Schema::component_type_count()];
+            for (size_t component_type_index = 0; component_type_index < Schema::component_type_count(); ++component_type_index) {
+                component_sizes[component_type_index] = static_cast<uint32_t>(columns_[component_type_index + 1].element_size);
+                table_sizes[component_type_index] = columns_[component_type_index + 1].captured_size;
+            }
+
+            bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                           std::fwrite(component_sizes, sizeof(component_sizes), 1, file) == 1 &&
+                           std::fwrite(table_sizes, sizeof(table_sizes), 1, file) == 1;
+
+            std::unique_ptr<uint8_t[]> buffer(new uint8_t[chunk_size * get_max_element_size()]);
+            for (size_t column_index = 0; column_index < column_count && written; ++column_index) {
+                Column& column = columns_[column_index];
+                for (size_t chunk_index = 0; chunk_index < column.chunk_count && written; ++chunk_index) {
+                    Chunk& chunk = column.chunks[chunk_index];
+
+                    // copy it ourselves unless the database already has or is about to
+                    const uint8_t* bytes = buffer.get();
+                    uint8_t state = pending;
+                    if (chunk.state.compare_exchange_strong(state, claimed, std::memory_order_acquire)) {
+                        copy_chunk(column_index, chunk_index, buffer.get());
+                        chunk.state.store(copied, std::memory_order_release);
+                    }
+                    else {
+                        wait_until_copied(chunk);
+                        bytes = chunk.bytes.get();
+                    }
+
+                    size_t byte_count = get_chunk_slot_count(column, chunk_index) * column.element_size;
+                    written = std::fwrite(bytes, 1, byte_count, file) == byte_count;
+                    chunk.bytes.reset();
+                }
+            }
+
+            return written && std::fflush(file) == 0;
+        }
+
+        // Appends the live entities of a checkpoint read from file to database, in
+        // entity order and with their relationships; the entities get new ids and
+        // consecutive indexes starting at the old entity table size. Fails for files
+        // written with a different schema.
+        static bool load(FILE* file, EntityDatabase<Schema>& database) {
+            ENTLER_PROFILE_ZONE("EntityCheckpoint::load");
+
+            Header header;
+            uint32_t component_sizes[Schema::component_type_count()];
+            uint64_t table_sizes[Schema::component_type_count()];
+            if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+                header.magic != magic || header.version != version ||
+                header.component_type_count != Schema::component_type_count() ||
+                header.component_slot_count != Schema::component_slot_count() ||
+                std::fread(component_sizes, sizeof(component_sizes), 1, file) != 1 ||
+                std::fread(table_sizes, sizeof(table_sizes), 1, file) != 1) {
+                return false;
+            }
+
+            std::vector<SavedRecord> records;
+            if (!read_column(file, records, header.entity_table_size)) {
+                return false;
+            }
+
+            bool valid = true;
+            std::vector<EntitySnapshot<Schema>> snapshots;
+            std::vector<size_t> new_entity_indexes(records.size(), EntityDatabase<Schema>::no_entity_index);
+            for (size_t entity_index = 0; entity_index < records.size(); ++entity_index) {
+                const SavedRecord& record = records[entity_index];
+                if (record.entity_id < 0) {
+                    continue;
+                }
+
+                valid = valid && (record.component_mask >> Schema::component_type_count()) == 0;
+                new_entity_indexes[entity_index] = database.get_entity_table_size() + snapshots.size();
+
+                EntitySnapshot<Schema> snapshot;
+                snapshot.component_mask = typename Schema::ComponentMask(record.component_mask);
+                snapshots.push_back(snapshot);
+            }
+
+            for_each_component_type([&](auto component_type_index) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                constexpr uint32_t component_size = std::is_empty_v<Component> ? 0 : sizeof(Component);
+                valid = valid && component_sizes[component_type_index] == component_size;
+                if constexpr (!std::is_empty_v<Component>) {
+                    constexpr size_t component_slot = *Schema::find_component_slot(component_type_index);
+
+                    std::vector<Component> components;
+                    valid = valid && read_column(file, components, table_sizes[component_type_index]);
+
+                    size_t snapshot_index = 0;
+                    for (size_t entity_index = 0; entity_index < records.size() && valid; ++entity_index) {
+                        const SavedRecord& record = records[entity_index];
+                        if (record.entity_id < 0) {
+                            continue;
+                        }
+
+                        EntitySnapshot<Schema>& snapshot = snapshots[snapshot_index++];
+                        if (snapshot.component_mask.test(component_type_index)) {
+                            uint64_t component_index = record.component_indexes[component_slot];
+                            valid = component_index < components.size();
+                            if (valid) {
+                                std::get<component_type_index>(snapshot.components) = components[component_index];
+                            }
+                        }
+                    }
+                }
+            });
+
+            for (const SavedRecord& record: records) {
+                bool has_parent = record.parent_index != no_parent_index;
+                valid = valid && (record.entity_id < 0 || !has_parent ||
+                    (record.parent_index < records.size() && records[record.parent_index].entity_id >= 0));
+            }
+
+            if (!valid) {
+                return false;
+            }
+
+            database.add_entities(snapshots.data(), snapshots.size());
+            for (size_t entity_index = 0; entity_index < records.size(); ++entity_index) {
+                const SavedRecord& record = records[entity_index];
+                if (record.entity_id >= 0 && record.parent_index != no_parent_index) {
+                    database.set_parent(database.get_entity(new_entity_indexes[entity_index]), database.get_entity(new_entity_indexes[record.parent_index]));
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t magic = 0x504b4345;   // "ECKP"
+        static constexpr uint32_t version = 1;
+        static constexpr uint64_t no_parent_index = UINT64_MAX;
+
+        // column 0 is the entity table, column 1 + i the table of component type i
+        static constexpr size_t column_count = Schema::component_type_count() + 1;
+
+        struct Header {
+            uint32_t magic = 0;
+            uint32_t version = 0;
+            uint32_t component_type_count = 0;
+            uint32_t component_slot_count = 0;
+            uint64_t entity_table_size = 0;
+        };
+
+        // what is kept of an entity record
+        struct SavedRecord {
+            int64_t  entity_id;
+            uint64_t component_mask;
+            uint64_t parent_index;
+            uint64_t component_indexes[std::max<size_t>(Schema::component_slot_count(), 1)];
+        };
+
+        enum ChunkState : uint8_t {
+            pending,
+            claimed,   // being copied
+            copied,
+        };
+
+        struct Chunk {
+            std::atomic<uint8_t>       state{pending};
+            std::unique_ptr<uint8_t[]> bytes;   // copied by the database; set before state becomes copied
+        };
+
+        struct Column {
+            size_t                   element_size = 0;
+            size_t                   captured_size = 0;
+            size_t                   chunk_count = 0;
+            std::unique_ptr<Chunk[]> chunks;
+        };
+
+        // calls f(std::integral_constant<size_t, component_type_index>) for every component type
+        template<typename F>
+        static void for_each_component_type(F&& f) {
+            [&]<size_t... component_type_indexes>(std::index_sequence<component_type_indexes...>) {
+                (f(std::integral_constant<size_t, component_type_indexes>{}), ...);
+            }(std::make_index_sequence<Schema::component_type_count()>{});
+        }
+
+        template<typename T>
+        static bool read_column(FILE* file, std::vector<T>& values, uint64_t size) {
+            static_assert(std::is_trivially_copyable_v<T>, "Checkpoints store values as raw bytes");
+
+            // grows as the file is read, so a corrupt size fails on a short read instead of a huge allocation
+            constexpr size_t batch_size = chunk_size * 16;
+            values.clear();
+            while (values.size() < size) {
+                size_t first = values.size();
+                size_t count = static_cast<size_t>(std::min<uint64_t>(batch_size, size - first));
+                values.resize(first + count);
+                if (std::fread(values.data() + first, sizeof(T), count, file) != count) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        size_t get_max_element_size() const {
+            size_t max_element_size = 1;
+            for (const Column& column: columns_) {
+                max_element_size = std::max(max_element_size, column.element_size);
+            }
+
+            return max_element_size;
+        }
+
+        size_t get_chunk_slot_count(const Column& column, size_t chunk_index) const {
+            return std::min(chunk_size, column.captured_size - chunk_index * chunk_size);
+        }
+
+        // called by the database before it changes records or components in [first, last)
+        void preserve_entity_records(size_t first, size_t last) {
+            preserve(0, first, last);
+        }
+
+        void preserve_components(size_t component_type_index, size_t first, size_t last) {
+            preserve(component_type_index + 1, first, last);
+        }
+
+        // called by the database before a table moves
+        void preserve_entity_table() {
+            preserve(0, 0, columns_[0].captured_size);
+        }
+
+        void preserve_component_table(size_t component_type_index) {
+            preserve(component_type_index + 1, 0, columns_[component_type_index + 1].captured_size);
+        }
+
+        void preserve(size_t column_index, size_t first, size_t last) {
+            Column& column = columns_[column_index];
+            last = std::min(last, column.captured_size);
+            if (first >= last) {
+                return;
+            }
+
+            for (size_t chunk_index = first / chunk_size; chunk_index <= (last - 1) / chunk_size; ++chunk_index) {
+                Chunk& chunk = column.chunks[chunk_index];
+                uint8_t state = chunk.state.load(std::memory_order_acquire);
+                if (state == copied) {
+                    continue;
+                }
+
+                if (state == pending && chunk.state.compare_exchange_strong(state, claimed, std::memory_order_acquire)) {
+                    chunk.bytes.reset(new uint8_t[get_chunk_slot_count(column, chunk_index) * column.element_size]);
+                    copy_chunk(column_index, chunk_index, chunk.bytes.get());
+                    chunk.state.store(copied, std::memory_order_release);
+                    preserved_chunk_count_.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    wait_until_copied(chunk);
+                }
+            }
+        }
+
+        // the other side claimed the chunk and is copying it, which takes microseconds
+        static void wait_until_copied(const Chunk& chunk) {
+            while (chunk.state.load(std::memory_order_acquire) != copied) {
+                std::this_thread::yield();
+            }
+        }
+
+        // copies the values a chunk of a column holds; the caller has claimed it
+        void copy_chunk(size_t column_index, size_t chunk_index, uint8_t* bytes) const {
+            const Column& column = columns_[column_index];
+            size_t first = chunk_index * chunk_size;
+            size_t last = first + get_chunk_slot_count(column, chunk_index);
+
+            if (column_index == 0) {
+                // field by field, as the database may touch the handles of these records meanwhile
+                for (size_t entity_index = first; entity_index < last; ++entity_index, bytes += sizeof(SavedRecord)) {
+                    const auto& record = database_.entity_table_[entity_index];
+
+                    SavedRecord saved_record;
+                    saved_record.entity_id = record.entity_id;
+                    saved_record.component_mask = record.component_mask.to_ullong();
+                    saved_record.parent_index = record.parent_index == EntityDatabase<Schema>::no_entity_index ? no_parent_index : record.parent_index;
+                    for (size_t component_slot = 0; component_slot < std::size(saved_record.component_indexes); ++component_slot) {
+                        saved_record.component_indexes[component_slot] = record.component_indexes[component_slot];
+                    }
+
+                    std::memcpy(bytes, &saved_record, sizeof(saved_record));
+                }
+
+                return;
+            }
+
+            EntityDatabase<Schema>::for_each_component_table(std::as_const(database_.component_tables_), [&](auto component_type_index, const auto& component_table) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                static_assert(std::is_trivially_copyable_v<Component>, "Checkpoints store components as raw bytes");
+
+                constexpr auto layout = Schema::get_component_layout(component_type_index);
+                if constexpr (layout.storage == ComponentStorage::single_buffered) {
+                    if (component_type_index + 1 == column_index) {
+                        std::memcpy(bytes, component_table.data() + first, (last - first) * sizeof(Component));
+                    }
+                }
+                else if constexpr (layout.storage == ComponentStorage::double_buffered) {
+                    if (component_type_index + 1 == column_index) {
+                        for (size_t component_index = first; component_index < last; ++component_index) {
+                            std::memcpy(bytes + (component_index - first) * sizeof(Component), &component_table[component_index], sizeof(Component));
+                        }
+                    }
+                }
+            });
+        }
+
+    private:
+        EntityDatabase<Schema>& database_;
+        Column                  columns_[column_count];
+        std::atomic<uint64_t>   preserved_chunk_count_{0};
+    };
+
+}
@@ -1,26 +1,48 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <bitset>
+#include <chrono>
+#include <memory>
 #include <optional>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <cstring>
 #include <cstdint>
 #include <cassert>
+#include "util/event_channel.h"
 #include "util/intrusive_list.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
 #include "entity_schema.h"
 
 namespace entler {
 
     using EntityId = int64_t;
 
+    // whether visits and queries see entities that are asleep, see EntityDatabase::sleep_entity
+    enum class SleepingEntities {
+        skip,
+        include,
+    };
+
     template<typename Schema>
     class EntityDatabase;
 
+    template<typename Schema>
+    class EntityCheckpoint;
+
     template<typename Schema>
     class Entity {
         template<typename> friend class EntityDatabase;
         template<typename> friend class EntityHandle;
+        template<typename> friend class EntityQuery;
+        template<typename> friend class ComponentIndex;
         using Database = EntityDatabase<Schema>;
 
     public:
@@ -31,18 +53,28 @@ namespace entler {
 
     public:
         EntityId get_id() const;
+        size_t get_index() const;
 
         template<ComponentType component_type>
         bool has_component() const;
         bool has_component(ComponentType component_type) const;
         bool has_components(typename Schema::ComponentMask component_mask) const;
+        typename Schema::ComponentMask get_component_mask() const;
 
+        // marks the component as changed when an index is kept on its type,
+        // so read through a const entity when not writing
         template<ComponentType component_type>
         Component<component_type>& get_component();
 
         template<ComponentType component_type>
         const Component<component_type>& get_component() const;
 
+        // the value the component had at the last swap_component_buffers(); only
+        // available for double buffered components and safe to call while another
+        // thread writes the component
+        template<ComponentType component_type>
+        const Component<component_type>& get_previous_component() const;
+
     private:
         Entity(EntityDatabase<Schema>& database, size_t entity_index);
 
@@ -57,6 +89,9 @@ namespace entler {
     public:
         EntityHandle() = default;
         EntityHandle(Entity<Schema>& entity);
+        EntityHandle(EntityHandle&& other) = default;
+        EntityHandle& operator=(EntityHandle&& rhs);
+        ~EntityHandle();
 
         explicit operator bool() const {
             return handle_list_node_.is_linked();
@@ -75,6 +110,33 @@ namespace entler {
         IntrusiveListNode       handle_list_node_;
     };
 
+    // a detached copy of the components of an entity, e.g. to move it to another database,
+    // or a prefab to instantiate many entities from
+    template<typename Schema>
+    struct EntitySnapshot {
+        using ComponentType = typename Schema::ComponentType;
+
+        template<ComponentType component_type>
+        using Component = entler::Component<ComponentType, component_type>;
+
+        typename Schema::ComponentMask   component_mask;
+        typename Schema::ComponentValues components;
+
+        template<ComponentType... component_types>
+        static EntitySnapshot make(Component<component_types>... values) {
+            EntitySnapshot snapshot;
+            snapshot.component_mask = Schema::template component_mask_v<component_types...>;
+            ((std::get<Schema::template component_type_index_v<component_types>>(snapshot.components) = std::move(values)), ...);
+            return snapshot;
+        }
+
+        template<ComponentType component_type>
+        Component<component_type>& get_component() {
+            assert(component_mask.test(Schema::template component_type_index_v<component_type>));
+            return std::get<Schema::template component_type_index_v<component_type>>(components);
+        }
+    };
+
     template<typename Schema>
     class EntityObserver {
     public:
@@ -89,15 +151,140 @@ namespace entler {
         virtual void entity_added(Entity<Schema> entity) {}
         virtual void entity_removed(Entity<Schema> entity) {}
 
+        // EntityDatabase::instantiate added the entities at [first_entity_index, first_entity_index + count);
+        // calls entity_added for each unless overridden
+        virtual void entities_added(size_t first_entity_index, size_t count);
+
+        // a component was added to or is about to be removed from a live entity
+        virtual void component_added(Entity<Schema> entity, typename Schema::ComponentType component_type) {}
+        virtual void component_removed(Entity<Schema> entity, typename Schema::ComponentType component_type) {}
+
     private:
         EntityDatabase<Schema>& entity_database_;
     };
 
+    // The entities that have all of the components in a mask, kept up to date
+    // as entities are added and removed, so visiting them walks a dense array
+    // of entity indexes instead of testing the mask of every entity in the
+    // table. Matches are in entity index order after every vacuum; entities
+    // added since come last, and removals move the last match into the hole.
+    //
+    // Keeping a query costs a few instructions per added or removed entity,
+    // which pays off for filters that are selective or visited often. Unless
+    // asked to include them, sleeping entities leave the matches until they
+    // wake up.
+    template<typename Schema>
+    class EntityQuery {
+        template<typename> friend class EntityDatabase;
+
+    public:
+        using ComponentMask = typename Schema::ComponentMask;
+
+        EntityQuery(EntityDatabase<Schema>& entity_database, ComponentMask component_mask, SleepingEntities sleeping_entities = SleepingEntities::skip);
+        EntityQuery(EntityQuery&&) = delete;
+        EntityQuery(const EntityQuery&) = delete;
+        EntityQuery& operator=(EntityQuery&&) = delete;
+        EntityQuery& operator=(const EntityQuery&) = delete;
+
+        ~EntityQuery();
+
+        ComponentMask get_component_mask() const {
+            return component_mask_;
+        }
+
+        size_t size() const {
+            return entity_indexes_.size();
+        }
+
+        bool empty() const {
+            return entity_indexes_.empty();
+        }
+
+        bool contains(Entity<Schema> entity) const;
+
+        // visits the matching entities
+        template<typename Visitor>
+        void for_each_entity(Visitor&& visitor);
+
+        // visits the matches in [first_match_index, last_match_index), where the bound is size();
+        // disjoint ranges may be visited from different threads
+        template<typename Visitor>
+        void for_each_entity(size_t first_match_index, size_t last_match_index, Visitor&& visitor);
+
+    private:
+        static constexpr size_t no_match_index = SIZE_MAX;
+
+        void add_match(size_t entity_index);
+        void remove_match(size_t entity_index);
+
+        // forgets every match, for the database to add them again in entity order
+        void reset_matches(size_t entity_table_size);
+
+        EntityDatabase<Schema>& entity_database_;
+        ComponentMask           component_mask_;
+        SleepingEntities        sleeping_entities_;
+        std::vector<size_t>     entity_indexes_;
+        std::vector<size_t>     match_indexes_;   // position in entity_indexes_ by entity index
+    };
+
+    // Base of secondary indexes over the values of one component type (see
+    // component_index.h). While an index exists, the database records which
+    // entities had the component fetched for writing and hands them to the
+    // index in one batch before the next lookup or vacuum, so writers only
+    // pay for setting a flag.
+    template<typename Schema>
+    class ComponentIndex {
+        template<typename> friend class EntityDatabase;
+
+    public:
+        using ComponentType = typename Schema::ComponentType;
+
+        ComponentIndex(EntityDatabase<Schema>& entity_database, ComponentType component_type);
+        ComponentIndex(ComponentIndex&&) = delete;
+        ComponentIndex(const ComponentIndex&) = delete;
+        ComponentIndex& operator=(ComponentIndex&&) = delete;
+        ComponentIndex& operator=(const ComponentIndex&) = delete;
+
+        virtual ~ComponentIndex();
+
+        ComponentType get_component_type() const {
+            return Schema::get_component_type(component_type_index_);
+        }
+
+    protected:
+        // hands pending changes to every index; call from the thread that mutates the database
+        void update_component_indexes();
+
+        EntityDatabase<Schema>& get_database() {
+            return entity_database_;
+        }
+
+        // entity has the component; called for entities added after the index was
+        // created, derived classes add the entities that were already there
+        virtual void component_added(Entity<Schema> entity) = 0;
+        virtual void component_removed(Entity<Schema> entity) = 0;
+
+        // the component may have been written since it was last added or changed
+        virtual void component_changed(Entity<Schema> entity) = 0;
+
+        // vacuum moved the entity at every index to live_entity_indexes[index]; the indexes
+        // of entities that have the component are valid, and their order is preserved unless
+        // vacuum was given a sort key
+        virtual void entities_moved(const std::vector<size_t>& live_entity_indexes, size_t entity_table_size) = 0;
+
+    private:
+        EntityDatabase<Schema>& entity_database_;
+        size_t                  component_type_index_;
+    };
+
     template<typename Schema>
     class EntityDatabase {
         template<typename> friend class Entity;
         template<typename> friend class EntityHandle;
         template<typename> friend class EntityObserver;
+        template<typename> friend class EntityQuery;
+        template<typename> friend class ComponentIndex;
+        template<typename> friend class EntityCheckpoint;
 
     public:
         using ComponentType = typename Schema::ComponentType;
@@ -106,26 +293,182 @@ namespace entler {
         template<ComponentType component_type>
         using Component = entler::Component<ComponentType, component_type>;
 
+        template<ComponentType component_type>
+        using ComponentTable = entler::ComponentTable<Component<component_type>>;
+
+        static constexpr size_t no_entity_index = SIZE_MAX;
+
     public:
         EntityDatabase();
 
         template<ComponentType... component_types>
         Entity<Schema> add_entity(Component<component_types>... components);
 
+        // adds an entity with the components in snapshot
+        Entity<Schema> add_entity(const EntitySnapshot<Schema>& snapshot);
+
+        // adds one entity per snapshot with the tables grown once up front, e.g. a chunk of
+        // a map coming in from disk; the entities get consecutive indexes starting at the
+        // returned one
+        size_t add_entities(const EntitySnapshot<Schema>* snapshots, size_t count);
+
+        // Adds count entities with the components of prefab, e.g. a wave of spawned
+        // robots. The tables grow once and are filled with copies of the prefab, then
+        // override(entity, instance_index), if given, sets what differs per instance,
+        // such as the position, and observers hear of all of the entities in one
+        // entities_added call. The entities get consecutive indexes starting at the
+        // returned one. Until the next swap_component_buffers, the previous value of a
+        // double buffered component an override changed is the prefab's.
+        size_t instantiate(const EntitySnapshot<Schema>& prefab, size_t count);
+
+        template<typename Override>
+        size_t instantiate(const EntitySnapshot<Schema>& prefab, size_t count, Override&& override);
+
+        // removes the entity and all of its descendants
         void remove_entity(Entity<Schema> entity);
 
+        // adds a component to a live entity that does not have one of the type yet; the
+        // entity keeps its id, index and handles
+        template<ComponentType component_type>
+        void add_component(Entity<Schema> entity, Component<component_type> component);
+
+        // removes a component from a live entity; the component is destroyed right away
+        // and its slot in the component table is reclaimed by the next vacuum
+        template<ComponentType component_type>
+        void remove_component(Entity<Schema> entity);
+
+        // copies the components of entity; the snapshot does not keep the entity id
+        EntitySnapshot<Schema> take_snapshot(Entity<Schema> entity) const;
+
+        // entity indexes stay valid until the next vacuum
+        Entity<Schema> get_entity(size_t entity_index);
+        size_t get_entity_table_size() const;
+
+        // whether entity_index holds a live entity rather than a tombstone
+        bool is_live(size_t entity_index) const;
+
+        // The visits below skip sleeping entities unless told otherwise.
+        // Skipping walks a bitmap of the awake entities, so entities that sleep
+        // in runs of 64 indexes cost a bit test per run.
+
         // visits all entities
         template<typename Visitor>
         void for_each_entity(Visitor&& visitor);
 
-        // visits entities that have all of the components in component_mask
+        template<typename Visitor>
+        void for_each_entity(SleepingEntities sleeping_entities, Visitor&& visitor);
+
+        // visits entities that have all of the components in component_types
         template<typename Visitor>
         void for_each_entity(std::initializer_list<ComponentType> component_types, Visitor&& visitor);
 
-        void vacuum() {
-            // TODO
+        // visits entities that have all of the components in component_mask; pair with
+        // Schema::component_mask_v to keep mask construction out of the call
+        template<typename Visitor>
+        void for_each_entity(ComponentMask component_mask, Visitor&& visitor);
+
+        template<typename Visitor>
+        void for_each_entity(ComponentMask component_mask, SleepingEntities sleeping_entities, Visitor&& visitor);
+
+        // visits entities in [first_entity_index, last_entity_index) that have all of the components in component_mask;
+        // disjoint ranges may be visited from different threads
+        template<typename Visitor>
+        void for_each_entity(size_t first_entity_index, size_t last_entity_index, ComponentMask component_mask, Visitor&& visitor);
+
+        template<typename Visitor>
+        void for_each_entity(size_t first_entity_index, size_t last_entity_index, ComponentMask component_mask, SleepingEntities sleeping_entities, Visitor&& visitor);
+
+        // Sleeping entities keep their components, handles and indexes but are
+        // skipped by visits and queries, e.g. objects that stay put.
+        // Entities are added awake. Waking is immediate through wake_entity; a
+        // component fetched for writing, from any thread, wakes its entity at
+        // the next swap_component_buffers().
+        void sleep_entity(Entity<Schema> entity);
+        void wake_entity(Entity<Schema> entity);
+        bool is_sleeping(Entity<Schema> entity) const;
+
+        size_t get_active_entity_count() const;
+        size_t get_sleeping_entity_count() const;
+
+        // makes child a child of parent, detaching it from its previous parent;
+        // parent must not be child or one of its descendants
+        void set_parent(Entity<Schema> child, Entity<Schema> parent);
+        void clear_parent(Entity<Schema> child);
+
+        std::optional<Entity<Schema>> get_parent(Entity<Schema> entity);
+        size_t get_child_count(Entity<Schema> entity) const;
+
+        // visits the children of parent in entity index order; children of a parent are stored next to each other
+        template<typename Visitor>
+        void for_each_child(Entity<Schema> parent, Visitor&& visitor);
+
+        // calls visitor(parent, child) for every relationship, depth first, so every parent is visited
+        // as a child before its own children are; propagating transforms is a single linear pass
+        template<typename Visitor>
+        void for_each_relationship(Visitor&& visitor);
+
+        // The table holding every component of a type, for systems that sweep it
+        // as a whole. Slots of removed entities and components stay in the table
+        // until the next vacuum. Writes through the table bypass change tracking,
+        // so indexes on the type do not see them unless told with
+        // mark_components_changed, and a running checkpoint, so announce them
+        // with prepare_component_writes.
+        template<ComponentType component_type>
+        ComponentTable<component_type>& get_component_table();
+
+        // lets a running checkpoint copy the slots [first_component_index, last_component_index)
+        // of the table of component_type before they are written through the table; may be
+        // called from any thread that writes them
+        template<ComponentType component_type>
+        void prepare_component_writes(size_t first_component_index, size_t last_component_index);
+
+        // lets the indexes on component_type see the writes made through the table to the slots
+        // [first_component_index, last_component_index); needs track_component_owners. Does nothing
+        // while no index is on the type. May be called from any thread that writes the slots.
+        template<ComponentType component_type>
+        void mark_components_changed(size_t first_component_index, size_t last_component_index);
+
+        // from now on, keeps the index of the entity owning every slot in the table of component_type
+        template<ComponentType component_type>
+        void track_component_owners();
+
+        // the owner of every slot in the table of component_type, or no_entity_index for slots
+        // whose entity or component was removed; needs track_component_owners
+        template<ComponentType component_type>
+        const std::vector<size_t>& get_component_owners() const;
+
+        // makes the current value of every double buffered component its previous value and
+        // wakes the entities that were written while asleep; call at the tick boundary while no
+        // system is running
+        void swap_component_buffers();
+
+        // drops removed entities and their components, compacting every table;
+        // invalidates entity indexes (handles are updated). While a checkpoint is
+        // running this first copies every table it has not got to yet.
+        void vacuum();
+
+        // Vacuums and orders the live entities by sort_key(Entity<Schema>), an unsigned
+        // integer; entities with the same key keep their order. Sorting entities that are
+        // used together next to each other, e.g. by location, packs their components too.
+        template<typename SortKey>
+        void vacuum(SortKey&& sort_key);
+
+        uint64_t get_vacuum_count() const {
+            return vacuum_count_;
+        }
+
+        // an EntityCheckpoint of the database is being written
+        bool has_checkpoint() const {
+            return checkpoint_ != nullptr;
         }
 
+        size_t get_live_entity_count() const;
+        size_t get_tombstone_count() const;
+
+        // reports table sizes, entity and handle counts, observer dispatches and vacuum timings;
+        // call from the thread that mutates the database
+        void collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const;
+
     private:
         using ComponentTables = typename Schema::ComponentTables;
 
@@ -135,14 +478,34 @@ namespace entler {
         struct EntityRecord {
             EntityId         entity_id;
             ComponentMask    component_mask;
-            size_t           component_indexes[Schema::component_type_count()];
+            size_t           component_indexes[std::max<size_t>(Schema::component_slot_count(), 1)];   // tags have no slot
             EntityHandleList handles;
+            size_t           parent_index;
+            size_t           child_count;
+            size_t           children_begin;   // range in children_ as of the last update_relationships
+            size_t           children_end;
 
             EntityRecord(EntityId entity_id)
                 : entity_id(entity_id)
+                , parent_index(no_entity_index)
+                , child_count(0)
+                , children_begin(0)
+                , children_end(0)
             {
                 memset(component_indexes, 0, sizeof(component_indexes));
             }
+
+            // where the component is in its table; always 0 for tags
+            size_t get_component_index(size_t component_type_index) const {
+                std::optional<size_t> component_slot = Schema::find_component_slot(component_type_index);
+                return component_slot ? component_indexes[*component_slot] : 0;
+            }
+
+            void set_component_index(size_t component_type_index, size_t component_index) {
+                if (std::optional<size_t> component_slot = Schema::find_component_slot(component_type_index)) {
+                    component_indexes[*component_slot] = component_index;
+                }
+            }
         };
 
         void add_entity_observer(EntityObserver<Schema>& observer) {
@@ -155,13 +518,99 @@ namespace entler {
             }
         }
 
+        void add_entity_query(EntityQuery<Schema>& query);
+
+        void remove_entity_query(EntityQuery<Schema>& query) {
+            if (auto it = std::find(entity_queries_.begin(), entity_queries_.end(), &query); it != entity_queries_.end()) {
+                entity_queries_.erase(it);
+            }
+
+            component_transitions_.clear();
+        }
+
+        // The queries an entity joins when a component is added to it, or leaves
+        // when one is removed, only depend on its mask and the component type.
+        // Transitions are worked out once and cached until the queries change.
+        struct ComponentTransitionKey {
+            unsigned long long component_mask_bits;
+            size_t             component_type_index;
+            bool               added;
+
+            bool operator==(const ComponentTransitionKey& rhs) const = default;
+        };
+
+        struct ComponentTransitionKeyHash {
+            size_t operator()(const ComponentTransitionKey& key) const {
+                return std::hash<unsigned long long>()(key.component_mask_bits) ^ (key.component_type_index << 1 | key.added) * 0x9e3779b97f4a7c15ull;
+            }
+        };
+
+        struct ComponentTransition {
+            std::vector<EntityQuery<Schema>*> queries;       // whose membership changes
+            bool                              has_indexes;   // some index is kept on the component type
+        };
+
+        const ComponentTransition& get_component_transition(ComponentMask component_mask, size_t component_type_index, bool added);
+
+        void notify_component_added(Entity<Schema> entity, ComponentType component_type) {
+            observer_dispatch_count_.add(static_cast<int64_t>(entity_observers_.size()));
+
+            for (EntityObserver<Schema>* observer: entity_observers_) {
+                observer->component_added(entity, component_type);
+            }
+        }
+
+        void notify_component_removed(Entity<Schema> entity, ComponentType component_type) {
+            observer_dispatch_count_.add(static_cast<int64_t>(entity_observers_.size()));
+
+            for (EntityObserver<Schema>* observer: entity_observers_) {
+                observer->component_removed(entity, component_type);
+            }
+        }
+
+        void add_component_index(ComponentIndex<Schema>& index);
+        void remove_component_index(ComponentIndex<Schema>& index);
+
+        // the entities whose component of one type was fetched for writing since the last update
+        struct ComponentChanges {
+            std::vector<uint8_t> changed;   // by entity index
+            EventChannel<size_t> entity_indexes;
+        };
+
+        // may be called from any thread that may write the entity's components
+        void mark_component_changed(size_t component_type_index, size_t entity_index) {
+            ComponentChanges& changes = *component_changes_[component_type_index];
+            assert(entity_index < changes.changed.size());
+            if (!changes.changed[entity_index]) {
+                changes.changed[entity_index] = 1;
+                changes.entity_indexes.emit(entity_index);
+            }
+        }
+
+        void update_component_indexes();
+
         void notify_entity_added(Entity<Schema> entity) {
+            ENTLER_PROFILE_ZONE("EntityDatabase::notify_entity_added");
+            observer_dispatch_count_.add(static_cast<int64_t>(entity_observers_.size()));
+
             for (EntityObserver<Schema>* observer: entity_observers_) {
                 observer->entity_added(entity);
             }
         }
 
+        void notify_entities_added(size_t first_entity_index, size_t count) {
+            ENTLER_PROFILE_ZONE("EntityDatabase::notify_entities_added");
+            observer_dispatch_count_.add(static_cast<int64_t>(entity_observers_.size()));
+
+            for (EntityObserver<Schema>* observer: entity_observers_) {
+                observer->entities_added(first_entity_index, count);
+            }
+        }
+
         void notify_entity_removed(Entity<Schema> entity) {
+            ENTLER_PROFILE_ZONE("EntityDatabase::notify_entity_removed");
+            observer_dispatch_count_.add(static_cast<int64_t>(entity_observers_.size()));
+
             for (EntityObserver<Schema>* observer: entity_observers_) {
                 observer->entity_removed(entity);
             }
@@ -178,30 +627,81 @@ namespace entler {
             }
         }
 
+        Entity<Schema> add_entity_record(EntityRecord record);
+        void remove_entity_record(size_t entity_index);
+
+        // compacts the tables, putting the live entities in order, old entity indexes in
+        // their new order, or in index order if order is null
+        void compact(const std::vector<size_t>* order);
+
+        // rebuilds children_ and relationship_order_ after set_parent or vacuum; removing entities
+        // and clearing parents leave stale entries behind, which is_child_of filters out
+        void update_relationships();
+
+        bool is_child_of(size_t child_index, size_t parent_index) const {
+            const EntityRecord& record = entity_table_[child_index];
+            return record.entity_id >= 0 && record.parent_index == parent_index;
+        }
+
+        bool is_awake(size_t entity_index) const {
+            return (awake_words_[entity_index / 64] >> (entity_index % 64)) & 1;
+        }
+
+        void set_awake(size_t entity_index, bool awake) {
+            uint64_t bit = 1ull << (entity_index % 64);
+            awake_words_[entity_index / 64] = awake ? awake_words_[entity_index / 64] | bit : awake_words_[entity_index / 64] & ~bit;
+        }
+
+        // whether a query sees the entity at all
+        static bool is_visible_to(const EntityQuery<Schema>& query, bool awake) {
+            return awake || query.sleeping_entities_ == SleepingEntities::include;
+        }
+
+        // may be called from any thread that may write the entity's components
+        void request_wake(size_t entity_index) {
+            if (!is_awake(entity_index) && !wake_requested_[entity_index]) {
+                wake_requested_[entity_index] = 1;
+                wake_requests_.emit(entity_index);
+            }
+        }
+
+        void apply_wake_requests();
+
+        // let a running checkpoint copy what is about to be written, see entity_checkpoint.h
+        void preserve_entity_record(size_t entity_index);
+        void preserve_component(size_t component_type_index, size_t component_index);
+
+        // before pushing to a table, which moves it once it outgrows its capacity
+        void preserve_entity_table_growth(size_t size);
+
+        template<typename Table>
+        void preserve_component_table_growth(size_t component_type_index, const Table& component_table, size_t size);
+
         template<ComponentType component_type>
-        void add_component(EntityRecord& record, Component<component_type> component) {
-            static constexpr auto component_type_index = Schema::find_component_type(component_type);
-            static_assert(component_type_index, "Unknown component type");
+        void push_component(EntityRecord& record, Component<component_type> component) {
+            constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
 
-            auto& component_table = std::get<*component_type_index>(component_tables_);
-            record.component_mask.set(*component_type_index);
-            record.component_indexes[*component_type_index] = component_table.size();
+            auto& component_table = std::get<component_type_index>(component_tables_);
+            preserve_component_table_growth(component_type_index, component_table, component_table.size() + 1);
+            record.component_mask.set(component_type_index);
+            record.set_component_index(component_type_index, component_table.size());
             component_table.push_back(std::move(component));
         }
 
         template<ComponentType component_type, ComponentType... component_types>
-        void add_components(EntityRecord& record, Component<component_type> component, Component<component_types>... components) {
-            add_component(record, std::move(component));
+        void push_components(EntityRecord& record, Component<component_type> component, Component<component_types>... components) {
+            push_component(record, std::move(component));
             if constexpr (sizeof...(component_types)) {
-                add_components(record, std::move(components)...);
+                push_components(record, std::move(components)...);
             }
         }
 
-        template<typename F, size_t component_type_index = 0>
-        void for_each_component_table(F&& f) {
+        // calls f(std::integral_constant<size_t, component_type_index>, component_table) for every table
+        template<typename Tables, typename F, size_t component_type_index = 0>
+        static void for_each_component_table(Tables& component_tables, F&& f) {
             if constexpr (component_type_index < Schema::component_type_count()) {
-                f(std::get<component_type_index>(component_tables_));
-                for_each_component_table<F, component_type_index + 1>(std::forward<F>(f));
+                f(std::integral_constant<size_t, component_type_index>{}, std::get<component_type_index>(component_tables));
+                for_each_component_table<Tables, F, component_type_index + 1>(component_tables, std::forward<F>(f));
             }
         }
 
@@ -210,8 +710,49 @@ namespace entler {
         std::vector<EntityRecord>            entity_table_;
         ComponentTables                      component_tables_;
         std::vector<EntityObserver<Schema>*> entity_observers_;
+        std::vector<EntityQuery<Schema>*>    entity_queries_;
+
+        std::unordered_map<ComponentTransitionKey, ComponentTransition, ComponentTransitionKeyHash> component_transitions_;
+
+        // slot owners of the component types in owner_tracked_component_mask_
+        ComponentMask                        owner_tracked_component_mask_;
+        std::vector<size_t>                  component_owners_[Schema::component_type_count()];
+
+        // component types with at least one index, whose writes are tracked
+        std::vector<ComponentIndex<Schema>*> component_indexes_;
+        ComponentMask                        tracked_component_mask_;
+        std::unique_ptr<ComponentChanges>    component_changes_[Schema::component_type_count()];
+        size_t                               live_entity_count_;
+
+        // a depth first walk over all entities with a parent or children
+        struct RelationshipNode {
+            size_t entity_index;
+            size_t parent_node_index;
+        };
+
+        // child entity indexes grouped by parent, in entity index order
+        std::vector<size_t>                  children_;
+        std::vector<RelationshipNode>        relationship_order_;
+        size_t                               relationship_count_;
+        bool                                 relationships_dirty_;
+
+        ShardedCounter                       handle_count_;
+        ShardedCounter                       observer_dispatch_count_;
+        uint64_t                             vacuum_count_;
+        uint64_t                             last_vacuum_time_ns_;
+        uint64_t                             total_vacuum_time_ns_;
+
+        EntityCheckpoint<Schema>*            checkpoint_;   // being written, if any
+
+        // one bit per entity index, set for live entities that are awake
+        std::vector<uint64_t>                awake_words_;
+        size_t                               sleeping_entity_count_;
+        std::vector<uint8_t>                 wake_requested_;   // by entity index
+        EventChannel<size_t>                 wake_requests_;
     };
 
 #include "entity_database_inline.h"
 
 }
+
+#include "entity_checkpoint.h"
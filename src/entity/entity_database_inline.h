@@ -11,55 +11,83 @@ EntityId Entity<Schema>::get_id() const {
     return database_.entity_table_[entity_index_].entity_id;
 }
 
+template<typename Schema>
+size_t Entity<Schema>::get_index() const {
+    return entity_index_;
+}
+
 template<typename Schema>
 template<typename Schema::ComponentType component_type>
 bool Entity<Schema>::has_component() const {
-    static constexpr auto component_type_index = Schema::find_component_type(component_type);
-    static_assert(component_type_index, "Unknown component type");
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
 
-    const Database::EntityRecord& record = database_.get_entity_record(entity_index_);
-    return record.component_mask.test(*component_type_index);
+    const typename Database::EntityRecord& record = database_.get_entity_record(entity_index_);
+    return record.component_mask.test(component_type_index);
 }
 
 template<typename Schema>
 bool Entity<Schema>::has_component(ComponentType component_type) const {
-    static constexpr auto component_type_index = Schema::find_component_type(component_type);
-    static_assert(component_type_index, "Unknown component type");
+    auto component_type_index = Schema::find_component_type(component_type);
+    assert(component_type_index);
 
-    const Database::EntityRecord& record = database_.get_entity_record(entity_index_);
+    const typename Database::EntityRecord& record = database_.get_entity_record(entity_index_);
     return record.component_mask.test(*component_type_index);
 }
 
 template<typename Schema>
 bool Entity<Schema>::has_components(typename Schema::ComponentMask component_mask) const {
-    const Database::EntityRecord& record = database_.get_entity_record(entity_index_);
+    const typename Database::EntityRecord& record = database_.get_entity_record(entity_index_);
     return (record.component_mask & component_mask) == component_mask;
 }
 
+template<typename Schema>
+typename Schema::ComponentMask Entity<Schema>::get_component_mask() const {
+    return database_.get_entity_record(entity_index_).component_mask;
+}
+
 template<typename Schema>
 template<typename Schema::ComponentType component_type>
 auto Entity<Schema>::get_component() -> Component<component_type>& {
-    static constexpr auto component_type_index = Schema::find_component_type(component_type);
-    static_assert(component_type_index, "Unknown component type");
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
 
-    const Database::EntityRecord& record = database_.get_entity_record(entity_index_);
+    const typename Database::EntityRecord& record = database_.get_entity_record(entity_index_);
     assert(has_component<component_type>());
 
-    size_t component_index = record.component_indexes[*component_type_index];
-    return std::get<*component_type_index>(database_.component_tables_)[component_index];
+    size_t component_index = record.get_component_index(component_type_index);
+    if (database_.tracked_component_mask_.test(component_type_index)) {
+        database_.mark_component_changed(component_type_index, entity_index_);
+    }
+    if (database_.sleeping_entity_count_ > 0) {
+        database_.request_wake(entity_index_);
+    }
+
+    database_.preserve_component(component_type_index, component_index);
+    return std::get<component_type_index>(database_.component_tables_)[component_index];
 }
 
 template<typename Schema>
 template<typename Schema::ComponentType component_type>
 auto Entity<Schema>::get_component() const -> const Component<component_type>& {
-    static constexpr auto component_type_index = Schema::find_component_type(component_type);
-    static_assert(component_type_index, "Unknown component type");
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+
+    const typename Database::EntityRecord& record = database_.get_entity_record(entity_index_);
+    assert(has_component<component_type>());
+
+    size_t component_index = record.get_component_index(component_type_index);
+    return std::get<component_type_index>(database_.component_tables_)[component_index];
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+auto Entity<Schema>::get_previous_component() const -> const Component<component_type>& {
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+    static_assert(get_component_storage<Component<component_type>>() == ComponentStorage::double_buffered, "Component is not double buffered");
 
-    const Database::EntityRecord& record = database_.get_entity_record(entity_index_);
+    const typename Database::EntityRecord& record = database_.get_entity_record(entity_index_);
     assert(has_component<component_type>());
 
-    size_t component_index = record.component_indexes[*component_type_index];
-    return std::get<*component_type_index>(database_.component_tables_)[component_index];
+    size_t component_index = record.get_component_index(component_type_index);
+    return std::get<component_type_index>(database_.component_tables_).get_previous(component_index);
 }
 
 template<typename Schema>
@@ -69,6 +97,25 @@ EntityHandle<Schema>::EntityHandle(Entity<Schema>& entity)
 {
     auto& record = entity_database_->get_entity_record(entity_index_);
     record.handles.push_back(*this);
+    entity_database_->handle_count_.increment();
+}
+
+template<typename Schema>
+EntityHandle<Schema>& EntityHandle<Schema>::operator=(EntityHandle&& rhs) {
+    if (this != &rhs) {
+        reset();
+
+        entity_database_ = rhs.entity_database_;
+        entity_index_ = rhs.entity_index_;
+        handle_list_node_ = std::move(rhs.handle_list_node_);
+    }
+
+    return *this;
+}
+
+template<typename Schema>
+EntityHandle<Schema>::~EntityHandle() {
+    reset();
 }
 
 template<typename Schema>
@@ -85,8 +132,9 @@ Entity<Schema> EntityHandle<Schema>::operator*() {
 template<typename Schema>
 void EntityHandle<Schema>::reset() {
     if (*this) {
+        entity_database_->handle_count_.decrement();
         entity_database_ = nullptr;
-        entity_offset_ = 0;
+        entity_index_ = 0;
         handle_list_node_.unlink();
     }
 }
@@ -109,20 +157,309 @@ EntityObserver<Schema>::~EntityObserver() {
     entity_database_.remove_entity_observer(*this);
 }
 
+template<typename Schema>
+void EntityObserver<Schema>::entities_added(size_t first_entity_index, size_t count) {
+    for (size_t entity_index = first_entity_index; entity_index < first_entity_index + count; ++entity_index) {
+        entity_added(entity_database_.get_entity(entity_index));
+    }
+}
+
+template<typename Schema>
+EntityQuery<Schema>::EntityQuery(EntityDatabase<Schema>& entity_database, ComponentMask component_mask, SleepingEntities sleeping_entities)
+        : entity_database_(entity_database)
+        , component_mask_(component_mask)
+        , sleeping_entities_(sleeping_entities)
+{
+    entity_database_.add_entity_query(*this);
+}
+
+template<typename Schema>
+EntityQuery<Schema>::~EntityQuery() {
+    entity_database_.remove_entity_query(*this);
+}
+
+template<typename Schema>
+bool EntityQuery<Schema>::contains(Entity<Schema> entity) const {
+    return entity.entity_index_ < match_indexes_.size() && match_indexes_[entity.entity_index_] != no_match_index;
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityQuery<Schema>::for_each_entity(Visitor&& visitor) {
+    for_each_entity(0, entity_indexes_.size(), std::forward<Visitor>(visitor));
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityQuery<Schema>::for_each_entity(size_t first_match_index, size_t last_match_index, Visitor&& visitor) {
+    ENTLER_PROFILE_ZONE("EntityQuery::for_each_entity");
+
+    assert(first_match_index <= last_match_index);
+    assert(last_match_index <= entity_indexes_.size());
+
+    for (size_t match_index = first_match_index; match_index < last_match_index; ++match_index) {
+        visitor(Entity<Schema>(entity_database_, entity_indexes_[match_index]));
+    }
+}
+
+template<typename Schema>
+void EntityQuery<Schema>::add_match(size_t entity_index) {
+    if (entity_index >= match_indexes_.size()) {
+        match_indexes_.resize(entity_index + 1, no_match_index);
+    }
+
+    assert(match_indexes_[entity_index] == no_match_index);
+    match_indexes_[entity_index] = entity_indexes_.size();
+    entity_indexes_.push_back(entity_index);
+}
+
+template<typename Schema>
+void EntityQuery<Schema>::remove_match(size_t entity_index) {
+    assert(entity_index < match_indexes_.size() && match_indexes_[entity_index] != no_match_index);
+
+    size_t match_index = match_indexes_[entity_index];
+    size_t last_entity_index = entity_indexes_.back();
+    entity_indexes_[match_index] = last_entity_index;
+    match_indexes_[last_entity_index] = match_index;
+
+    entity_indexes_.pop_back();
+    match_indexes_[entity_index] = no_match_index;
+}
+
+template<typename Schema>
+void EntityQuery<Schema>::reset_matches(size_t entity_table_size) {
+    entity_indexes_.clear();
+    match_indexes_.assign(entity_table_size, no_match_index);
+}
+
+template<typename Schema>
+ComponentIndex<Schema>::ComponentIndex(EntityDatabase<Schema>& entity_database, ComponentType component_type)
+        : entity_database_(entity_database)
+        , component_type_index_(*Schema::find_component_type(component_type))
+{
+    entity_database_.add_component_index(*this);
+}
+
+template<typename Schema>
+ComponentIndex<Schema>::~ComponentIndex() {
+    entity_database_.remove_component_index(*this);
+}
+
+template<typename Schema>
+void ComponentIndex<Schema>::update_component_indexes() {
+    entity_database_.update_component_indexes();
+}
+
 template<typename Schema>
 EntityDatabase<Schema>::EntityDatabase()
         : next_entity_id_(0)
+        , live_entity_count_(0)
+        , relationship_count_(0)
+        , relationships_dirty_(false)
+        , vacuum_count_(0)
+        , last_vacuum_time_ns_(0)
+        , total_vacuum_time_ns_(0)
+        , checkpoint_(nullptr)
+        , sleeping_entity_count_(0)
 {
 }
 
 template<typename Schema>
 template<typename Schema::ComponentType... component_types>
 Entity<Schema> EntityDatabase<Schema>::add_entity(Component<component_types>... components) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::add_entity");
+
+    EntityRecord record(next_entity_id_++);
+    push_components(record, std::move(components)...);
+    return add_entity_record(std::move(record));
+}
+
+template<typename Schema>
+Entity<Schema> EntityDatabase<Schema>::add_entity(const EntitySnapshot<Schema>& snapshot) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::add_entity");
+
     EntityRecord record(next_entity_id_++);
-    add_components(record, std::move(components)...);
+    for_each_component_table(component_tables_, [&](auto component_type_index, auto& component_table) {
+        if (snapshot.component_mask.test(component_type_index)) {
+            preserve_component_table_growth(component_type_index, component_table, component_table.size() + 1);
+            record.component_mask.set(component_type_index);
+            record.set_component_index(component_type_index, component_table.size());
+            component_table.push_back(std::get<component_type_index>(snapshot.components));
+        }
+    });
+
+    return add_entity_record(std::move(record));
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::add_entities(const EntitySnapshot<Schema>* snapshots, size_t count) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::add_entities");
+
+    // grows geometrically, so loading many small batches does not reallocate every time
+    auto reserve = [](auto& table, size_t size) {
+        if (size > table.capacity()) {
+            table.reserve(std::max(size, table.capacity() * 2));
+        }
+    };
+
+    size_t first_entity_index = entity_table_.size();
+    preserve_entity_table_growth(entity_table_.size() + count);
+    reserve(entity_table_, entity_table_.size() + count);
+
+    size_t component_counts[Schema::component_type_count()] = {};
+    for (size_t snapshot_index = 0; snapshot_index < count; ++snapshot_index) {
+        for (size_t component_type_index = 0; component_type_index < Schema::component_type_count(); ++component_type_index) {
+            component_counts[component_type_index] += snapshots[snapshot_index].component_mask.test(component_type_index);
+        }
+    }
+
+    for_each_component_table(component_tables_, [&](auto component_type_index, auto& component_table) {
+        preserve_component_table_growth(component_type_index, component_table, component_table.size() + component_counts[component_type_index]);
+        reserve(component_table, component_table.size() + component_counts[component_type_index]);
+    });
 
+    for (size_t snapshot_index = 0; snapshot_index < count; ++snapshot_index) {
+        add_entity(snapshots[snapshot_index]);
+    }
+
+    return first_entity_index;
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::instantiate(const EntitySnapshot<Schema>& prefab, size_t count) {
+    return instantiate(prefab, count, [](Entity<Schema>, size_t) {});
+}
+
+template<typename Schema>
+template<typename Override>
+size_t EntityDatabase<Schema>::instantiate(const EntitySnapshot<Schema>& prefab, size_t count, Override&& override) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::instantiate");
+
+    size_t first_entity_index = entity_table_.size();
+    size_t last_entity_index = first_entity_index + count;
+
+    // the component indexes of the first instance; instance i is i slots further along in the prefab's tables
+    size_t first_component_indexes[std::max<size_t>(Schema::component_slot_count(), 1)] = {};
+    size_t component_index_strides[std::max<size_t>(Schema::component_slot_count(), 1)] = {};
+    for_each_component_table(component_tables_, [&](auto component_type_index, auto& component_table) {
+        if (prefab.component_mask.test(component_type_index)) {
+            size_t first_component_index = component_table.size();
+            if (std::optional<size_t> component_slot = Schema::find_component_slot(component_type_index)) {
+                first_component_indexes[*component_slot] = first_component_index;
+                component_index_strides[*component_slot] = 1;
+            }
+
+            preserve_component_table_growth(component_type_index, component_table, first_component_index + count);
+            component_table.resize(first_component_index + count, std::get<component_type_index>(prefab.components));
+        }
+    });
+
+    preserve_entity_table_growth(last_entity_index);
+    if (last_entity_index > entity_table_.capacity()) {
+        entity_table_.reserve(std::max(last_entity_index, entity_table_.capacity() * 2));
+    }
+    for (size_t instance_index = 0; instance_index < count; ++instance_index) {
+        EntityRecord& record = entity_table_.emplace_back(next_entity_id_++);
+        record.component_mask = prefab.component_mask;
+        for (size_t component_slot = 0; component_slot < Schema::component_slot_count(); ++component_slot) {
+            record.component_indexes[component_slot] = first_component_indexes[component_slot] + component_index_strides[component_slot] * instance_index;
+        }
+    }
+
+    live_entity_count_ += count;
+    awake_words_.resize((last_entity_index + 63) / 64, 0);
+    for (size_t entity_index = first_entity_index; entity_index < last_entity_index; ++entity_index) {
+        set_awake(entity_index, true);
+    }
+    wake_requested_.resize(last_entity_index, 0);
+
+    if (owner_tracked_component_mask_.any()) {
+        for (size_t component_type_index = 0; component_type_index < Schema::component_type_count(); ++component_type_index) {
+            if ((owner_tracked_component_mask_ & prefab.component_mask).test(component_type_index)) {
+                auto& component_owners = component_owners_[component_type_index];
+                assert(entity_table_[first_entity_index].get_component_index(component_type_index) == component_owners.size());
+                for (size_t entity_index = first_entity_index; entity_index < last_entity_index; ++entity_index) {
+                    component_owners.push_back(entity_index);
+                }
+            }
+        }
+    }
+
+    for (EntityQuery<Schema>* query: entity_queries_) {
+        if ((prefab.component_mask & query->component_mask_) == query->component_mask_) {
+            for (size_t entity_index = first_entity_index; entity_index < last_entity_index; ++entity_index) {
+                query->add_match(entity_index);
+            }
+        }
+    }
+
+    if (tracked_component_mask_.any()) {
+        for (auto& changes: component_changes_) {
+            if (changes) {
+                changes->changed.resize(entity_table_.size());
+            }
+        }
+
+        for (ComponentIndex<Schema>* index: component_indexes_) {
+            if (prefab.component_mask.test(index->component_type_index_)) {
+                for (size_t entity_index = first_entity_index; entity_index < last_entity_index; ++entity_index) {
+                    index->component_added(Entity<Schema>(*this, entity_index));
+                }
+            }
+        }
+    }
+
+    // the instances are fully added by now, so writes the overrides make are tracked like any other
+    for (size_t instance_index = 0; instance_index < count; ++instance_index) {
+        override(Entity<Schema>(*this, first_entity_index + instance_index), instance_index);
+    }
+
+    notify_entities_added(first_entity_index, count);
+    return first_entity_index;
+}
+
+template<typename Schema>
+Entity<Schema> EntityDatabase<Schema>::add_entity_record(EntityRecord record) {
     size_t entity_index = entity_table_.size();
-    entity_table_.push_back(record);
+    preserve_entity_table_growth(entity_table_.size() + 1);
+    entity_table_.push_back(std::move(record));
+    live_entity_count_ += 1;
+
+    if (entity_index % 64 == 0) {
+        awake_words_.push_back(0);
+    }
+    set_awake(entity_index, true);
+    wake_requested_.push_back(0);
+
+    const EntityRecord& added_record = entity_table_.back();
+    if (owner_tracked_component_mask_.any()) {
+        for (size_t component_type_index = 0; component_type_index < Schema::component_type_count(); ++component_type_index) {
+            if ((owner_tracked_component_mask_ & added_record.component_mask).test(component_type_index)) {
+                assert(added_record.get_component_index(component_type_index) == component_owners_[component_type_index].size());
+                component_owners_[component_type_index].push_back(entity_index);
+            }
+        }
+    }
+
+    for (EntityQuery<Schema>* query: entity_queries_) {
+        if ((added_record.component_mask & query->component_mask_) == query->component_mask_) {
+            query->add_match(entity_index);
+        }
+    }
+
+    if (tracked_component_mask_.any()) {
+        for (auto& changes: component_changes_) {
+            if (changes) {
+                changes->changed.resize(entity_table_.size());
+            }
+        }
+
+        for (ComponentIndex<Schema>* index: component_indexes_) {
+            if (added_record.component_mask.test(index->component_type_index_)) {
+                index->component_added(Entity<Schema>(*this, entity_index));
+            }
+        }
+    }
 
     Entity<Schema> entity (*this, entity_index);
     notify_entity_added(entity);
@@ -131,53 +468,928 @@ Entity<Schema> EntityDatabase<Schema>::add_entity(Component<component_types>...
 
 template<typename Schema>
 void EntityDatabase<Schema>::remove_entity(Entity<Schema> entity) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::remove_entity");
+
+    assert(entity_table_[entity.entity_index_].entity_id >= 0);
+
+    clear_parent(entity);
+    if (entity_table_[entity.entity_index_].child_count == 0) {
+        remove_entity_record(entity.entity_index_);
+        return;
+    }
+
+    // collect the whole subtree before removing any of it; removals leave children_ intact
+    update_relationships();
+
+    std::vector<size_t> subtree_entity_indexes = { entity.entity_index_ };
+    for (size_t subtree_index = 0; subtree_index < subtree_entity_indexes.size(); ++subtree_index) {
+        size_t parent_index = subtree_entity_indexes[subtree_index];
+        const EntityRecord& parent_record = entity_table_[parent_index];
+        for (size_t child_slot = parent_record.children_begin; child_slot < parent_record.children_end; ++child_slot) {
+            if (is_child_of(children_[child_slot], parent_index)) {
+                subtree_entity_indexes.push_back(children_[child_slot]);
+            }
+        }
+    }
+
+    for (size_t entity_index: subtree_entity_indexes) {
+        EntityRecord& record = entity_table_[entity_index];
+        if (record.parent_index != no_entity_index) {
+            preserve_entity_record(entity_index);
+            record.parent_index = no_entity_index;
+            relationship_count_ -= 1;
+        }
+        record.child_count = 0;
+
+        remove_entity_record(entity_index);
+    }
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+void EntityDatabase<Schema>::add_component(Entity<Schema> entity, Component<component_type> component) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::add_component");
+
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+
+    EntityRecord& record = entity_table_[entity.entity_index_];
+    assert(record.entity_id >= 0);
+    assert(!record.component_mask.test(component_type_index));
+
+    const ComponentTransition& transition = get_component_transition(record.component_mask, component_type_index, true);
+    preserve_entity_record(entity.entity_index_);
+    push_component(record, std::move(component));
+
+    if (owner_tracked_component_mask_.test(component_type_index)) {
+        component_owners_[component_type_index].push_back(entity.entity_index_);
+    }
+
+    bool awake = is_awake(entity.entity_index_);
+    for (EntityQuery<Schema>* query: transition.queries) {
+        if (is_visible_to(*query, awake)) {
+            query->add_match(entity.entity_index_);
+        }
+    }
+
+    if (transition.has_indexes) {
+        for (ComponentIndex<Schema>* index: component_indexes_) {
+            if (index->component_type_index_ == component_type_index) {
+                index->component_added(entity);
+            }
+        }
+    }
+
+    notify_component_added(entity, component_type);
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+void EntityDatabase<Schema>::remove_component(Entity<Schema> entity) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::remove_component");
+
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+
     EntityRecord& record = entity_table_[entity.entity_index_];
     assert(record.entity_id >= 0);
+    assert(record.component_mask.test(component_type_index));
+
+    // observers and indexes still see the component
+    notify_component_removed(entity, component_type);
+
+    const ComponentTransition& transition = get_component_transition(record.component_mask, component_type_index, false);
+    bool awake = is_awake(entity.entity_index_);
+    for (EntityQuery<Schema>* query: transition.queries) {
+        if (is_visible_to(*query, awake)) {
+            query->remove_match(entity.entity_index_);
+        }
+    }
+
+    if (transition.has_indexes) {
+        for (ComponentIndex<Schema>* index: component_indexes_) {
+            if (index->component_type_index_ == component_type_index) {
+                index->component_removed(entity);
+            }
+        }
+    }
 
-    notify_entity_removed(entity);
+    preserve_entity_record(entity.entity_index_);
+    record.component_mask.reset(component_type_index);
+
+    size_t component_index = record.get_component_index(component_type_index);
+    preserve_component(component_type_index, component_index);
+    if (owner_tracked_component_mask_.test(component_type_index)) {
+        component_owners_[component_type_index][component_index] = no_entity_index;
+    }
+
+    // move the component onto the stack so it can free resources
+    auto& component_table = std::get<component_type_index>(component_tables_);
+    auto removed_component = std::move(component_table[component_index]);
+    (void)removed_component;
+}
+
+template<typename Schema>
+auto EntityDatabase<Schema>::get_component_transition(ComponentMask component_mask, size_t component_type_index, bool added) -> const ComponentTransition& {
+    ComponentTransitionKey key { component_mask.to_ullong(), component_type_index, added };
+    auto [it, inserted] = component_transitions_.try_emplace(key);
+    if (!inserted) {
+        return it->second;
+    }
+
+    ComponentMask old_component_mask = component_mask;
+    ComponentMask new_component_mask = component_mask;
+    new_component_mask.set(component_type_index, added);
+
+    ComponentTransition& transition = it->second;
+    for (EntityQuery<Schema>* query: entity_queries_) {
+        bool old_match = (old_component_mask & query->component_mask_) == query->component_mask_;
+        bool new_match = (new_component_mask & query->component_mask_) == query->component_mask_;
+        if (old_match != new_match) {
+            transition.queries.push_back(query);
+        }
+    }
+
+    transition.has_indexes = tracked_component_mask_.test(component_type_index);
+    return transition;
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::remove_entity_record(size_t entity_index) {
+    EntityRecord& record = entity_table_[entity_index];
+    assert(record.entity_id >= 0);
+    assert(record.parent_index == no_entity_index && record.child_count == 0);
+
+    notify_entity_removed(Entity<Schema>(*this, entity_index));
+
+    bool awake = is_awake(entity_index);
+    for (EntityQuery<Schema>* query: entity_queries_) {
+        if (is_visible_to(*query, awake) && (record.component_mask & query->component_mask_) == query->component_mask_) {
+            query->remove_match(entity_index);
+        }
+    }
+
+    if (awake) {
+        set_awake(entity_index, false);
+    }
+    else {
+        sleeping_entity_count_ -= 1;
+    }
+
+    // pending changes of the entity are skipped once it is tombstoned
+    for (ComponentIndex<Schema>* index: component_indexes_) {
+        if (record.component_mask.test(index->component_type_index_)) {
+            index->component_removed(Entity<Schema>(*this, entity_index));
+        }
+    }
+
+    int64_t handle_count = 0;
+    for ([[maybe_unused]] auto& handle: record.handles) {
+        handle_count += 1;
+    }
+    handle_count_.add(-handle_count);
     record.handles.clear();
+    preserve_entity_record(entity_index);
     record.entity_id = -1;
+    live_entity_count_ -= 1;
 
-    size_t component_type_index = 0;
-    for_each_component_table([&](auto&& component_table) {
-        if (record.component_mask.test(component_type_id)) {
-            size_t component_index = record.component_indexes[component_type_index];
+    for_each_component_table(component_tables_, [&](auto component_type_index, auto&& component_table) {
+        if (record.component_mask.test(component_type_index)) {
+            size_t component_index = record.get_component_index(component_type_index);
+            if (owner_tracked_component_mask_.test(component_type_index)) {
+                component_owners_[component_type_index][component_index] = no_entity_index;
+            }
 
             // move the component onto the stack so it can free resources
+            preserve_component(component_type_index, component_index);
             auto component = std::move(component_table[component_index]);
             (void)component;
         }
+    });
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::preserve_entity_record(size_t entity_index) {
+    if (checkpoint_) {
+        checkpoint_->preserve_entity_records(entity_index, entity_index + 1);
+    }
+}
 
-        component_type_index += 1;
+template<typename Schema>
+void EntityDatabase<Schema>::preserve_component(size_t component_type_index, size_t component_index) {
+    if (checkpoint_) {
+        checkpoint_->preserve_components(component_type_index, component_index, component_index + 1);
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::preserve_entity_table_growth(size_t size) {
+    if (checkpoint_ && size > entity_table_.capacity()) {
+        checkpoint_->preserve_entity_table();
+    }
+}
+
+template<typename Schema>
+template<typename Table>
+void EntityDatabase<Schema>::preserve_component_table_growth(size_t component_type_index, const Table& component_table, size_t size) {
+    if (checkpoint_ && size > component_table.capacity()) {
+        checkpoint_->preserve_component_table(component_type_index);
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::add_entity_query(EntityQuery<Schema>& query) {
+    entity_queries_.push_back(&query);
+    component_transitions_.clear();
+
+    // match the entities that are already there
+    query.reset_matches(entity_table_.size());
+    for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+        const EntityRecord& record = entity_table_[entity_index];
+        if (record.entity_id >= 0 && is_visible_to(query, is_awake(entity_index)) && (record.component_mask & query.component_mask_) == query.component_mask_) {
+            query.add_match(entity_index);
+        }
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::add_component_index(ComponentIndex<Schema>& index) {
+    size_t component_type_index = index.component_type_index_;
+    component_indexes_.push_back(&index);
+    component_transitions_.clear();
+
+    if (!tracked_component_mask_.test(component_type_index)) {
+        tracked_component_mask_.set(component_type_index);
+        component_changes_[component_type_index] = std::make_unique<ComponentChanges>();
+        component_changes_[component_type_index]->changed.resize(entity_table_.size());
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::remove_component_index(ComponentIndex<Schema>& index) {
+    size_t component_type_index = index.component_type_index_;
+    if (auto it = std::find(component_indexes_.begin(), component_indexes_.end(), &index); it != component_indexes_.end()) {
+        component_indexes_.erase(it);
+    }
+
+    bool tracked = std::any_of(component_indexes_.begin(), component_indexes_.end(), [&](ComponentIndex<Schema>* other_index) {
+        return other_index->component_type_index_ == component_type_index;
     });
+
+    if (!tracked) {
+        tracked_component_mask_.reset(component_type_index);
+        component_changes_[component_type_index].reset();
+        component_transitions_.clear();
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::update_component_indexes() {
+    if (tracked_component_mask_.none()) {
+        return;
+    }
+
+    ENTLER_PROFILE_ZONE("EntityDatabase::update_component_indexes");
+
+    for (size_t component_type_index = 0; component_type_index < Schema::component_type_count(); ++component_type_index) {
+        if (!tracked_component_mask_.test(component_type_index)) {
+            continue;
+        }
+
+        ComponentChanges& changes = *component_changes_[component_type_index];
+        changes.entity_indexes.drain([&](size_t entity_index) {
+            changes.changed[entity_index] = 0;
+
+            const EntityRecord& record = entity_table_[entity_index];
+            if (record.entity_id < 0 || !record.component_mask.test(component_type_index)) {
+                return;
+            }
+
+            for (ComponentIndex<Schema>* index: component_indexes_) {
+                if (index->component_type_index_ == component_type_index) {
+                    index->component_changed(Entity<Schema>(*this, entity_index));
+                }
+            }
+        });
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::set_parent(Entity<Schema> child, Entity<Schema> parent) {
+    assert(entity_table_[child.entity_index_].entity_id >= 0);
+    assert(entity_table_[parent.entity_index_].entity_id >= 0);
+
+#ifndef NDEBUG
+    for (size_t ancestor_index = parent.entity_index_; ancestor_index != no_entity_index; ancestor_index = entity_table_[ancestor_index].parent_index) {
+        assert(ancestor_index != child.entity_index_);
+    }
+#endif
+
+    clear_parent(child);
+
+    preserve_entity_record(child.entity_index_);
+    entity_table_[child.entity_index_].parent_index = parent.entity_index_;
+    entity_table_[parent.entity_index_].child_count += 1;
+    relationship_count_ += 1;
+    relationships_dirty_ = true;
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::clear_parent(Entity<Schema> child) {
+    EntityRecord& record = entity_table_[child.entity_index_];
+    if (record.parent_index == no_entity_index) {
+        return;
+    }
+
+    entity_table_[record.parent_index].child_count -= 1;
+    preserve_entity_record(child.entity_index_);
+    record.parent_index = no_entity_index;
+    relationship_count_ -= 1;
+}
+
+template<typename Schema>
+std::optional<Entity<Schema>> EntityDatabase<Schema>::get_parent(Entity<Schema> entity) {
+    size_t parent_index = entity_table_[entity.entity_index_].parent_index;
+    if (parent_index == no_entity_index) {
+        return std::nullopt;
+    }
+
+    return Entity<Schema>(*this, parent_index);
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::get_child_count(Entity<Schema> entity) const {
+    return entity_table_[entity.entity_index_].child_count;
 }
 
 template<typename Schema>
 template<typename Visitor>
-void EntityDatabase<Schema>::for_each_entity(Visitor&& visitor) {
-    size_t entity_count = entity_table_.size();
-    for (size_t entity_index = 0; entity_index < entity_count; ++entity_index) {
-        EntityRecord& record = entity_table_[entity_index];
-        if (record.entity_id < 0) {
+void EntityDatabase<Schema>::for_each_child(Entity<Schema> parent, Visitor&& visitor) {
+    update_relationships();
+
+    const EntityRecord& parent_record = entity_table_[parent.entity_index_];
+    for (size_t child_slot = parent_record.children_begin; child_slot < parent_record.children_end; ++child_slot) {
+        size_t child_index = children_[child_slot];
+        if (is_child_of(child_index, parent.entity_index_)) {
+            visitor(Entity<Schema>(*this, child_index));
+        }
+    }
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_relationship(Visitor&& visitor) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::for_each_relationship");
+
+    update_relationships();
+
+    for (const RelationshipNode& node: relationship_order_) {
+        if (node.parent_node_index == no_entity_index) {
             continue;
         }
 
-        visitor(Entity<Schema>(*this, entity_index));
+        size_t parent_index = relationship_order_[node.parent_node_index].entity_index;
+        if (is_child_of(node.entity_index, parent_index)) {
+            visitor(Entity<Schema>(*this, parent_index), Entity<Schema>(*this, node.entity_index));
+        }
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::update_relationships() {
+    if (!relationships_dirty_) {
+        return;
+    }
+
+    ENTLER_PROFILE_ZONE("EntityDatabase::update_relationships");
+
+    children_.clear();
+    relationship_order_.clear();
+    relationships_dirty_ = false;
+    if (relationship_count_ == 0) {
+        for (EntityRecord& record: entity_table_) {
+            record.children_begin = 0;
+            record.children_end = 0;
+        }
+
+        return;
+    }
+
+    // lay the children of every parent out next to each other with a counting sort
+    for (EntityRecord& record: entity_table_) {
+        record.children_begin = 0;
+        record.children_end = 0;
+    }
+    for (const EntityRecord& record: entity_table_) {
+        if (record.entity_id >= 0 && record.parent_index != no_entity_index) {
+            entity_table_[record.parent_index].children_end += 1;
+        }
+    }
+
+    size_t child_slot = 0;
+    for (EntityRecord& record: entity_table_) {
+        size_t child_count = record.children_end;
+        record.children_begin = child_slot;
+        record.children_end = child_slot;
+        child_slot += child_count;
+    }
+
+    children_.resize(child_slot);
+    for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+        const EntityRecord& record = entity_table_[entity_index];
+        if (record.entity_id >= 0 && record.parent_index != no_entity_index) {
+            children_[entity_table_[record.parent_index].children_end++] = entity_index;
+        }
+    }
+
+    // walk every tree from its root; stack entries are (entity index, parent node index)
+    std::vector<RelationshipNode> stack;
+    for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+        const EntityRecord& record = entity_table_[entity_index];
+        if (record.entity_id < 0 || record.parent_index != no_entity_index || record.child_count == 0) {
+            continue;
+        }
+
+        stack.push_back(RelationshipNode{entity_index, no_entity_index});
+        while (!stack.empty()) {
+            RelationshipNode node = stack.back();
+            stack.pop_back();
+
+            size_t node_index = relationship_order_.size();
+            relationship_order_.push_back(node);
+
+            // pushed in reverse so the first child is walked first
+            const EntityRecord& node_record = entity_table_[node.entity_index];
+            for (size_t child_slot = node_record.children_end; child_slot != node_record.children_begin; --child_slot) {
+                stack.push_back(RelationshipNode{children_[child_slot - 1], node_index});
+            }
+        }
+    }
+}
+
+template<typename Schema>
+EntitySnapshot<Schema> EntityDatabase<Schema>::take_snapshot(Entity<Schema> entity) const {
+    const EntityRecord& record = entity_table_[entity.entity_index_];
+    assert(record.entity_id >= 0);
+
+    EntitySnapshot<Schema> snapshot;
+    snapshot.component_mask = record.component_mask;
+    for_each_component_table(component_tables_, [&](auto component_type_index, const auto& component_table) {
+        if (record.component_mask.test(component_type_index)) {
+            std::get<component_type_index>(snapshot.components) = component_table[record.get_component_index(component_type_index)];
+        }
+    });
+
+    return snapshot;
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+auto EntityDatabase<Schema>::get_component_table() -> ComponentTable<component_type>& {
+    return std::get<Schema::template component_type_index_v<component_type>>(component_tables_);
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+void EntityDatabase<Schema>::prepare_component_writes(size_t first_component_index, size_t last_component_index) {
+    assert(first_component_index <= last_component_index);
+    if (checkpoint_) {
+        checkpoint_->preserve_components(Schema::template component_type_index_v<component_type>, first_component_index, last_component_index);
+    }
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+void EntityDatabase<Schema>::mark_components_changed(size_t first_component_index, size_t last_component_index) {
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+    assert(first_component_index <= last_component_index);
+    if (!tracked_component_mask_.test(component_type_index)) {
+        return;
+    }
+
+    const std::vector<size_t>& component_owners = get_component_owners<component_type>();
+    for (size_t component_index = first_component_index; component_index < last_component_index; ++component_index) {
+        size_t entity_index = component_owners[component_index];
+        if (entity_index != no_entity_index) {
+            mark_component_changed(component_type_index, entity_index);
+        }
+    }
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+void EntityDatabase<Schema>::track_component_owners() {
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+    static_assert(get_component_storage<Component<component_type>>() != ComponentStorage::tag, "Tags have no slots");
+
+    if (owner_tracked_component_mask_.test(component_type_index)) {
+        return;
+    }
+
+    owner_tracked_component_mask_.set(component_type_index);
+
+    std::vector<size_t>& component_owners = component_owners_[component_type_index];
+    component_owners.assign(get_component_table<component_type>().size(), no_entity_index);
+    for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+        const EntityRecord& record = entity_table_[entity_index];
+        if (record.entity_id >= 0 && record.component_mask.test(component_type_index)) {
+            component_owners[record.get_component_index(component_type_index)] = entity_index;
+        }
+    }
+}
+
+template<typename Schema>
+template<typename Schema::ComponentType component_type>
+const std::vector<size_t>& EntityDatabase<Schema>::get_component_owners() const {
+    constexpr size_t component_type_index = Schema::template component_type_index_v<component_type>;
+    assert(owner_tracked_component_mask_.test(component_type_index));
+    return component_owners_[component_type_index];
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::sleep_entity(Entity<Schema> entity) {
+    const EntityRecord& record = entity_table_[entity.entity_index_];
+    assert(record.entity_id >= 0);
+    if (!is_awake(entity.entity_index_)) {
+        return;
+    }
+
+    set_awake(entity.entity_index_, false);
+    sleeping_entity_count_ += 1;
+
+    for (EntityQuery<Schema>* query: entity_queries_) {
+        if (!is_visible_to(*query, false) && (record.component_mask & query->component_mask_) == query->component_mask_) {
+            query->remove_match(entity.entity_index_);
+        }
+    }
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::wake_entity(Entity<Schema> entity) {
+    const EntityRecord& record = entity_table_[entity.entity_index_];
+    assert(record.entity_id >= 0);
+    if (is_awake(entity.entity_index_)) {
+        return;
+    }
+
+    set_awake(entity.entity_index_, true);
+    sleeping_entity_count_ -= 1;
+
+    for (EntityQuery<Schema>* query: entity_queries_) {
+        if (!is_visible_to(*query, false) && (record.component_mask & query->component_mask_) == query->component_mask_) {
+            query->add_match(entity.entity_index_);
+        }
+    }
+}
+
+template<typename Schema>
+bool EntityDatabase<Schema>::is_sleeping(Entity<Schema> entity) const {
+    assert(entity_table_[entity.entity_index_].entity_id >= 0);
+    return !is_awake(entity.entity_index_);
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::get_active_entity_count() const {
+    return live_entity_count_ - sleeping_entity_count_;
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::get_sleeping_entity_count() const {
+    return sleeping_entity_count_;
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::apply_wake_requests() {
+    wake_requests_.drain([&](size_t entity_index) {
+        wake_requested_[entity_index] = 0;
+        if (entity_table_[entity_index].entity_id >= 0) {
+            wake_entity(Entity<Schema>(*this, entity_index));
+        }
+    });
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::swap_component_buffers() {
+    for_each_component_table(component_tables_, [&](auto component_type_index, auto& component_table) {
+        constexpr auto layout = Schema::get_component_layout(component_type_index);
+        if constexpr (layout.storage == ComponentStorage::double_buffered) {
+            component_table.swap_buffers();
+        }
+    });
+
+    apply_wake_requests();
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::vacuum() {
+    ENTLER_PROFILE_ZONE("EntityDatabase::vacuum");
+
+    compact(nullptr);
+}
+
+template<typename Schema>
+template<typename SortKey>
+void EntityDatabase<Schema>::vacuum(SortKey&& sort_key) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::vacuum");
+
+    std::vector<std::pair<uint64_t, size_t>> keyed_entity_indexes;
+    keyed_entity_indexes.reserve(live_entity_count_);
+    for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+        if (entity_table_[entity_index].entity_id >= 0) {
+            keyed_entity_indexes.emplace_back(static_cast<uint64_t>(sort_key(Entity<Schema>(*this, entity_index))), entity_index);
+        }
+    }
+
+    // ties go by entity index, which keeps their order
+    std::sort(keyed_entity_indexes.begin(), keyed_entity_indexes.end());
+
+    std::vector<size_t> order;
+    order.reserve(keyed_entity_indexes.size());
+    for (auto [key, entity_index]: keyed_entity_indexes) {
+        order.push_back(entity_index);
     }
+
+    compact(&order);
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::compact(const std::vector<size_t>* order) {
+    auto start = std::chrono::steady_clock::now();
+
+    // every record and component may move
+    if (checkpoint_) {
+        checkpoint_->preserve_entity_table();
+        for (size_t component_type_index = 0; component_type_index < Schema::component_type_count(); ++component_type_index) {
+            checkpoint_->preserve_component_table(component_type_index);
+        }
+    }
+
+    // indexes have to see the changes made under the old entity indexes, as do wake requests
+    update_component_indexes();
+    apply_wake_requests();
+
+    // parents and indexes refer to entities by index, so remember where every entity moves to
+    bool remap_entity_indexes = relationship_count_ > 0 || !component_indexes_.empty();
+    std::vector<size_t> live_entity_indexes;
+    if (remap_entity_indexes) {
+        live_entity_indexes.resize(entity_table_.size(), no_entity_index);
+    }
+
+    if (order) {
+        // records move to a new table, as an entity may move either way; so do the awake bits
+        assert(order->size() == live_entity_count_);
+        std::vector<EntityRecord> live_entity_table;
+        live_entity_table.reserve(order->size());
+        std::vector<uint64_t> live_awake_words((order->size() + 63) / 64, 0);
+
+        for (size_t entity_index: *order) {
+            assert(entity_table_[entity_index].entity_id >= 0);
+            size_t live_entity_index = live_entity_table.size();
+            if (remap_entity_indexes) {
+                live_entity_indexes[entity_index] = live_entity_index;
+            }
+
+            live_awake_words[live_entity_index / 64] |= uint64_t(is_awake(entity_index)) << (live_entity_index % 64);
+            live_entity_table.push_back(std::move(entity_table_[entity_index]));
+        }
+
+        entity_table_ = std::move(live_entity_table);
+        awake_words_ = std::move(live_awake_words);
+        for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+            update_entity_index(entity_index);
+        }
+    }
+    else {
+        // the awake bits move along with their entities; live_entity_index never passes entity_index
+        size_t live_entity_index = 0;
+        for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+            if (entity_table_[entity_index].entity_id < 0) {
+                continue;
+            }
+
+            if (remap_entity_indexes) {
+                live_entity_indexes[entity_index] = live_entity_index;
+            }
+
+            bool awake = is_awake(entity_index);
+            set_awake(entity_index, false);
+            set_awake(live_entity_index, awake);
+
+            if (live_entity_index != entity_index) {
+                entity_table_[live_entity_index] = std::move(entity_table_[entity_index]);
+                update_entity_index(live_entity_index);
+            }
+
+            live_entity_index += 1;
+        }
+
+        entity_table_.erase(entity_table_.begin() + live_entity_index, entity_table_.end());
+        awake_words_.resize((entity_table_.size() + 63) / 64);
+    }
+
+    assert(entity_table_.size() == live_entity_count_);
+    wake_requested_.assign(entity_table_.size(), 0);
+
+    // every match moved, so rebuild the queries, which also puts them back into entity order
+    if (!entity_queries_.empty()) {
+        for (EntityQuery<Schema>* query: entity_queries_) {
+            query->reset_matches(entity_table_.size());
+        }
+        for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+            const EntityRecord& record = entity_table_[entity_index];
+            bool awake = is_awake(entity_index);
+            for (EntityQuery<Schema>* query: entity_queries_) {
+                if (is_visible_to(*query, awake) && (record.component_mask & query->component_mask_) == query->component_mask_) {
+                    query->add_match(entity_index);
+                }
+            }
+        }
+    }
+
+    if (relationship_count_ > 0) {
+        for (EntityRecord& record: entity_table_) {
+            if (record.parent_index != no_entity_index) {
+                record.parent_index = live_entity_indexes[record.parent_index];
+                assert(record.parent_index != no_entity_index);
+            }
+        }
+
+        relationships_dirty_ = true;
+    }
+
+    for (ComponentIndex<Schema>* index: component_indexes_) {
+        index->entities_moved(live_entity_indexes, entity_table_.size());
+    }
+    for (auto& changes: component_changes_) {
+        if (changes) {
+            changes->changed.assign(entity_table_.size(), 0);
+        }
+    }
+
+    // rebuild each table in entity order, which drops the components of removed entities
+    for_each_component_table(component_tables_, [&](auto component_type_index, auto& component_table) {
+        constexpr auto layout = Schema::get_component_layout(component_type_index);
+        if constexpr (layout.storage != ComponentStorage::tag) {
+            std::remove_reference_t<decltype(component_table)> live_component_table;
+            live_component_table.reserve(component_table.size());
+
+            bool owners_tracked = owner_tracked_component_mask_.test(component_type_index);
+            std::vector<size_t>& component_owners = component_owners_[component_type_index];
+            component_owners.clear();
+
+            for (size_t entity_index = 0; entity_index < entity_table_.size(); ++entity_index) {
+                EntityRecord& record = entity_table_[entity_index];
+                if (record.component_mask.test(component_type_index)) {
+                    size_t component_index = record.get_component_index(component_type_index);
+                    live_component_table.push_back(std::move(component_table[component_index]));
+                    record.set_component_index(component_type_index, live_component_table.size() - 1);
+
+                    if (owners_tracked) {
+                        component_owners.push_back(entity_index);
+                    }
+                }
+            }
+
+            component_table = std::move(live_component_table);
+        }
+    });
+
+    auto stop = std::chrono::steady_clock::now();
+    last_vacuum_time_ns_ = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    total_vacuum_time_ns_ += last_vacuum_time_ns_;
+    vacuum_count_ += 1;
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::get_live_entity_count() const {
+    return live_entity_count_;
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::get_tombstone_count() const {
+    return entity_table_.size() - live_entity_count_;
+}
+
+template<typename Schema>
+void EntityDatabase<Schema>::collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const {
+    std::string name(prefix);
+    auto add = [&](std::string_view suffix, auto value) {
+        snapshot.add(name + std::string(suffix), static_cast<int64_t>(value));
+    };
+
+    add("live_entities", live_entity_count_);
+    add("active_entities", get_active_entity_count());
+    add("sleeping_entities", sleeping_entity_count_);
+    add("tombstoned_entities", get_tombstone_count());
+    add("entity_table.size", entity_table_.size());
+    add("entity_table.capacity", entity_table_.capacity());
+    add("relationships", relationship_count_);
+    add("handles", handle_count_.load());
+    add("observers", entity_observers_.size());
+    add("queries", entity_queries_.size());
+    add("component_indexes", component_indexes_.size());
+    add("observer_dispatches", observer_dispatch_count_.load());
+    add("vacuums", vacuum_count_);
+    add("vacuum.last_ns", last_vacuum_time_ns_);
+    add("vacuum.total_ns", total_vacuum_time_ns_);
+
+    for_each_component_table(component_tables_, [&](auto component_type_index, const auto& component_table) {
+        constexpr auto layout = Schema::get_component_layout(component_type_index);
+
+        std::string table_name = std::string("component_table.") + to_string(layout.component_type);
+        add(table_name + ".size", component_table.size());
+        add(table_name + ".capacity", component_table.capacity());
+        // double buffered tables hold two copies and a state word per slot
+        size_t slot_size = layout.storage == ComponentStorage::double_buffered ? layout.size * 2 + sizeof(uint64_t) : layout.size;
+        add(table_name + ".bytes", component_table.capacity() * slot_size);
+    });
+}
+
+template<typename Schema>
+Entity<Schema> EntityDatabase<Schema>::get_entity(size_t entity_index) {
+    assert(get_entity_record(entity_index).entity_id >= 0);
+    return Entity<Schema>(*this, entity_index);
+}
+
+template<typename Schema>
+size_t EntityDatabase<Schema>::get_entity_table_size() const {
+    return entity_table_.size();
+}
+
+template<typename Schema>
+bool EntityDatabase<Schema>::is_live(size_t entity_index) const {
+    assert(entity_index < entity_table_.size());
+    return entity_table_[entity_index].entity_id >= 0;
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_entity(Visitor&& visitor) {
+    for_each_entity(0, entity_table_.size(), ComponentMask(), SleepingEntities::skip, std::forward<Visitor>(visitor));
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_entity(SleepingEntities sleeping_entities, Visitor&& visitor) {
+    for_each_entity(0, entity_table_.size(), ComponentMask(), sleeping_entities, std::forward<Visitor>(visitor));
 }
 
 template<typename Schema>
 template<typename Visitor>
 void EntityDatabase<Schema>::for_each_entity(std::initializer_list<ComponentType> component_types, Visitor&& visitor) {
-    ComponentMask component_mask;
-    for (ComponentType component_type: component_types) {
-        std::optional<size_t> component_type_index = Schema::find_component_type(component_type);
-        assert(component_type_index);
-        component_mask.set(*component_type_index);
+    ComponentMask component_mask = Schema::make_component_mask(component_types);
+    for_each_entity(0, entity_table_.size(), component_mask, SleepingEntities::skip, std::forward<Visitor>(visitor));
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_entity(ComponentMask component_mask, Visitor&& visitor) {
+    for_each_entity(0, entity_table_.size(), component_mask, SleepingEntities::skip, std::forward<Visitor>(visitor));
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_entity(ComponentMask component_mask, SleepingEntities sleeping_entities, Visitor&& visitor) {
+    for_each_entity(0, entity_table_.size(), component_mask, sleeping_entities, std::forward<Visitor>(visitor));
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_entity(size_t first_entity_index, size_t last_entity_index, ComponentMask component_mask, Visitor&& visitor) {
+    for_each_entity(first_entity_index, last_entity_index, component_mask, SleepingEntities::skip, std::forward<Visitor>(visitor));
+}
+
+template<typename Schema>
+template<typename Visitor>
+void EntityDatabase<Schema>::for_each_entity(size_t first_entity_index, size_t last_entity_index, ComponentMask component_mask, SleepingEntities sleeping_entities, Visitor&& visitor) {
+    ENTLER_PROFILE_ZONE("EntityDatabase::for_each_entity");
+
+    assert(first_entity_index <= last_entity_index);
+    assert(last_entity_index <= entity_table_.size());
+
+    // only awake entities have their bit set, so the bitmap skips sleeping and removed entities alike;
+    // the visitor may remove entities later in the copied word, so their record is checked again
+    if (sleeping_entities == SleepingEntities::skip) {
+        for (size_t word_index = first_entity_index / 64; word_index * 64 < last_entity_index; ++word_index) {
+            uint64_t word = awake_words_[word_index];
+            if (word_index == first_entity_index / 64) {
+                word &= ~0ull << (first_entity_index % 64);
+            }
+            if (last_entity_index - word_index * 64 < 64) {
+                word &= (1ull << (last_entity_index - word_index * 64)) - 1;
+            }
+
+            for (; word != 0; word &= word - 1) {
+                size_t entity_index = word_index * 64 + static_cast<size_t>(std::countr_zero(word));
+                const EntityRecord& record = entity_table_[entity_index];
+                if (record.entity_id >= 0 && (record.component_mask & component_mask) == component_mask) {
+                    visitor(Entity<Schema>(*this, entity_index));
+                }
+            }
+        }
+
+        return;
     }
 
-    size_t entity_count = entity_table_.size();
-    for (size_t entity_index = 0; entity_index < entity_count; ++entity_index) {
+    for (size_t entity_index = first_entity_index; entity_index < last_entity_index; ++entity_index) {
         EntityRecord& record = entity_table_[entity_index];
         if (record.entity_id < 0) {
             continue;
@@ -1,18 +1,67 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <bitset>
+#include <initializer_list>
 #include <optional>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 #include <cstring>
 #include <cstdint>
 #include <cassert>
+#include "component_table.h"
 
 namespace entler {
 
     template<typename ComponentType, ComponentType component_type>
     class Component;
 
+    // components opt into double buffering with a static member:
+    //   static constexpr ComponentStorage storage = ComponentStorage::double_buffered;
+    // components without data members are stored as tags
+    enum class ComponentStorage {
+        single_buffered,
+        double_buffered,
+        tag,
+    };
+
+    template<typename Component>
+    constexpr ComponentStorage get_component_storage() {
+        if constexpr (requires { Component::storage; }) {
+            return Component::storage;
+        }
+        else if constexpr (std::is_empty_v<Component>) {
+            return ComponentStorage::tag;
+        }
+        else {
+            return ComponentStorage::single_buffered;
+        }
+    }
+
+    template<typename Component>
+    using ComponentTable = std::conditional_t<
+        get_component_storage<Component>() == ComponentStorage::double_buffered,
+        DoubleBufferedComponentTable<Component>,
+        std::conditional_t<
+            get_component_storage<Component>() == ComponentStorage::tag,
+            TagComponentTable<Component>,
+            std::vector<Component>
+        >
+    >;
+
+    // static description of how a component is stored, for storage and serialization code
+    template<typename ComponentType>
+    struct ComponentLayout {
+        ComponentType    component_type;
+        size_t           component_type_index;
+        size_t           size;
+        size_t           alignment;
+        bool             trivially_copyable;
+        ComponentStorage storage;
+    };
+
     template<typename ComponentType_, ComponentType_... component_types>
     class EntitySchema {
     public:
@@ -23,18 +72,72 @@ namespace entler {
         using Component = entler::Component<ComponentType, component_type>;
 
         using ComponentTables = std::tuple<
-            std::vector<
+            ComponentTable<
                 Component<component_types>
             >...
         >;
 
+        // one value of every component type
+        using ComponentValues = std::tuple<
+            Component<component_types>...
+        >;
+
+    private:
+        using ComponentTypeValue = std::underlying_type_t<ComponentType>;
+
+        static_assert(sizeof...(component_types) > 0, "Schemas need at least one component type");
+        static_assert(sizeof...(component_types) <= 64, "Component masks are built from 64 bit words");
+        static_assert(((static_cast<ComponentTypeValue>(component_types) >= 0) && ...), "Component type values must not be negative");
+
+        static constexpr size_t component_type_value_limit = std::max({static_cast<size_t>(component_types)...}) + 1;
+        static_assert(component_type_value_limit <= 1024, "Component type values are used to index a lookup table");
+
+        // maps a component type value to its index in component_types, or to component_type_count() if absent
+        static constexpr auto component_type_index_table = []() {
+            std::array<uint16_t, component_type_value_limit> table = {};
+            for (auto& component_type_index: table) {
+                component_type_index = sizeof...(component_types);
+            }
+
+            uint16_t component_type_index = 0;
+            ((table[static_cast<size_t>(component_types)] = component_type_index++), ...);
+            return table;
+        }();
+
+        // maps a component type index to its slot in the per entity component index array,
+        // or to component_type_count() for tags, which have no slot
+        static constexpr auto component_slot_table = []() {
+            std::array<uint16_t, sizeof...(component_types)> table = {};
+
+            size_t component_type_index = 0;
+            uint16_t component_slot = 0;
+            ((table[component_type_index++] = get_component_storage<Component<component_types>>() == ComponentStorage::tag
+                ? static_cast<uint16_t>(sizeof...(component_types))
+                : component_slot++), ...);
+            return table;
+        }();
+
     public:
         static constexpr size_t component_type_count() {
             return sizeof...(component_types);
         }
 
+        // the number of component types that are not tags
+        static constexpr size_t component_slot_count() {
+            return ((get_component_storage<Component<component_types>>() != ComponentStorage::tag ? 1 : 0) + ... + 0);
+        }
+
+        static constexpr std::optional<size_t> find_component_slot(size_t component_type_index) {
+            size_t component_slot = component_slot_table[component_type_index];
+            if (component_slot == component_type_count()) {
+                return std::nullopt;
+            }
+
+            return component_slot;
+        }
+
         static constexpr ComponentType get_component_type(size_t component_type_index) {
-            ComponentType component_type_array[] = {
+            constexpr ComponentType component_type_array[] = {
                     component_types...
             };
 
@@ -42,13 +145,64 @@ namespace entler {
         }
 
         static constexpr std::optional<size_t> find_component_type(ComponentType component_type) {
-            for (size_t component_type_index = 0; component_type_index < component_type_count(); ++component_type_index) {
-                if (component_type == get_component_type(component_type_index)) {
-                    return component_type_index;
-                }
+            auto component_type_value = static_cast<size_t>(component_type);
+            if (component_type_value >= component_type_value_limit) {
+                return std::nullopt;
+            }
+
+            size_t component_type_index = component_type_index_table[component_type_value];
+            if (component_type_index == component_type_count()) {
+                return std::nullopt;
+            }
+
+            return component_type_index;
+        }
+
+        template<ComponentType component_type>
+        static constexpr size_t component_type_index_v = []() {
+            constexpr auto component_type_index = find_component_type(component_type);
+            static_assert(component_type_index, "Unknown component type");
+            return *component_type_index;
+        }();
+
+        static constexpr ComponentMask make_component_mask(std::initializer_list<ComponentType> component_types_) {
+            unsigned long long component_mask_bits = 0;
+            for (ComponentType component_type: component_types_) {
+                std::optional<size_t> component_type_index = find_component_type(component_type);
+                assert(component_type_index);
+                component_mask_bits |= 1ull << *component_type_index;
             }
 
-            return std::nullopt;
+            return ComponentMask(component_mask_bits);
+        }
+
+        // the mask is folded at compile time, e.g. Schema::component_mask_v<ComponentType::position>
+        template<ComponentType... mask_component_types>
+        static constexpr ComponentMask component_mask_v = ComponentMask(
+            ((1ull << component_type_index_v<mask_component_types>) | ... | 0ull)
+        );
+
+        static constexpr std::array<ComponentLayout<ComponentType>, sizeof...(component_types)> get_component_layouts() {
+            size_t component_type_index = 0;
+            return {
+                ComponentLayout<ComponentType> {
+                    .component_type = component_types,
+                    .component_type_index = component_type_index++,
+                    .size = sizeof(Component<component_types>),
+                    .alignment = alignof(Component<component_types>),
+                    .trivially_copyable = std::is_trivially_copyable_v<Component<component_types>>,
+                    .storage = get_component_storage<Component<component_types>>(),
+                }...
+            };
+        }
+
+        static constexpr ComponentLayout<ComponentType> get_component_layout(size_t component_type_index) {
+            return get_component_layouts()[component_type_index];
+        }
+
+        // true when every component can be copied as raw bytes
+        static constexpr bool is_trivially_copyable() {
+            return (std::is_trivially_copyable_v<Component<component_types>> && ...);
         }
     };
 
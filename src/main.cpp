@@ -1,11 +1,631 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
 
 #include "simulation/simulation.h"
+#include "simulation/behavior_system.h"
+#include "simulation/checkpointer.h"
+#include "simulation/map_streamer.h"
+#include "simulation/energy_system.h"
+#include "simulation/movement_system.h"
+#include "simulation/script_system.h"
+#include "simulation/sharded_simulation.h"
+#include "simulation/state_hash.h"
+#include "simulation/terminal_renderer.h"
+#include "simulation/world_export.h"
+#include "util/process.h"
+#include "util/profiler.h"
 
 using namespace entler;
 
+namespace {
+
+    constexpr size_t max_behavior_interval = 64;
+
+    struct Options {
+        size_t width = 100;
+        size_t height = 100;
+        size_t object_counts[4] = { 1000, 500, 500, 500 }; // indexed by ObjectType
+        size_t ticks = 1000;
+        size_t threads = 1;
+        size_t shard_columns = 1;
+        size_t shard_rows = 1;
+        bool behavior = false;
+        std::string behavior_rate = "tick";
+        size_t behavior_interval = 8;
+        size_t behavior_near_radius = 16;
+        size_t behavior_budget_us = 0;
+        bool scripts = false;
+        size_t spatial_sort_interval = 0;
+        size_t render_fps = 0;
+        size_t viewport_x = 0;
+        size_t viewport_y = 0;
+        size_t viewport_width = 40;
+        size_t viewport_height = 20;
+        size_t stream_chunk_size = 0;
+        size_t stream_radius = 1;
+        std::string map_path = "entler.map";
+        std::string export_name;
+        size_t checkpoint_interval = 0;
+        std::string checkpoint_path = "entler.checkpoint";
+        std::string restore_path;
+        size_t report_interval = 100;
+        size_t metrics_interval = 1000;
+        uint32_t seed = 1;
+        std::string trace_path;
+    };
+
+    void print_usage(const char* program) {
+        std::cerr
+            << "usage: " << program << " [options]\n"
+            << "  --width=N            map width (default 100)\n"
+            << "  --height=N           map height (default 100)\n"
+            << "  --robots=N           number of robots (default 1000)\n"
+            << "  --rocks=N            number of rocks (default 500)\n"
+            << "  --balls=N            number of balls (default 500)\n"
+            << "  --blocks=N           number of blocks (default 500)\n"
+            << "  --ticks=N            number of ticks to run (default 1000)\n"
+            << "  --threads=N          number of simulation threads (default 1)\n"
+            << "  --shard-columns=N    split the map into N region columns (default 1)\n"
+            << "  --shard-rows=N       split the map into N region rows (default 1)\n"
+            << "  --behavior=0|1       drive robots with behavior trees, unsharded only (default 0)\n"
+            << "  --behavior-rate=MODE update behaviors every tick (tick), every Nth tick (nth), a round-robin 1/N of them\n"
+            << "                       per tick (slice), or every tick near the area of interest and every Nth tick\n"
+            << "                       further out (lod) (default tick)\n"
+            << "  --behavior-n=N       N for --behavior-rate (default 8)\n"
+            << "  --behavior-near=N    tiles around the area of interest that lod updates every tick (default 16)\n"
+            << "  --behavior-budget=N  raise or lower N to keep behavior updates under N microseconds, slice and lod only;\n"
+            << "                       runs are no longer deterministic (default 0, off)\n"
+            << "  --scripts=0|1        run a script on every robot that stops it for a while when it bumps into something,\n"
+            << "                       unsharded and unstreamed only; restored runs start the scripts over (default 0)\n"
+            << "  --spatial-sort=N     sort entity storage by map location every N ticks, unsharded only (default 0, off)\n"
+            << "  --render=N           draw the map to the terminal at up to N frames/s, unsharded only (default 0, off)\n"
+            << "  --viewport-x=N       first column of the map to draw (default 0)\n"
+            << "  --viewport-y=N       first row of the map to draw (default 0)\n"
+            << "  --viewport-width=N   columns of the map to draw (default 40)\n"
+            << "  --viewport-height=N  rows of the map to draw (default 20)\n"
+            << "  --stream-chunk=N     stream the map from disk in N x N tile chunks around a moving area of interest,\n"
+            << "                       unsharded only; runs are no longer deterministic (default 0, off)\n"
+            << "  --stream-radius=N    chunks kept in memory around the area of interest (default 1)\n"
+            << "  --map=FILE           map file written and streamed by --stream-chunk (default entler.map)\n"
+            << "  --export=NAME        publish the world to shared memory segment NAME after every tick, unsharded only\n"
+            << "                       (read it with entler_world_reader)\n"
+            << "  --checkpoint-ticks=N write a checkpoint in the background every N ticks, unsharded and unstreamed only\n"
+            << "                       (default 0, off)\n"
+            << "  --checkpoint=FILE    file written by --checkpoint-ticks (default entler.checkpoint)\n"
+            << "  --restore=FILE       start from a checkpoint instead of placing objects, unsharded only\n"
+            << "  --report-interval=N  ticks per report line, 0 for only a summary (default 100)\n"
+            << "  --metrics-interval=N ticks between metrics dumps, 0 to disable (default 1000)\n"
+            << "  --seed=N             seed for object placement (default 1)\n"
+            << "  --trace=FILE         write a chrome trace of the run (requires ENTLER_PROFILING)\n";
+    }
+
+    bool parse_options(int argc, char** argv, Options& options) {
+        for (int arg_index = 1; arg_index < argc; ++arg_index) {
+            std::string arg = argv[arg_index];
+            size_t separator = arg.find('=');
+            if (arg.rfind("--", 0) != 0 || separator == std::string::npos) {
+                return false;
+            }
+
+            std::string name = arg.substr(2, separator - 2);
+            std::string text = arg.substr(separator + 1);
+            if (name == "trace") {
+                options.trace_path = text;
+                continue;
+            }
+
+            if (name == "map") {
+                options.map_path = text;
+                continue;
+            }
+
+            if (name == "export") {
+                options.export_name = text;
+                continue;
+            }
+
+            if (name == "checkpoint") {
+                options.checkpoint_path = text;
+                continue;
+            }
+
+            if (name == "restore") {
+                options.restore_path = text;
+                continue;
+            }
+
+            if (name == "behavior-rate") {
+                options.behavior_rate = text;
+                continue;
+            }
+
+            size_t value = 0;
+            try {
+                value = std::stoull(text);
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+
+            if (name == "width") {
+                options.width = value;
+            }
+            else if (name == "height") {
+                options.height = value;
+            }
+            else if (name == "robots") {
+                options.object_counts[static_cast<size_t>(ObjectType::robot)] = value;
+            }
+            else if (name == "rocks") {
+                options.object_counts[static_cast<size_t>(ObjectType::rock)] = value;
+            }
+            else if (name == "balls") {
+                options.object_counts[static_cast<size_t>(ObjectType::ball)] = value;
+            }
+            else if (name == "blocks") {
+                options.object_counts[static_cast<size_t>(ObjectType::block)] = value;
+            }
+            else if (name == "ticks") {
+                options.ticks = value;
+            }
+            else if (name == "threads") {
+                options.threads = value;
+            }
+            else if (name == "shard-columns") {
+                options.shard_columns = value;
+            }
+            else if (name == "shard-rows") {
+                options.shard_rows = value;
+            }
+            else if (name == "behavior") {
+                options.behavior = value != 0;
+            }
+            else if (name == "behavior-n") {
+                options.behavior_interval = value;
+            }
+            else if (name == "behavior-near") {
+                options.behavior_near_radius = value;
+            }
+            else if (name == "behavior-budget") {
+                options.behavior_budget_us = value;
+            }
+            else if (name == "scripts") {
+                options.scripts = value != 0;
+            }
+            else if (name == "spatial-sort") {
+                options.spatial_sort_interval = value;
+            }
+            else if (name == "render") {
+                options.render_fps = value;
+            }
+            else if (name == "viewport-x") {
+                options.viewport_x = value;
+            }
+            else if (name == "viewport-y") {
+                options.viewport_y = value;
+            }
+            else if (name == "viewport-width") {
+                options.viewport_width = value;
+            }
+            else if (name == "viewport-height") {
+                options.viewport_height = value;
+            }
+            else if (name == "stream-chunk") {
+                options.stream_chunk_size = value;
+            }
+            else if (name == "stream-radius") {
+                options.stream_radius = value;
+            }
+            else if (name == "checkpoint-ticks") {
+                options.checkpoint_interval = value;
+            }
+            else if (name == "report-interval") {
+                options.report_interval = value;
+            }
+            else if (name == "metrics-interval") {
+                options.metrics_interval = value;
+            }
+            else if (name == "seed") {
+                options.seed = static_cast<uint32_t>(value);
+            }
+            else {
+                return false;
+            }
+        }
+
+        bool sliced = options.behavior_rate == "slice" || options.behavior_rate == "lod";
+        bool valid_behavior_rate = sliced || options.behavior_rate == "tick" || options.behavior_rate == "nth";
+        if (!valid_behavior_rate || options.behavior_interval == 0 || options.behavior_interval > max_behavior_interval || (options.behavior_budget_us && !sliced)) {
+            return false;
+        }
+
+        bool sharded = options.shard_columns * options.shard_rows > 1;
+        bool unsharded_only = options.behavior || options.scripts || options.spatial_sort_interval || options.render_fps || options.stream_chunk_size || !options.export_name.empty() || options.checkpoint_interval || !options.restore_path.empty();
+        return options.width > 0 && options.height > 0 && !(sharded && unsharded_only) && !(options.stream_chunk_size && (options.checkpoint_interval || options.scripts)) &&
+               options.shard_columns > 0 && options.shard_columns <= options.width &&
+               options.shard_rows > 0 && options.shard_rows <= options.height;
+    }
+
+    UpdatePolicy get_behavior_policy(const Options& options) {
+        uint32_t interval = static_cast<uint32_t>(options.behavior_interval);
+        uint64_t budget_ns = options.behavior_budget_us * 1000;
+
+        UpdatePolicy policy;
+        if (options.behavior_rate == "nth") {
+            policy = UpdatePolicy::every_nth_tick(interval);
+        }
+        else if (options.behavior_rate == "slice") {
+            policy = UpdatePolicy::round_robin(interval, budget_ns);
+        }
+        else if (options.behavior_rate == "lod") {
+            policy = UpdatePolicy::distance_lod(static_cast<uint32_t>(options.behavior_near_radius), interval, budget_ns);
+        }
+
+        policy.max_interval = max_behavior_interval;
+        return policy;
+    }
+
+    // robots and balls get a body and wander around, rocks and blocks stay put;
+    // is_occupied(position) checks a tile and add_object(components...) places an object
+    template<typename IsOccupied, typename AddObject>
+    void populate(const Options& options, IsOccupied&& is_occupied, AddObject&& add_object) {
+        std::mt19937 random(options.seed);
+        std::uniform_int_distribution<int32_t> random_x(0, static_cast<int32_t>(options.width - 1));
+        std::uniform_int_distribution<int32_t> random_y(0, static_cast<int32_t>(options.height - 1));
+        std::uniform_int_distribution<int32_t> random_step(-1, 1);
+
+        static const char* names[] = { "rb", "rk", "bl", "bk" };
+        for (size_t object_type_index = 0; object_type_index < 4; ++object_type_index) {
+            auto object_type = static_cast<ObjectType>(object_type_index);
+            for (size_t object_index = 0; object_index < options.object_counts[object_type_index]; ++object_index) {
+                I32Vec3 position;
+                do {
+                    position = I32Vec3{random_x(random), random_y(random), 0};
+                } while (is_occupied(position));
+
+                Schema::Component<ComponentType::display> display;
+                display.name[0] = names[object_type_index][0];
+                display.name[1] = names[object_type_index][1];
+                display.color = static_cast<int>(object_type_index + 1);
+
+                if (object_type == ObjectType::robot || object_type == ObjectType::ball) {
+                    I32Vec3 velocity;
+                    do {
+                        velocity = I32Vec3{random_step(random), random_step(random), 0};
+                    } while (velocity == I32Vec3{});
+
+                    // robots start charged and drain a unit per tick
+                    Schema::Component<ComponentType::energy> energy;
+                    if (object_type == ObjectType::robot) {
+                        energy = {.value = 100, .capacity = 100, .recharge_rate = -1};
+                    }
+
+                    auto add_mobile_object = [&](auto... extra_components) {
+                        add_object(
+                            Schema::Component<ComponentType::object_type>{object_type},
+                            Schema::Component<ComponentType::position>{position},
+                            Schema::Component<ComponentType::body>{velocity, I32Vec3{}},
+                            display,
+                            energy,
+                            extra_components...
+                        );
+                    };
+
+                    if (object_type == ObjectType::robot && options.behavior) {
+                        add_mobile_object(Schema::Component<ComponentType::behavior>{BehaviorSystem::robot_tree_index, {}});
+                    }
+                    else {
+                        add_mobile_object();
+                    }
+                }
+                else {
+                    add_object(
+                        Schema::Component<ComponentType::object_type>{object_type},
+                        Schema::Component<ComponentType::position>{position},
+                        display
+                    );
+                }
+            }
+        }
+    }
+
+    struct TickSamples {
+        std::vector<double> latencies_ns;
+        size_t              updated_entity_count = 0;
+        double              elapsed_ns = 0;
+
+        void clear() {
+            latencies_ns.clear();
+            updated_entity_count = 0;
+            elapsed_ns = 0;
+        }
+    };
+
+    void report(const char* label, TickSamples& samples) {
+        if (samples.latencies_ns.empty()) {
+            return;
+        }
+
+        auto& latencies_ns = samples.latencies_ns;
+        std::sort(latencies_ns.begin(), latencies_ns.end());
+        auto percentile = [&](double fraction) {
+            size_t index = static_cast<size_t>(fraction * static_cast<double>(latencies_ns.size() - 1) + 0.5);
+            return latencies_ns[index];
+        };
+
+        double seconds = samples.elapsed_ns / 1e9;
+        std::printf(
+            "%s ticks/s=%.1f entities/s=%.0f p50=%.3fms p99=%.3fms max=%.3fms peak_rss=%.1fMiB\n",
+            label,
+            static_cast<double>(latencies_ns.size()) / seconds,
+            static_cast<double>(samples.updated_entity_count) / seconds,
+            percentile(0.50) / 1e6,
+            percentile(0.99) / 1e6,
+            latencies_ns.back() / 1e6,
+            static_cast<double>(get_peak_rss()) / (1024.0 * 1024.0)
+        );
+        std::fflush(stdout);
+    }
+
+    // objects without a body never move on their own, so they sleep until something writes to them
+    void sleep_idle_objects(EntityDatabase<Schema>& database) {
+        database.for_each_entity([&](Entity<Schema> entity) {
+            if (entity.has_component<ComponentType::object_type>() && !entity.has_component<ComponentType::body>()) {
+                database.sleep_entity(entity);
+            }
+        });
+    }
+
+    void start_robot_scripts(EntityDatabase<Schema>& database, ScriptSystem& scripts) {
+        database.for_each_entity(Schema::component_mask_v<ComponentType::object_type, ComponentType::body>, [&](Entity<Schema> entity) {
+            if (entity.get_component<ComponentType::object_type>().type == ObjectType::robot) {
+                scripts.start(entity, ScriptSystem::get_robot_script_access(), &ScriptSystem::robot_script);
+            }
+        });
+    }
+
+    // writes the populated map to options.map_path chunk by chunk, empties the simulation
+    // and hands the map to a MapStreamer that starts with every chunk on disk
+    bool start_streaming(const Options& options, Simulation& simulation, std::optional<MapStreamer>& streamer) {
+        auto& database = simulation.get_database();
+        auto& scene = simulation.get_scene();
+
+        MapFile file;
+        if (!file.create(options.map_path, options.width, options.height, options.stream_chunk_size, scene.get_depth())) {
+            return false;
+        }
+
+        for (size_t chunk_index = 0; chunk_index < file.get_chunk_count(); ++chunk_index) {
+            if (!file.write_chunk(chunk_index, MapStreamer::take_chunk(database, scene, file, chunk_index))) {
+                return false;
+            }
+        }
+
+        std::vector<Entity<Schema>> entities;
+        database.for_each_entity(SleepingEntities::include, [&](Entity<Schema> entity) {
+            entities.push_back(entity);
+        });
+        for (Entity<Schema> entity: entities) {
+            database.remove_entity(entity);
+        }
+        database.vacuum();
+
+        streamer.emplace(database, scene, std::move(file), options.stream_radius);
+        return true;
+    }
+
+    // ticks a Simulation or ShardedSimulation and reports throughput, latency and the final state hash;
+    // after_tick() runs outside of the measured tick time
+    template<typename AnySimulation, typename AfterTick>
+    void run(AnySimulation& simulation, const Options& options, AfterTick&& after_tick) {
+        TickSamples interval_samples;
+        TickSamples total_samples;
+        for (size_t tick = 0; tick < options.ticks; ++tick) {
+            auto start = std::chrono::steady_clock::now();
+            size_t updated_entity_count = simulation.tick();
+            auto stop = std::chrono::steady_clock::now();
+
+            double latency_ns = std::chrono::duration<double, std::nano>(stop - start).count();
+            for (TickSamples* samples: { &interval_samples, &total_samples }) {
+                samples->latencies_ns.push_back(latency_ns);
+                samples->updated_entity_count += updated_entity_count;
+                samples->elapsed_ns += latency_ns;
+            }
+
+            after_tick();
+
+            if (options.report_interval && (tick + 1) % options.report_interval == 0) {
+                std::string label = "tick " + std::to_string(tick + 1) + ":";
+                report(label.c_str(), interval_samples);
+                interval_samples.clear();
+            }
+
+            if (options.metrics_interval && (tick + 1) % options.metrics_interval == 0) {
+                std::printf("metrics at tick %zu:\n%s", tick + 1, simulation.get_metrics().snapshot().to_string().c_str());
+                std::fflush(stdout);
+            }
+        }
+
+        report("total:", total_samples);
+        std::printf("state_hash=%016llx\n", static_cast<unsigned long long>(simulation.compute_state_hash()));
+    }
+
+}
+
 int main(int argc, char** argv) {
-    Simulation simulation(10, 10);
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    size_t object_count = 0;
+    for (size_t count: options.object_counts) {
+        object_count += count;
+    }
+    if (object_count > options.width * options.height) {
+        std::cerr << "map is too small for " << object_count << " objects" << std::endl;
+        return 1;
+    }
+
+    if (options.shard_columns * options.shard_rows > 1) {
+        ShardedSimulation simulation(options.width, options.height, options.shard_columns, options.shard_rows, options.threads);
+        populate(options, [&](I32Vec3 position) {
+            return simulation.get_object(position).has_value();
+        }, [&](auto... components) {
+            simulation.add_object(components...);
+        });
+
+        run(simulation, options, [] {});
+    }
+    else {
+        Simulation simulation(options.width, options.height, options.threads);
+        simulation.set_spatial_sort_interval(options.spatial_sort_interval);
+        if (options.behavior) {
+            simulation.add_system(std::make_unique<BehaviorSystem>(), get_behavior_policy(options));
+        }
+        simulation.add_system(std::make_unique<MovementSystem>());
+        ScriptSystem* scripts = nullptr;
+        if (options.scripts) {
+            auto script_system = std::make_unique<ScriptSystem>(simulation.get_database());
+            scripts = script_system.get();
+            simulation.add_system(std::move(script_system));
+        }
+        simulation.add_system(std::make_unique<EnergySystem>());
+
+        size_t tick = 0;
+        if (!options.restore_path.empty()) {
+            uint64_t restored_tick = 0;
+            if (!Checkpointer::restore(options.restore_path, simulation.get_database(), simulation.get_scene(), restored_tick)) {
+                std::cerr << "failed to restore " << options.restore_path << std::endl;
+                return 1;
+            }
+
+            tick = static_cast<size_t>(restored_tick);
+            simulation.set_tick_count(restored_tick);
+            std::printf("restored %zu entities at tick %zu\n", simulation.get_database().get_live_entity_count(), tick);
+        }
+        else {
+            populate(options, [&](I32Vec3 position) {
+                return simulation.get_scene().get_object(position).has_value();
+            }, [&](auto... components) {
+                simulation.get_scene().add_object(simulation.get_database().add_entity(components...));
+            });
+        }
+        sleep_idle_objects(simulation.get_database());
+        // a restored world may hold more entities than the options place; streaming takes them out again
+        size_t entity_count = simulation.get_database().get_live_entity_count();
+        if (scripts) {
+            start_robot_scripts(simulation.get_database(), *scripts);
+            simulation.get_metrics().add_collector([&](MetricsSnapshot& snapshot) {
+                scripts->collect_metrics(snapshot, "scripts.");
+            });
+        }
+
+        std::optional<MapStreamer> streamer;
+        if (options.stream_chunk_size) {
+            if (!start_streaming(options, simulation, streamer)) {
+                std::cerr << "failed to write " << options.map_path << std::endl;
+                return 1;
+            }
+
+            simulation.get_metrics().add_collector([&](MetricsSnapshot& snapshot) {
+                streamer->collect_metrics(snapshot, "streamer.");
+            });
+        }
+
+        std::optional<TerminalRenderer> renderer;
+        if (options.render_fps) {
+            renderer.emplace(simulation.get_database(), simulation.get_scene(), stdout, static_cast<double>(options.render_fps));
+            renderer->set_viewport(I32Vec3{static_cast<int32_t>(options.viewport_x), static_cast<int32_t>(options.viewport_y), 0}, options.viewport_width, options.viewport_height);
+        }
+
+        std::optional<WorldExporter> exporter;
+        if (!options.export_name.empty()) {
+            exporter.emplace(simulation.get_database(), simulation.get_scene());
+            if (!exporter->create(options.export_name, { ComponentType::object_type, ComponentType::position, ComponentType::display }, entity_count)) {
+                std::cerr << "failed to create shared memory segment " << options.export_name << std::endl;
+                return 1;
+            }
+
+            simulation.get_metrics().add_collector([&](MetricsSnapshot& snapshot) {
+                exporter->collect_metrics(snapshot, "export.");
+            });
+        }
+
+        std::optional<Checkpointer> checkpointer;
+        if (options.checkpoint_interval) {
+            checkpointer.emplace(simulation.get_database(), simulation.get_scene());
+            simulation.get_metrics().add_collector([&](MetricsSnapshot& snapshot) {
+                checkpointer->collect_metrics(snapshot, "checkpoint.");
+            });
+        }
+
+        size_t first_tick = tick;
+        bool checkpoint_due = false;
+        run(simulation, options, [&] {
+            tick += 1;
+            if (streamer) {
+                // the area of interest sweeps along the middle row; everything comes back in
+                // for the last tick so the state hash covers the whole map
+                I32Vec3 area_of_interest{static_cast<int32_t>(tick % options.width), static_cast<int32_t>(options.height / 2), 0};
+                simulation.get_scene().set_area_of_interest(area_of_interest);
+                streamer->update({ area_of_interest });
+                if (tick - first_tick == options.ticks) {
+                    streamer->load_all();
+                }
+            }
+
+            if (exporter) {
+                exporter->publish(tick);
+            }
+
+            // a checkpoint that is still being written when the next one is due delays that one
+            if (checkpointer) {
+                checkpointer->update();
+                if (tick % options.checkpoint_interval == 0 || checkpoint_due) {
+                    checkpoint_due = !checkpointer->start(options.checkpoint_path, tick);
+                }
+            }
+
+            if (renderer) {
+                renderer->render();
+            }
+        });
+
+        if (renderer) {
+            renderer->render(TerminalRenderer::Clock::time_point::max());
+            std::printf("rendered %llu frames, %llu cells, %llu bytes\n",
+                static_cast<unsigned long long>(renderer->get_frame_count()),
+                static_cast<unsigned long long>(renderer->get_drawn_cell_count()),
+                static_cast<unsigned long long>(renderer->get_written_byte_count()));
+        }
+
+        if (streamer) {
+            streamer->unload_all();
+        }
+    }
+
+    if (!options.trace_path.empty()) {
+#if ENTLER_PROFILING
+        std::ofstream stream(options.trace_path);
+        if (!stream) {
+            std::cerr << "failed to open " << options.trace_path << std::endl;
+            return 1;
+        }
+
+        Profiler::get_instance().write_chrome_trace(stream);
+#else
+        std::cerr << "--trace ignored: built without ENTLER_PROFILING" << std::endl;
+#endif
+    }
 
     return 0;
 }
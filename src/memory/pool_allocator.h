@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+namespace entler {
+
+    // Hands out blocks of up to max_block_size bytes from one free list per
+    // power of two size class. Blocks are carved from page_size pages that
+    // stay with the pool until it is destroyed, so once the pool grew to the
+    // peak number of live blocks, allocating is popping a free list. Larger
+    // requests go to operator new. Blocks are aligned to
+    // __STDCPP_DEFAULT_NEW_ALIGNMENT__, like operator new.
+    //
+    // Any thread may allocate and free; a mutex keeps the lists consistent.
+    class PoolAllocator {
+    public:
+        static constexpr size_t min_block_size = 64;
+        static constexpr size_t max_block_size = 4096;
+        static constexpr size_t page_size = 64 * 1024;
+
+        PoolAllocator() = default;
+        PoolAllocator(PoolAllocator&&) = delete;
+        PoolAllocator(const PoolAllocator&) = delete;
+        PoolAllocator& operator=(PoolAllocator&&) = delete;
+        PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+        void* allocate(size_t size) {
+            if (size > max_block_size) {
+                return ::operator new(size);
+            }
+
+            size_t size_class = get_size_class(size);
+
+            std::lock_guard lock(mutex_);
+            FreeBlock*& free_list = free_lists_[size_class];
+            if (!free_list) {
+                add_page(size_class);
+            }
+
+            FreeBlock* block = free_list;
+            free_list = block->next;
+            allocated_count_ += 1;
+            return block;
+        }
+
+        // size must be the size the block was allocated with
+        void free(void* block, size_t size) {
+            if (size > max_block_size) {
+                ::operator delete(block);
+                return;
+            }
+
+            size_t size_class = get_size_class(size);
+
+            std::lock_guard lock(mutex_);
+            assert(allocated_count_ > 0);
+            FreeBlock* free_block = static_cast<FreeBlock*>(block);
+            free_block->next = free_lists_[size_class];
+            free_lists_[size_class] = free_block;
+            allocated_count_ -= 1;
+        }
+
+        // blocks handed out and not yet freed, not counting requests above max_block_size
+        size_t get_allocated_count() const {
+            std::lock_guard lock(mutex_);
+            return allocated_count_;
+        }
+
+        size_t get_page_count() const {
+            std::lock_guard lock(mutex_);
+            return pages_.size();
+        }
+
+    private:
+        static constexpr size_t size_class_count = std::countr_zero(max_block_size) - std::countr_zero(min_block_size) + 1;
+
+        static_assert(std::has_single_bit(min_block_size) && std::has_single_bit(max_block_size), "Block sizes are powers of two");
+        static_assert(min_block_size % __STDCPP_DEFAULT_NEW_ALIGNMENT__ == 0, "Blocks keep the alignment of their page");
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        static size_t get_size_class(size_t size) {
+            size_t block_size = std::bit_ceil(std::max(size, min_block_size));
+            return static_cast<size_t>(std::countr_zero(block_size) - std::countr_zero(min_block_size));
+        }
+
+        // threads the blocks of a new page onto the free list of size_class, lowest address first
+        void add_page(size_t size_class) {
+            size_t block_size = min_block_size << size_class;
+            pages_.push_back(std::make_unique<std::byte[]>(page_size));
+            std::byte* page = pages_.back().get();
+
+            FreeBlock* next = free_lists_[size_class];
+            for (size_t offset = page_size; offset >= block_size; offset -= block_size) {
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(page + offset - block_size);
+                block->next = next;
+                next = block;
+            }
+
+            free_lists_[size_class] = next;
+        }
+
+    private:
+        mutable std::mutex                        mutex_;
+        FreeBlock*                                free_lists_[size_class_count] = {};
+        std::vector<std::unique_ptr<std::byte[]>> pages_;
+        size_t                                    allocated_count_ = 0;
+    };
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <utility>
+#include "simulation.h"
+#include "system.h"
+
+namespace entler {
+
+    // Moves attached objects along with their parents. Relationships are
+    // visited depth first, so a chain of attachments settles in one pass.
+    class AttachmentSystem : public System {
+    public:
+        const char* get_name() const override {
+            return "AttachmentSystem";
+        }
+
+        size_t update(Simulation& simulation) override {
+            auto& database = simulation.get_database();
+
+            size_t updated_entity_count = 0;
+            database.for_each_relationship([&](Entity<Schema> parent, Entity<Schema> child) {
+                if (!child.has_component<ComponentType::attachment>() || !parent.has_component<ComponentType::position>()) {
+                    return;
+                }
+
+                auto& parent_position = std::as_const(parent).get_component<ComponentType::position>();
+                auto& attachment = std::as_const(child).get_component<ComponentType::attachment>();
+                auto& position = child.get_component<ComponentType::position>();
+                position.value = parent_position.value + attachment.offset;
+                updated_entity_count += 1;
+            });
+
+            return updated_entity_count;
+        }
+    };
+
+}
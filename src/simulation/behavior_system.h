@@ -0,0 +1,165 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <cassert>
+#include "behavior/behavior_tree.h"
+#include "simulation.h"
+#include "system.h"
+
+namespace entler {
+
+    // what behavior tree actions get to work with
+    struct BehaviorContext {
+        Entity<Schema> entity;
+        Scene&         scene;
+    };
+
+    // Evaluates the behavior tree of every entity with a behavior component.
+    // Each job splits its range of the entity table into one batch per tree
+    // and evaluates the batches one after the other, so a tree's nodes and
+    // actions stay hot while its instances are visited in table order.
+    // Actions may only write the components of their own entity; they run
+    // in parallel against the scene as it was at the start of the system.
+    // Entities left out by the update policy keep their tree state and pick
+    // up where they were on their next update.
+    class BehaviorSystem : public System {
+    public:
+        using Tree = BehaviorTree<BehaviorContext>;
+
+        static constexpr uint16_t robot_tree_index = 0;
+
+        BehaviorSystem() {
+            add_tree(make_robot_tree());
+        }
+
+        // returns the index to put in behavior components
+        uint16_t add_tree(Tree tree) {
+            trees_.push_back(std::move(tree));
+            return static_cast<uint16_t>(trees_.size() - 1);
+        }
+
+        const char* get_name() const override {
+            return "BehaviorSystem";
+        }
+
+        bool can_update_slices() const override {
+            return true;
+        }
+
+        size_t update(Simulation& simulation) override {
+            auto& database = simulation.get_database();
+            auto& scene = simulation.get_scene();
+            auto& job_system = simulation.get_job_system();
+            UpdateFilter update_filter = simulation.get_update_filter();
+
+            thread_batches_.resize(job_system.thread_count());
+            thread_updated_entity_counts_.assign(job_system.thread_count(), 0);
+
+            constexpr auto component_mask = Schema::component_mask_v<ComponentType::behavior>;
+
+            job_system.parallel_for(database.get_entity_table_size(), grain_size, [&](size_t first, size_t last, size_t thread_index) {
+                auto& batches = thread_batches_[thread_index];
+                batches.resize(trees_.size());
+
+                database.for_each_entity(first, last, component_mask, [&](Entity<Schema> entity) {
+                    if (!update_filter.includes(entity)) {
+                        return;
+                    }
+
+                    uint16_t tree_index = std::as_const(entity).get_component<ComponentType::behavior>().tree_index;
+                    assert(tree_index < trees_.size());
+                    batches[tree_index].push_back(entity.get_index());
+                });
+
+                size_t updated_entity_count = 0;
+                for (size_t tree_index = 0; tree_index < trees_.size(); ++tree_index) {
+                    const Tree& tree = trees_[tree_index];
+                    for (size_t entity_index: batches[tree_index]) {
+                        BehaviorContext context { database.get_entity(entity_index), scene };
+                        auto& behavior = context.entity.get_component<ComponentType::behavior>();
+                        tree.evaluate(context, behavior.state);
+                    }
+
+                    updated_entity_count += batches[tree_index].size();
+                    batches[tree_index].clear();
+                }
+
+                thread_updated_entity_counts_[thread_index] += updated_entity_count;
+            });
+
+            size_t updated_entity_count = 0;
+            for (size_t count: thread_updated_entity_counts_) {
+                updated_entity_count += count;
+            }
+
+            return updated_entity_count;
+        }
+
+        // Robots that stand still wait a few ticks and then pick a direction;
+        // moving robots turn right when the tile ahead is taken or off the map.
+        // Needs position and body components.
+        static Tree make_robot_tree() {
+            return Tree(Tree::selector({
+                Tree::sequence({
+                    Tree::action(is_idle),
+                    Tree::action(wait),
+                    Tree::action(start_moving),
+                }),
+                Tree::sequence({
+                    Tree::action(is_path_blocked),
+                    Tree::action(turn_right),
+                }),
+                Tree::action(keep_moving),
+            }));
+        }
+
+    private:
+        static constexpr size_t   grain_size = 4096;
+        static constexpr uint32_t idle_ticks = 3;
+
+        static BehaviorStatus is_idle(BehaviorContext& context, uint32_t) {
+            auto& body = std::as_const(context.entity).get_component<ComponentType::body>();
+            return body.velocity == I32Vec3{} ? BehaviorStatus::success : BehaviorStatus::failure;
+        }
+
+        static BehaviorStatus wait(BehaviorContext&, uint32_t running_ticks) {
+            return running_ticks < idle_ticks ? BehaviorStatus::running : BehaviorStatus::success;
+        }
+
+        // the direction only depends on the position so the choice is deterministic
+        static BehaviorStatus start_moving(BehaviorContext& context, uint32_t) {
+            static const I32Vec3 directions[] = { {1, 0, 0}, {0, 1, 0}, {-1, 0, 0}, {0, -1, 0} };
+
+            auto& position = std::as_const(context.entity).get_component<ComponentType::position>();
+            auto& body = context.entity.get_component<ComponentType::body>();
+            body.velocity = directions[static_cast<uint32_t>(position.value.x + position.value.y) % 4];
+            return BehaviorStatus::success;
+        }
+
+        static BehaviorStatus is_path_blocked(BehaviorContext& context, uint32_t) {
+            auto& position = std::as_const(context.entity).get_component<ComponentType::position>();
+            auto& body = std::as_const(context.entity).get_component<ComponentType::body>();
+
+            I32Vec3 target = position.value + body.velocity;
+            bool blocked = !context.scene.contains(target) || !context.scene.is_loaded(target) || context.scene.get_object(target);
+            return blocked ? BehaviorStatus::success : BehaviorStatus::failure;
+        }
+
+        static BehaviorStatus turn_right(BehaviorContext& context, uint32_t) {
+            auto& body = context.entity.get_component<ComponentType::body>();
+            body.velocity = I32Vec3{-body.velocity.y, body.velocity.x, body.velocity.z};
+            return BehaviorStatus::success;
+        }
+
+        static BehaviorStatus keep_moving(BehaviorContext&, uint32_t) {
+            return BehaviorStatus::success;
+        }
+
+    private:
+        std::vector<Tree>                             trees_;
+        std::vector<std::vector<std::vector<size_t>>> thread_batches_;
+        std::vector<size_t>                           thread_updated_entity_counts_;
+    };
+
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <cstdio>
+#include <cstdint>
+#include "entity/entity_database.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
+#include "schema.h"
+#include "scene.h"
+
+namespace entler {
+
+    // Writes checkpoints of a simulation's database and scene to disk on a
+    // background thread while the simulation keeps ticking; see EntityCheckpoint
+    // for how the state at the start of a checkpoint is kept. A checkpoint goes
+    // to path + ".tmp" and replaces path once it is complete, so path always
+    // holds the last complete one.
+    //
+    // The file holds the tick and the bounds of the scene, followed by the
+    // database tables. The scene itself is derived from the entities: restore
+    // puts entities with a property_type on their tile as properties, and the
+    // remaining ones with an object_type and no attachment as objects, which is
+    // how the simulation places them.
+    class Checkpointer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        Checkpointer(EntityDatabase<Schema>& database, Scene& scene)
+            : database_(database)
+            , scene_(scene)
+        {
+        }
+
+        Checkpointer(Checkpointer&&) = delete;
+        Checkpointer(const Checkpointer&) = delete;
+        Checkpointer& operator=(Checkpointer&&) = delete;
+        Checkpointer& operator=(const Checkpointer&) = delete;
+
+        ~Checkpointer() {
+            wait();
+        }
+
+        // captures the world as it is now and starts writing it to path; fails while the
+        // previous checkpoint is still being written. Call between ticks.
+        bool start(const std::string& path, uint64_t tick) {
+            ENTLER_PROFILE_ZONE("Checkpointer::start");
+
+            if (checkpoint_) {
+                return false;
+            }
+
+            auto start = Clock::now();
+
+            Header header {
+                .magic = magic,
+                .version = version,
+                .tick = tick,
+                .origin = { scene_.get_origin().x, scene_.get_origin().y, scene_.get_origin().z },
+                .width = scene_.get_width(),
+                .height = scene_.get_height(),
+                .depth = scene_.get_depth(),
+            };
+
+            checkpoint_ = std::make_unique<EntityCheckpoint<Schema>>(database_);
+            written_.store(false, std::memory_order_relaxed);
+            writer_thread_ = std::thread([this, path, header]() {
+                run_writer_thread(path, header);
+            });
+
+            last_capture_ns_ = get_elapsed_ns(start);
+            started_count_ += 1;
+            return true;
+        }
+
+        // finishes the checkpoint once it is written; call between ticks
+        void update() {
+            if (checkpoint_ && written_.load(std::memory_order_acquire)) {
+                finish();
+            }
+        }
+
+        // blocks until the running checkpoint is written
+        void wait() {
+            if (checkpoint_) {
+                finish();
+            }
+        }
+
+        bool is_running() const {
+            return checkpoint_ != nullptr;
+        }
+
+        // call from the thread that calls start
+        void collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const {
+            std::string name(prefix);
+            auto add = [&](std::string_view suffix, auto value) {
+                snapshot.add(name + std::string(suffix), static_cast<int64_t>(value));
+            };
+
+            add("running", is_running());
+            add("started", started_count_);
+            add("completed", completed_count_);
+            add("failed", failed_count_);
+            add("capture.last_ns", last_capture_ns_);
+            add("write.last_ns", last_write_ns_);
+            add("written_bytes", written_byte_count_);
+            add("preserved_chunks", preserved_chunk_count_ + (checkpoint_ ? checkpoint_->get_preserved_chunk_count() : 0));
+        }
+
+        // adds the entities of the checkpoint at path to database and places them in scene, which
+        // must have the bounds the checkpoint was taken with; tick is set to the tick it was taken
+        // at. On failure, database and scene may hold part of the checkpoint.
+        static bool restore(const std::string& path, EntityDatabase<Schema>& database, Scene& scene, uint64_t& tick) {
+            ENTLER_PROFILE_ZONE("Checkpointer::restore");
+
+            FILE* file = std::fopen(path.c_str(), "rb");
+            if (!file) {
+                return false;
+            }
+
+            Header header;
+            size_t first_entity_index = database.get_entity_table_size();
+            bool loaded = std::fread(&header, sizeof(header), 1, file) == 1 &&
+                          header.magic == magic && header.version == version &&
+                          header.origin[0] == scene.get_origin().x && header.origin[1] == scene.get_origin().y && header.origin[2] == scene.get_origin().z &&
+                          header.width == scene.get_width() && header.height == scene.get_height() && header.depth == scene.get_depth() &&
+                          EntityCheckpoint<Schema>::load(file, database);
+            std::fclose(file);
+
+            if (!loaded) {
+                return false;
+            }
+
+            for (size_t entity_index = first_entity_index; entity_index < database.get_entity_table_size(); ++entity_index) {
+                Entity<Schema> entity = database.get_entity(entity_index);
+                if (!entity.has_component<ComponentType::position>() || !entity.has_component<ComponentType::object_type>()) {
+                    continue;
+                }
+
+                I32Vec3 position = std::as_const(entity).get_component<ComponentType::position>().value;
+                if (!scene.contains(position)) {
+                    return false;
+                }
+
+                if (entity.has_component<ComponentType::property_type>()) {
+                    scene.add_property(entity);
+                }
+                else if (!entity.has_component<ComponentType::attachment>()) {
+                    if (scene.get_object(position)) {
+                        return false;
+                    }
+
+                    scene.add_object(entity);
+                }
+            }
+
+            tick = header.tick;
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t magic = 0x4b484345;   // "ECHK"
+        static constexpr uint32_t version = 2;
+
+        struct Header {
+            uint32_t magic = 0;
+            uint32_t version = 0;
+            uint64_t tick = 0;
+            int32_t  origin[3] = {};
+            uint32_t padding = 0;
+            uint64_t width = 0;
+            uint64_t height = 0;
+            uint64_t depth = 0;
+        };
+
+        static uint64_t get_elapsed_ns(Clock::time_point start) {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        }
+
+        void run_writer_thread(const std::string& path, const Header& header) {
+            auto start = Clock::now();
+
+            std::string temporary_path = path + ".tmp";
+            FILE* file = std::fopen(temporary_path.c_str(), "wb");
+            bool written = file != nullptr;
+            if (file) {
+                std::setvbuf(file, nullptr, _IOFBF, write_buffer_size);
+                written = std::fwrite(&header, sizeof(header), 1, file) == 1 && checkpoint_->write(file);
+                written = std::fclose(file) == 0 && written;
+            }
+
+            std::error_code error;
+            if (written) {
+                std::filesystem::rename(temporary_path, path, error);
+            }
+            if (!written || error) {
+                std::filesystem::remove(temporary_path, error);
+                written = false;
+            }
+
+            succeeded_ = written;
+            write_ns_ = get_elapsed_ns(start);
+            written_.store(true, std::memory_order_release);
+        }
+
+        void finish() {
+            writer_thread_.join();
+
+            completed_count_ += succeeded_;
+            failed_count_ += !succeeded_;
+            written_byte_count_ += succeeded_ ? sizeof(Header) + checkpoint_->get_byte_count() : 0;
+            preserved_chunk_count_ += checkpoint_->get_preserved_chunk_count();
+            last_write_ns_ = write_ns_;
+
+            checkpoint_.reset();
+        }
+
+    private:
+        static constexpr size_t write_buffer_size = 1 << 20;
+
+        EntityDatabase<Schema>&                   database_;
+        Scene&                                    scene_;
+        std::unique_ptr<EntityCheckpoint<Schema>> checkpoint_;   // being written
+
+        std::thread                               writer_thread_;
+        std::atomic<bool>                         written_{false};
+        bool                                      succeeded_ = false;   // set by the writer thread before written_
+        uint64_t                                  write_ns_ = 0;        // set by the writer thread before written_
+
+        // tick thread statistics
+        uint64_t                                  started_count_ = 0;
+        uint64_t                                  completed_count_ = 0;
+        uint64_t                                  failed_count_ = 0;
+        uint64_t                                  last_capture_ns_ = 0;
+        uint64_t                                  last_write_ns_ = 0;
+        uint64_t                                  written_byte_count_ = 0;
+        uint64_t                                  preserved_chunk_count_ = 0;
+    };
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "behavior/behavior_tree.h"
 #include "entity/entity_schema.h"
 #include "util/math.h"
 
@@ -26,8 +27,32 @@ namespace entler {
         body,
         display,
         energy,
+        behavior,
+        attachment,
+        in_lava,
+        selected,
+        dead,
     };
 
+    inline const char* to_string(ComponentType component_type) {
+        switch (component_type) {
+            case ComponentType::object_type:   return "object_type";
+            case ComponentType::property_type: return "property_type";
+            case ComponentType::position:      return "position";
+            case ComponentType::rotation:      return "rotation";
+            case ComponentType::body:          return "body";
+            case ComponentType::display:       return "display";
+            case ComponentType::energy:        return "energy";
+            case ComponentType::behavior:      return "behavior";
+            case ComponentType::attachment:    return "attachment";
+            case ComponentType::in_lava:       return "in_lava";
+            case ComponentType::selected:      return "selected";
+            case ComponentType::dead:          return "dead";
+        }
+
+        return "unknown";
+    }
+
     template<>
     class Component<ComponentType, ComponentType::object_type> {
     public:
@@ -40,9 +65,12 @@ namespace entler {
         PropertyType type;
     };
 
+    // double buffered so neighbours can be read while movement writes
     template<>
     class Component<ComponentType, ComponentType::position> {
     public:
+        static constexpr ComponentStorage storage = ComponentStorage::double_buffered;
+
         I32Vec3 value;
     };
 
@@ -68,9 +96,40 @@ namespace entler {
 
     template<>
     class Component<ComponentType, ComponentType::energy> {
+    public:
         int value = 0;
         int capacity = 0;
         int recharge_rate = 0;
     };
 
+    // an instance of one of the trees registered with the BehaviorSystem
+    template<>
+    class Component<ComponentType, ComponentType::behavior> {
+    public:
+        uint16_t      tree_index = 0;
+        BehaviorState state;
+    };
+
+    // an object carried by its parent entity, e.g. a block held by a robot; its position
+    // follows the parent's (see AttachmentSystem) and it is not placed in the scene
+    template<>
+    class Component<ComponentType, ComponentType::attachment> {
+    public:
+        I32Vec3 offset;
+    };
+
+    // tags; they carry no data and only take a bit in the component mask
+
+    template<>
+    class Component<ComponentType, ComponentType::in_lava> {
+    };
+
+    template<>
+    class Component<ComponentType, ComponentType::selected> {
+    };
+
+    template<>
+    class Component<ComponentType, ComponentType::dead> {
+    };
+
 }
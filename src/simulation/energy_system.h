@@ -0,0 +1,156 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "events.h"
+#include "simulation.h"
+#include "system.h"
+
+namespace entler {
+
+    // Recharges (or drains, for negative rates) every energy component by its
+    // recharge_rate once per tick, saturating at 0 and at the capacity. The
+    // energy table is swept as a whole instead of entity by entity, and the
+    // components that became empty or full are reported as EnergyEvents after
+    // the sweep; indexes on energy see every swept component as changed.
+    // Values are whole energy units; value + recharge_rate must fit in an int.
+    class EnergySystem : public System {
+    public:
+        using EnergyComponent = Schema::Component<ComponentType::energy>;
+
+        static_assert(sizeof(EnergyComponent) == 3 * sizeof(int), "The SIMD path expects value, capacity and recharge_rate packed");
+
+        const char* get_name() const override {
+            return "EnergySystem";
+        }
+
+        size_t update(Simulation& simulation) override {
+            auto& database = simulation.get_database();
+            auto& job_system = simulation.get_job_system();
+            auto& events = simulation.get_event_channel<EnergyEvent>();
+
+            database.track_component_owners<ComponentType::energy>();
+
+            size_t slot_count = database.get_component_table<ComponentType::energy>().size();
+            job_system.parallel_for(slot_count, grain_size, [&](size_t first, size_t last, size_t) {
+                update_slots(database, first, last, events);
+            });
+
+            return slot_count;
+        }
+
+        // One tick for the slots [first, last) of the energy table of database, e.g. for
+        // simulations that sweep their databases themselves; needs track_component_owners
+        // on energy. Slots of removed components are swept too, but have no owner to report.
+        static void update_slots(EntityDatabase<Schema>& database, size_t first, size_t last, EventChannel<EnergyEvent>& events) {
+            auto& energy_table = database.get_component_table<ComponentType::energy>();
+            const std::vector<size_t>& owners = database.get_component_owners<ComponentType::energy>();
+
+            database.prepare_component_writes<ComponentType::energy>(first, last);
+            update_simd(energy_table.data() + first, last - first, [&](size_t component_index, EnergyTransition transition) {
+                size_t entity_index = owners[first + component_index];
+                if (entity_index != EntityDatabase<Schema>::no_entity_index) {
+                    events.emit(EnergyEvent{entity_index, transition});
+                }
+            });
+            database.mark_components_changed<ComponentType::energy>(first, last);
+        }
+
+        // one tick for count components; calls transition(component index, EnergyTransition)
+        // in component order for every component that became empty or full
+        template<typename F>
+        static void update_scalar(EnergyComponent* components, size_t count, F&& transition) {
+            for (size_t component_index = 0; component_index < count; ++component_index) {
+                update_component(components[component_index], component_index, transition);
+            }
+        }
+
+        // same results and transitions as update_scalar, four components at a time
+        template<typename F>
+        static void update_simd(EnergyComponent* components, size_t count, F&& transition) {
+            size_t component_index = 0;
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            for (; component_index + 4 <= count; component_index += 4) {
+                // four packed components are three vectors: [v0 c0 r0 v1] [c1 r1 v2 c2] [r2 v3 c3 r3]
+                const __m128i* packed = reinterpret_cast<const __m128i*>(components + component_index);
+                __m128 a = _mm_castsi128_ps(_mm_loadu_si128(packed + 0));
+                __m128 b = _mm_castsi128_ps(_mm_loadu_si128(packed + 1));
+                __m128 c = _mm_castsi128_ps(_mm_loadu_si128(packed + 2));
+
+                // gather each field into its own vector
+                __m128 value_23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 1, 0, 2));
+                __m128i value = _mm_castps_si128(_mm_shuffle_ps(a, value_23, _MM_SHUFFLE(2, 0, 3, 0)));
+
+                __m128 capacity_01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 1));
+                __m128 capacity_23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 2, 0, 3));
+                __m128i capacity = _mm_castps_si128(_mm_shuffle_ps(capacity_01, capacity_23, _MM_SHUFFLE(2, 0, 2, 0)));
+
+                __m128 rate_01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 1, 0, 2));
+                __m128 rate_23 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 3, 0, 0));
+                __m128i rate = _mm_castps_si128(_mm_shuffle_ps(rate_01, rate_23, _MM_SHUFFLE(2, 0, 2, 0)));
+
+                // clamp to [0, capacity] the way update_component does; SSE2 has no 32 bit min and max
+                __m128i new_value = _mm_add_epi32(value, rate);
+                new_value = _mm_and_si128(new_value, _mm_cmpgt_epi32(new_value, zero));
+                __m128i above_capacity = _mm_cmpgt_epi32(new_value, capacity);
+                new_value = _mm_or_si128(_mm_and_si128(above_capacity, capacity), _mm_andnot_si128(above_capacity, new_value));
+
+                alignas(16) int new_values[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(new_values), new_value);
+                components[component_index + 0].value = new_values[0];
+                components[component_index + 1].value = new_values[1];
+                components[component_index + 2].value = new_values[2];
+                components[component_index + 3].value = new_values[3];
+
+                __m128i depleted = _mm_and_si128(_mm_cmpgt_epi32(value, zero), _mm_cmpeq_epi32(new_value, zero));
+                __m128i full = _mm_and_si128(_mm_cmplt_epi32(value, capacity), _mm_cmpeq_epi32(new_value, capacity));
+                int depleted_bits = _mm_movemask_ps(_mm_castsi128_ps(depleted));
+                int full_bits = _mm_movemask_ps(_mm_castsi128_ps(full));
+                if ((depleted_bits | full_bits) == 0) {
+                    continue;
+                }
+
+                // a component can not become empty and full at once
+                for (size_t lane = 0; lane < 4; ++lane) {
+                    if (depleted_bits & (1 << lane)) {
+                        transition(component_index + lane, EnergyTransition::depleted);
+                    }
+                    else if (full_bits & (1 << lane)) {
+                        transition(component_index + lane, EnergyTransition::full);
+                    }
+                }
+            }
+#endif
+
+            for (; component_index < count; ++component_index) {
+                update_component(components[component_index], component_index, transition);
+            }
+        }
+
+    private:
+        static constexpr size_t grain_size = 16384;
+
+        template<typename F>
+        static void update_component(EnergyComponent& energy, size_t component_index, F& transition) {
+            int value = energy.value + energy.recharge_rate;
+            value = value > 0 ? value : 0;
+            value = value > energy.capacity ? energy.capacity : value;
+
+            if (energy.value > 0 && value == 0) {
+                transition(component_index, EnergyTransition::depleted);
+            }
+            else if (energy.value < energy.capacity && value == energy.capacity) {
+                transition(component_index, EnergyTransition::full);
+            }
+
+            energy.value = value;
+        }
+    };
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "util/math.h"
+
+namespace entler {
+
+    // Events systems emit through Simulation::get_event_channel. Entity
+    // indexes stay valid for the rest of the tick the event was emitted in.
+
+    // an object could not move onto target because the tile was taken, claimed by another object or off the map
+    struct CollisionEvent {
+        size_t  entity_index;
+        I32Vec3 target;
+    };
+
+    enum class EnergyTransition : uint8_t {
+        depleted,   // the value dropped to 0
+        full,       // the value reached the capacity
+    };
+
+    // emitted by the EnergySystem in the tick the transition happened
+    struct EnergyEvent {
+        size_t           entity_index;
+        EnergyTransition transition;
+    };
+
+}
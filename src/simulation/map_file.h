@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include "entity/entity_database.h"
+#include "util/profiler.h"
+#include "schema.h"
+
+namespace entler {
+
+    // the entities on the tiles of one chunk, split by how the scene holds them
+    struct MapChunk {
+        std::vector<EntitySnapshot<Schema>> objects;
+        std::vector<EntitySnapshot<Schema>> properties;
+
+        size_t size() const {
+            return objects.size() + properties.size();
+        }
+
+        void clear() {
+            objects.clear();
+            properties.clear();
+        }
+    };
+
+    // A map stored as a grid of square chunks of chunk_size x chunk_size tiles,
+    // each a column through every level of the map, that can be read and
+    // rewritten one at a time. The file starts with a
+    // header, the size of every component type (so a file written with another
+    // schema is rejected) and an index with the offset, size and capacity of
+    // every chunk's payload. A payload holds the object and property counts,
+    // the component mask of every entity and then one packed column per
+    // component type with the values of the entities that have one, in entity
+    // order; tags only take their bit in the mask. A chunk that outgrows its
+    // slot is rewritten at the end of the file. Values are stored in the
+    // native byte order.
+    class MapFile {
+    public:
+        MapFile() = default;
+
+        MapFile(MapFile&& other) noexcept {
+            *this = std::move(other);
+        }
+
+        MapFile& operator=(MapFile&& other) noexcept {
+            std::swap(file_, other.file_);
+            std::swap(header_, other.header_);
+            std::swap(chunk_columns_, other.chunk_columns_);
+            std::swap(chunk_rows_, other.chunk_rows_);
+            std::swap(chunk_records_, other.chunk_records_);
+            std::swap(file_size_, other.file_size_);
+            std::swap(buffer_, other.buffer_);
+            return *this;
+        }
+
+        MapFile(const MapFile&) = delete;
+        MapFile& operator=(const MapFile&) = delete;
+
+        ~MapFile() {
+            close();
+        }
+
+        // creates (or truncates) a map of width x height x depth tiles whose chunks are all empty
+        bool create(const std::string& path, size_t width, size_t height, size_t chunk_size, size_t depth = 1) {
+            assert(width > 0 && height > 0 && depth > 0 && chunk_size > 0);
+            close();
+
+            file_ = std::fopen(path.c_str(), "w+b");
+            if (!file_) {
+                return false;
+            }
+
+            header_ = Header {
+                .magic = magic,
+                .version = version,
+                .width = static_cast<uint32_t>(width),
+                .height = static_cast<uint32_t>(height),
+                .depth = static_cast<uint32_t>(depth),
+                .chunk_size = static_cast<uint32_t>(chunk_size),
+                .component_type_count = static_cast<uint32_t>(Schema::component_type_count()),
+            };
+            set_chunk_grid();
+            chunk_records_.assign(get_chunk_count(), ChunkRecord{});
+
+            uint32_t component_sizes[Schema::component_type_count()];
+            get_component_sizes(component_sizes);
+
+            file_size_ = get_payload_offset();
+            if (!write_at(0, &header_, sizeof(header_)) ||
+                !write_at(sizeof(header_), component_sizes, sizeof(component_sizes)) ||
+                !write_at(get_index_offset(), chunk_records_.data(), chunk_records_.size() * sizeof(ChunkRecord))) {
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        // opens a map written by create; fails for files written with a different schema
+        bool open(const std::string& path) {
+            close();
+
+            file_ = std::fopen(path.c_str(), "r+b");
+            if (!file_) {
+                return false;
+            }
+
+            uint32_t component_sizes[Schema::component_type_count()];
+            uint32_t file_component_sizes[Schema::component_type_count()];
+            get_component_sizes(component_sizes);
+
+            if (!read_at(0, &header_, sizeof(header_)) ||
+                header_.magic != magic || header_.version != version ||
+                header_.component_type_count != Schema::component_type_count() ||
+                header_.width == 0 || header_.height == 0 || header_.depth == 0 || header_.chunk_size == 0 ||
+                !read_at(sizeof(header_), file_component_sizes, sizeof(file_component_sizes)) ||
+                std::memcmp(component_sizes, file_component_sizes, sizeof(component_sizes)) != 0) {
+                close();
+                return false;
+            }
+
+            set_chunk_grid();
+            chunk_records_.resize(get_chunk_count());
+            if (!read_at(get_index_offset(), chunk_records_.data(), chunk_records_.size() * sizeof(ChunkRecord))) {
+                close();
+                return false;
+            }
+
+            file_size_ = get_payload_offset();
+            for (const ChunkRecord& record: chunk_records_) {
+                file_size_ = std::max(file_size_, record.offset + record.capacity);
+            }
+
+            return true;
+        }
+
+        void close() {
+            if (file_) {
+                std::fclose(file_);
+                file_ = nullptr;
+            }
+        }
+
+        bool is_open() const {
+            return file_ != nullptr;
+        }
+
+        // replaces the contents of chunk with the entities stored for chunk_index
+        bool read_chunk(size_t chunk_index, MapChunk& chunk) {
+            ENTLER_PROFILE_ZONE("MapFile::read_chunk");
+
+            chunk.clear();
+
+            const ChunkRecord& record = chunk_records_[chunk_index];
+            if (record.size == 0) {
+                return true;
+            }
+
+            buffer_.resize(record.size);
+            return read_at(record.offset, buffer_.data(), buffer_.size()) && decode_chunk(buffer_, chunk);
+        }
+
+        bool write_chunk(size_t chunk_index, const MapChunk& chunk) {
+            ENTLER_PROFILE_ZONE("MapFile::write_chunk");
+
+            buffer_.clear();
+            encode_chunk(chunk, buffer_);
+
+            ChunkRecord record = chunk_records_[chunk_index];
+            if (buffer_.size() > record.capacity) {
+                // the old slot is left unused
+                record.offset = file_size_;
+                record.capacity = static_cast<uint32_t>(buffer_.size());
+                file_size_ += buffer_.size();
+            }
+            record.size = static_cast<uint32_t>(buffer_.size());
+
+            if (!write_at(record.offset, buffer_.data(), buffer_.size()) ||
+                !write_at(get_index_offset() + chunk_index * sizeof(ChunkRecord), &record, sizeof(record)) ||
+                std::fflush(file_) != 0) {
+                return false;
+            }
+
+            chunk_records_[chunk_index] = record;
+            return true;
+        }
+
+        // the payload size of a chunk, 0 for chunks that were never written
+        size_t get_chunk_byte_count(size_t chunk_index) const {
+            return chunk_records_[chunk_index].size;
+        }
+
+        size_t get_width() const {
+            return header_.width;
+        }
+
+        size_t get_height() const {
+            return header_.height;
+        }
+
+        size_t get_depth() const {
+            return header_.depth;
+        }
+
+        size_t get_chunk_size() const {
+            return header_.chunk_size;
+        }
+
+        size_t get_chunk_columns() const {
+            return chunk_columns_;
+        }
+
+        size_t get_chunk_rows() const {
+            return chunk_rows_;
+        }
+
+        size_t get_chunk_count() const {
+            return chunk_columns_ * chunk_rows_;
+        }
+
+        size_t find_chunk(I32Vec3 position) const {
+            assert(position.x >= 0 && static_cast<size_t>(position.x) < get_width());
+            assert(position.y >= 0 && static_cast<size_t>(position.y) < get_height());
+            return static_cast<size_t>(position.x) / header_.chunk_size + (static_cast<size_t>(position.y) / header_.chunk_size) * chunk_columns_;
+        }
+
+        I32Vec3 get_chunk_origin(size_t chunk_index) const {
+            return I32Vec3 {
+                static_cast<int32_t>((chunk_index % chunk_columns_) * header_.chunk_size),
+                static_cast<int32_t>((chunk_index / chunk_columns_) * header_.chunk_size),
+                0
+            };
+        }
+
+        // chunks in the last column and row are cut off by the map edge
+        size_t get_chunk_width(size_t chunk_index) const {
+            return std::min<size_t>(header_.chunk_size, get_width() - static_cast<size_t>(get_chunk_origin(chunk_index).x));
+        }
+
+        size_t get_chunk_height(size_t chunk_index) const {
+            return std::min<size_t>(header_.chunk_size, get_height() - static_cast<size_t>(get_chunk_origin(chunk_index).y));
+        }
+
+        static void encode_chunk(const MapChunk& chunk, std::vector<uint8_t>& bytes) {
+            uint32_t counts[2] = { static_cast<uint32_t>(chunk.objects.size()), static_cast<uint32_t>(chunk.properties.size()) };
+            append(bytes, counts, sizeof(counts));
+
+            for_each_snapshot(chunk, [&](const EntitySnapshot<Schema>& snapshot) {
+                uint64_t component_mask = snapshot.component_mask.to_ullong();
+                append(bytes, &component_mask, sizeof(component_mask));
+            });
+
+            for_each_component_type([&](auto component_type_index) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                if constexpr (!std::is_empty_v<Component>) {
+                    for_each_snapshot(chunk, [&](const EntitySnapshot<Schema>& snapshot) {
+                        if (snapshot.component_mask.test(component_type_index)) {
+                            append(bytes, &std::get<component_type_index>(snapshot.components), sizeof(Component));
+                        }
+                    });
+                }
+            });
+        }
+
+        static bool decode_chunk(const std::vector<uint8_t>& bytes, MapChunk& chunk) {
+            size_t offset = 0;
+            auto read = [&](void* data, size_t size) {
+                if (bytes.size() - offset < size) {
+                    return false;
+                }
+
+                std::memcpy(data, bytes.data() + offset, size);
+                offset += size;
+                return true;
+            };
+
+            uint32_t counts[2];
+            if (!read(counts, sizeof(counts)) || (static_cast<size_t>(counts[0]) + counts[1]) * sizeof(uint64_t) > bytes.size()) {
+                return false;
+            }
+
+            chunk.objects.resize(counts[0]);
+            chunk.properties.resize(counts[1]);
+
+            bool valid = true;
+            for_each_snapshot(chunk, [&](EntitySnapshot<Schema>& snapshot) {
+                uint64_t component_mask = 0;
+                valid = valid && read(&component_mask, sizeof(component_mask)) && (component_mask >> Schema::component_type_count()) == 0;
+                snapshot.component_mask = typename Schema::ComponentMask(component_mask);
+            });
+
+            for_each_component_type([&](auto component_type_index) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                if constexpr (!std::is_empty_v<Component>) {
+                    for_each_snapshot(chunk, [&](EntitySnapshot<Schema>& snapshot) {
+                        if (valid && snapshot.component_mask.test(component_type_index)) {
+                            valid = read(&std::get<component_type_index>(snapshot.components), sizeof(Component));
+                        }
+                    });
+                }
+            });
+
+            return valid && offset == bytes.size();
+        }
+
+    private:
+        static constexpr uint32_t magic = 0x50414d45;   // "EMAP"
+        static constexpr uint32_t version = 2;
+
+        struct Header {
+            uint32_t magic = 0;
+            uint32_t version = 0;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t depth = 0;
+            uint32_t chunk_size = 0;
+            uint32_t component_type_count = 0;
+        };
+
+        struct ChunkRecord {
+            uint64_t offset = 0;
+            uint32_t size = 0;
+            uint32_t capacity = 0;
+        };
+
+        // calls f(std::integral_constant<size_t, component_type_index>) for every component type
+        template<typename F>
+        static void for_each_component_type(F&& f) {
+            [&]<size_t... component_type_indexes>(std::index_sequence<component_type_indexes...>) {
+                (f(std::integral_constant<size_t, component_type_indexes>{}), ...);
+            }(std::make_index_sequence<Schema::component_type_count()>{});
+        }
+
+        template<typename Chunk, typename F>
+        static void for_each_snapshot(Chunk& chunk, F&& f) {
+            for (auto& snapshot: chunk.objects) {
+                f(snapshot);
+            }
+
+            for (auto& snapshot: chunk.properties) {
+                f(snapshot);
+            }
+        }
+
+        static void get_component_sizes(uint32_t* component_sizes) {
+            for_each_component_type([&](auto component_type_index) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                static_assert(std::is_trivially_copyable_v<Component>, "Chunks store components as raw bytes");
+                component_sizes[component_type_index] = std::is_empty_v<Component> ? 0 : sizeof(Component);
+            });
+        }
+
+        static void append(std::vector<uint8_t>& bytes, const void* data, size_t size) {
+            const uint8_t* first = static_cast<const uint8_t*>(data);
+            bytes.insert(bytes.end(), first, first + size);
+        }
+
+        void set_chunk_grid() {
+            chunk_columns_ = (header_.width + header_.chunk_size - 1) / header_.chunk_size;
+            chunk_rows_ = (header_.height + header_.chunk_size - 1) / header_.chunk_size;
+        }
+
+        uint64_t get_index_offset() const {
+            return sizeof(Header) + Schema::component_type_count() * sizeof(uint32_t);
+        }
+
+        uint64_t get_payload_offset() const {
+            return get_index_offset() + get_chunk_count() * sizeof(ChunkRecord);
+        }
+
+        bool seek(uint64_t offset) {
+#if defined(_WIN32)
+            return _fseeki64(file_, static_cast<int64_t>(offset), SEEK_SET) == 0;
+#else
+            return fseeko(file_, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+        }
+
+        bool read_at(uint64_t offset, void* data, size_t size) {
+            return seek(offset) && std::fread(data, 1, size, file_) == size;
+        }
+
+        bool write_at(uint64_t offset, const void* data, size_t size) {
+            return seek(offset) && std::fwrite(data, 1, size, file_) == size;
+        }
+
+    private:
+        FILE*                    file_ = nullptr;
+        Header                   header_;
+        size_t                   chunk_columns_ = 0;
+        size_t                   chunk_rows_ = 0;
+        std::vector<ChunkRecord> chunk_records_;   // a copy of the index on disk
+        uint64_t                 file_size_ = 0;
+        std::vector<uint8_t>     buffer_;          // payload of the chunk being read or written
+    };
+
+}
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include "entity/entity_database.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
+#include "util/spsc_queue.h"
+#include "map_file.h"
+#include "schema.h"
+#include "scene.h"
+
+namespace entler {
+
+    // Pages the chunks of a MapFile in and out of a Scene and its database
+    // around areas of interest. Chunks within load_radius chunks of an area are
+    // read on a background I/O thread and bulk inserted by the next update once
+    // they arrive; chunks further than load_radius + 1 away (the extra ring
+    // keeps chunks on an area's edge from bouncing) are snapshotted, removed
+    // and handed to the I/O thread to be written back. The tick thread never
+    // waits for the disk: update only takes finished reads off a queue. Tiles
+    // of chunks that are not in memory are unloaded in the scene, so nothing
+    // moves onto them while their entities are on disk. A chunk that fails to
+    // be written back is put back into the scene, to be written again when it
+    // is next unloaded, so an I/O error does not lose its entities.
+    //
+    // Only entities placed in the scene are streamed; parent links are not
+    // stored, so attached children are removed with their parent. Call update
+    // between ticks, from the thread that ticks the simulation.
+    class MapStreamer {
+    public:
+        // starts with every chunk on disk; the scene must cover the map and hold none of its entities yet
+        MapStreamer(EntityDatabase<Schema>& database, Scene& scene, MapFile file, size_t load_radius)
+            : database_(database)
+            , scene_(scene)
+            , file_(std::move(file))
+            , load_radius_(load_radius)
+            , chunk_states_(file_.get_chunk_count(), ChunkState::on_disk)
+            , keep_stamps_(file_.get_chunk_count(), 0)
+            , stale_loads_(file_.get_chunk_count(), false)
+        {
+            assert(file_.is_open());
+            assert(scene.get_origin() == I32Vec3{});
+            assert(scene.get_width() == file_.get_width() && scene.get_height() == file_.get_height() && scene.get_depth() == file_.get_depth());
+
+            scene.set_loaded(I32Vec3{}, scene.get_width(), scene.get_height(), false);
+            io_thread_ = std::thread([this]() {
+                run_io_thread();
+            });
+        }
+
+        MapStreamer(MapStreamer&&) = delete;
+        MapStreamer(const MapStreamer&) = delete;
+        MapStreamer& operator=(MapStreamer&&) = delete;
+        MapStreamer& operator=(const MapStreamer&) = delete;
+
+        // finishes the queued reads and writes; chunks still in memory are not written back, see unload_all
+        ~MapStreamer() {
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+
+            wake_condition_.notify_one();
+            io_thread_.join();
+        }
+
+        // snapshots the objects and properties on the tiles of a chunk
+        static MapChunk take_chunk(EntityDatabase<Schema>& database, Scene& scene, const MapFile& file, size_t chunk_index) {
+            MapChunk chunk;
+            for_each_chunk_entity(scene, file, chunk_index, [&](Entity<Schema> entity, bool property) {
+                (property ? chunk.properties : chunk.objects).push_back(database.take_snapshot(entity));
+            });
+
+            return chunk;
+        }
+
+        // brings in the chunks that finished loading, then loads and unloads chunks around areas_of_interest
+        void update(const std::vector<I32Vec3>& areas_of_interest) {
+            ENTLER_PROFILE_ZONE("MapStreamer::update");
+
+            apply_results();
+
+            update_count_ += 1;
+            for (I32Vec3 area: areas_of_interest) {
+                for_each_chunk_near(area, load_radius_ + 1, [&](size_t chunk_index, bool inside_load_radius) {
+                    keep_stamps_[chunk_index] = update_count_;
+                    if (inside_load_radius && chunk_states_[chunk_index] == ChunkState::on_disk) {
+                        request_load(chunk_index);
+                    }
+                });
+            }
+
+            for (size_t resident_index = 0; resident_index < resident_chunk_indexes_.size();) {
+                size_t chunk_index = resident_chunk_indexes_[resident_index];
+                if (keep_stamps_[chunk_index] == update_count_) {
+                    resident_index += 1;
+                    continue;
+                }
+
+                resident_chunk_indexes_[resident_index] = resident_chunk_indexes_.back();
+                resident_chunk_indexes_.pop_back();
+                unload(chunk_index);
+            }
+        }
+
+        // loads every chunk and waits until they are in
+        void load_all() {
+            for (size_t chunk_index = 0; chunk_index < chunk_states_.size(); ++chunk_index) {
+                if (chunk_states_[chunk_index] == ChunkState::on_disk) {
+                    request_load(chunk_index);
+                }
+            }
+
+            wait_until_idle();
+        }
+
+        // writes every chunk back and waits until the file is up to date; chunks that failed to
+        // be written stay in memory, see io_errors
+        void unload_all() {
+            // chunks that are still loading have to come in before they can go out again
+            wait_until_idle();
+
+            for (size_t chunk_index: resident_chunk_indexes_) {
+                unload(chunk_index);
+            }
+            resident_chunk_indexes_.clear();
+
+            wait_until_idle();
+        }
+
+        bool is_chunk_resident(size_t chunk_index) const {
+            return chunk_states_[chunk_index] == ChunkState::resident;
+        }
+
+        size_t get_resident_chunk_count() const {
+            return resident_chunk_indexes_.size();
+        }
+
+        // call from the thread that calls update
+        void collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const {
+            std::string name(prefix);
+            auto add = [&](std::string_view suffix, auto value) {
+                snapshot.add(name + std::string(suffix), static_cast<int64_t>(value));
+            };
+
+            add("chunks", chunk_states_.size());
+            add("resident_chunks", resident_chunk_indexes_.size());
+            add("pending_requests", pending_request_count_);
+            add("loads", load_count_);
+            add("stores", store_count_);
+            add("loaded_entities", loaded_entity_count_);
+            add("stored_entities", stored_entity_count_);
+            add("read_bytes", read_byte_count_);
+            add("written_bytes", written_byte_count_);
+            add("io_errors", io_error_count_);
+        }
+
+    private:
+        enum class ChunkState : uint8_t {
+            on_disk,
+            loading,
+            resident,
+        };
+
+        enum class RequestType : uint8_t {
+            load,
+            store,
+        };
+
+        struct Request {
+            RequestType type = RequestType::load;
+            size_t      chunk_index = 0;
+            MapChunk    chunk;   // to store
+        };
+
+        struct Result {
+            RequestType type = RequestType::load;
+            size_t      chunk_index = 0;
+            bool        succeeded = false;
+            size_t      byte_count = 0;
+            MapChunk    chunk;   // loaded, or not stored
+        };
+
+        // calls f(entity, property) for the objects and properties on the tiles of a chunk, through every level
+        template<typename F>
+        static void for_each_chunk_entity(Scene& scene, const MapFile& file, size_t chunk_index, F&& f) {
+            I32Vec3 origin = file.get_chunk_origin(chunk_index);
+            for (size_t z = 0; z < file.get_depth(); ++z) {
+                for (size_t y = 0; y < file.get_chunk_height(chunk_index); ++y) {
+                    for (size_t x = 0; x < file.get_chunk_width(chunk_index); ++x) {
+                        I32Vec3 position = origin + I32Vec3{static_cast<int32_t>(x), static_cast<int32_t>(y), static_cast<int32_t>(z)};
+                        if (auto object = scene.get_object(position)) {
+                            f(*object, false);
+                        }
+
+                        scene.for_each_property(position, [&](Entity<Schema> property) {
+                            f(property, true);
+                        });
+                    }
+                }
+            }
+        }
+
+        // calls f(chunk_index, inside_load_radius) for the chunks within radius chunks of position
+        template<typename F>
+        void for_each_chunk_near(I32Vec3 position, size_t radius, F&& f) const {
+            position.x = std::clamp<int32_t>(position.x, 0, static_cast<int32_t>(file_.get_width()) - 1);
+            position.y = std::clamp<int32_t>(position.y, 0, static_cast<int32_t>(file_.get_height()) - 1);
+
+            size_t chunk_index = file_.find_chunk(position);
+            size_t column = chunk_index % file_.get_chunk_columns();
+            size_t row = chunk_index / file_.get_chunk_columns();
+
+            size_t first_column = column - std::min(column, radius);
+            size_t last_column = std::min(column + radius, file_.get_chunk_columns() - 1);
+            size_t first_row = row - std::min(row, radius);
+            size_t last_row = std::min(row + radius, file_.get_chunk_rows() - 1);
+            for (size_t near_row = first_row; near_row <= last_row; ++near_row) {
+                for (size_t near_column = first_column; near_column <= last_column; ++near_column) {
+                    size_t distance = std::max(std::max(near_column, column) - std::min(near_column, column), std::max(near_row, row) - std::min(near_row, row));
+                    f(near_column + near_row * file_.get_chunk_columns(), distance <= load_radius_);
+                }
+            }
+        }
+
+        void request_load(size_t chunk_index) {
+            chunk_states_[chunk_index] = ChunkState::loading;
+            push_request(Request{RequestType::load, chunk_index, {}});
+        }
+
+        void unload(size_t chunk_index) {
+            ENTLER_PROFILE_ZONE("MapStreamer::unload");
+
+            assert(chunk_states_[chunk_index] == ChunkState::resident);
+
+            MapChunk chunk;
+            unloaded_entities_.clear();
+            for_each_chunk_entity(scene_, file_, chunk_index, [&](Entity<Schema> entity, bool property) {
+                (property ? chunk.properties : chunk.objects).push_back(database_.take_snapshot(entity));
+                unloaded_entities_.push_back(entity);
+            });
+
+            // the scene lets go of the entities as they are removed
+            for (Entity<Schema> entity: unloaded_entities_) {
+                database_.remove_entity(entity);
+            }
+
+            scene_.set_loaded(file_.get_chunk_origin(chunk_index), file_.get_chunk_width(chunk_index), file_.get_chunk_height(chunk_index), false);
+            chunk_states_[chunk_index] = ChunkState::on_disk;
+            stored_entity_count_ += chunk.size();
+            push_request(Request{RequestType::store, chunk_index, std::move(chunk)});
+        }
+
+        void insert(size_t chunk_index, const MapChunk& chunk) {
+            ENTLER_PROFILE_ZONE("MapStreamer::insert");
+
+            size_t first_entity_index = database_.add_entities(chunk.objects.data(), chunk.objects.size());
+            for (size_t object_index = 0; object_index < chunk.objects.size(); ++object_index) {
+                scene_.add_object(database_.get_entity(first_entity_index + object_index));
+            }
+
+            first_entity_index = database_.add_entities(chunk.properties.data(), chunk.properties.size());
+            for (size_t property_index = 0; property_index < chunk.properties.size(); ++property_index) {
+                scene_.add_property(database_.get_entity(first_entity_index + property_index));
+            }
+
+            scene_.set_loaded(file_.get_chunk_origin(chunk_index), file_.get_chunk_width(chunk_index), file_.get_chunk_height(chunk_index), true);
+            chunk_states_[chunk_index] = ChunkState::resident;
+            resident_chunk_indexes_.push_back(chunk_index);
+            loaded_entity_count_ += chunk.size();
+        }
+
+        void push_request(Request request) {
+            requests_.push(std::move(request));
+            pending_request_count_ += 1;
+
+            {
+                std::lock_guard lock(mutex_);
+                requested_count_ += 1;
+            }
+
+            wake_condition_.notify_one();
+        }
+
+        void apply_results() {
+            Result result;
+            while (results_.try_pop(result)) {
+                pending_request_count_ -= 1;
+                io_error_count_ += !result.succeeded;
+
+                if (result.type == RequestType::store) {
+                    if (result.succeeded) {
+                        store_count_ += 1;
+                        written_byte_count_ += result.byte_count;
+                        continue;
+                    }
+
+                    // the file still holds the chunk as it was before, so a load queued behind the
+                    // store would bring back stale entities; the ones that were not stored come back
+                    stale_loads_[result.chunk_index] = chunk_states_[result.chunk_index] == ChunkState::loading;
+                    stored_entity_count_ -= result.chunk.size();
+                    insert(result.chunk_index, result.chunk);
+                    continue;
+                }
+
+                if (stale_loads_[result.chunk_index]) {
+                    stale_loads_[result.chunk_index] = false;
+                    continue;
+                }
+
+                // a chunk that failed to load stays on disk and is asked for again by the next update
+                if (!result.succeeded) {
+                    chunk_states_[result.chunk_index] = ChunkState::on_disk;
+                    continue;
+                }
+
+                load_count_ += 1;
+                read_byte_count_ += result.byte_count;
+                insert(result.chunk_index, result.chunk);
+            }
+        }
+
+        void wait_until_idle() {
+            {
+                std::unique_lock lock(mutex_);
+                done_condition_.wait(lock, [&]() {
+                    return completed_count_ == requested_count_;
+                });
+            }
+
+            apply_results();
+        }
+
+        void run_io_thread() {
+            while (true) {
+                {
+                    std::unique_lock lock(mutex_);
+                    wake_condition_.wait(lock, [&]() {
+                        return taken_count_ < requested_count_ || stopping_;
+                    });
+
+                    if (taken_count_ == requested_count_) {
+                        return;
+                    }
+
+                    taken_count_ += 1;
+                }
+
+                Request request;
+                bool popped = requests_.try_pop(request);
+                assert(popped);
+                (void)popped;
+
+                Result result;
+                result.type = request.type;
+                result.chunk_index = request.chunk_index;
+                if (request.type == RequestType::load) {
+                    result.succeeded = file_.read_chunk(request.chunk_index, result.chunk);
+                }
+                else {
+                    result.succeeded = file_.write_chunk(request.chunk_index, request.chunk);
+                    if (!result.succeeded) {
+                        result.chunk = std::move(request.chunk);
+                    }
+                }
+                result.byte_count = file_.get_chunk_byte_count(request.chunk_index);
+                results_.push(std::move(result));
+
+                {
+                    std::lock_guard lock(mutex_);
+                    completed_count_ += 1;
+                }
+
+                done_condition_.notify_all();
+            }
+        }
+
+    private:
+        EntityDatabase<Schema>&     database_;
+        Scene&                      scene_;
+        MapFile                     file_;   // only used by the I/O thread once it runs
+        size_t                      load_radius_;
+
+        std::vector<ChunkState>     chunk_states_;
+        std::vector<uint64_t>       keep_stamps_;   // the last update that wanted the chunk in memory
+        std::vector<bool>           stale_loads_;   // the queued load of the chunk is to be dropped, see apply_results
+        std::vector<size_t>         resident_chunk_indexes_;
+        std::vector<Entity<Schema>> unloaded_entities_;
+        uint64_t                    update_count_ = 0;
+
+        // tick thread statistics
+        size_t                      pending_request_count_ = 0;
+        uint64_t                    load_count_ = 0;
+        uint64_t                    store_count_ = 0;
+        uint64_t                    loaded_entity_count_ = 0;
+        uint64_t                    stored_entity_count_ = 0;
+        uint64_t                    read_byte_count_ = 0;
+        uint64_t                    written_byte_count_ = 0;
+        uint64_t                    io_error_count_ = 0;
+
+        SpscQueue<Request>          requests_;
+        SpscQueue<Result>           results_;
+
+        std::mutex                  mutex_;
+        std::condition_variable     wake_condition_;
+        std::condition_variable     done_condition_;
+        uint64_t                    requested_count_ = 0;   // guarded by mutex_
+        uint64_t                    taken_count_ = 0;       // guarded by mutex_
+        uint64_t                    completed_count_ = 0;   // guarded by mutex_
+        bool                        stopping_ = false;      // guarded by mutex_
+        std::thread                 io_thread_;
+    };
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "events.h"
+#include "simulation.h"
+#include "system.h"
+
+namespace entler {
+
+    // Puts the claims on each target tile next to each other, lowest row-major
+    // source first; the first claim on a target is the one that moves.
+    // Claims need target_offset and source_offset members.
+    template<typename Claim>
+    void sort_move_claims(std::vector<Claim>& claims) {
+        std::sort(claims.begin(), claims.end(), [](const Claim& lhs, const Claim& rhs) {
+            if (lhs.target_offset != rhs.target_offset) {
+                return lhs.target_offset < rhs.target_offset;
+            }
+
+            return lhs.source_offset < rhs.source_offset;
+        });
+    }
+
+    // Moves every object with a body by its velocity. Moves are resolved so the
+    // result does not depend on iteration order or thread count: an object may
+    // only move onto a tile that was empty at the start of the tick, and when
+    // several objects want the same tile the one coming from the lowest
+    // row-major tile wins. Objects that cannot move bounce back and emit a
+    // CollisionEvent.
+    class MovementSystem : public System {
+    public:
+        const char* get_name() const override {
+            return "MovementSystem";
+        }
+
+        size_t update(Simulation& simulation) override {
+            auto& database = simulation.get_database();
+            auto& scene = simulation.get_scene();
+            auto& job_system = simulation.get_job_system();
+            auto& collisions = simulation.get_event_channel<CollisionEvent>();
+
+            thread_moves_.resize(job_system.thread_count());
+            thread_updated_entity_counts_.assign(job_system.thread_count(), 0);
+
+            constexpr auto component_mask = Schema::component_mask_v<
+                ComponentType::position,
+                ComponentType::body
+            >;
+
+            // propose moves against the scene as it was at the start of the tick
+            job_system.parallel_for(database.get_entity_table_size(), grain_size, [&](size_t first, size_t last, size_t thread_index) {
+                auto& moves = thread_moves_[thread_index];
+                size_t updated_entity_count = 0;
+
+                database.for_each_entity(first, last, component_mask, [&](Entity<Schema> entity) {
+                    // read only, so the double buffered position is not copied
+                    auto& position = std::as_const(entity).get_component<ComponentType::position>();
+                    auto& body = entity.get_component<ComponentType::body>();
+                    updated_entity_count += 1;
+
+                    if (body.velocity == I32Vec3{}) {
+                        return;
+                    }
+
+                    I32Vec3 target = position.value + body.velocity;
+                    if (!scene.contains(target) || !scene.is_loaded(target) || scene.get_object(target)) {
+                        body.velocity = I32Vec3{} - body.velocity;
+                        collisions.emit(CollisionEvent{entity.get_index(), target});
+                        return;
+                    }
+
+                    moves.push_back(Move {
+                        .entity_index = entity.get_index(),
+                        .source_offset = get_offset(scene, position.value),
+                        .target_offset = get_offset(scene, target),
+                        .target = target,
+                    });
+                });
+
+                thread_updated_entity_counts_[thread_index] += updated_entity_count;
+            });
+
+            moves_.clear();
+            for (auto& moves: thread_moves_) {
+                moves_.insert(moves_.end(), moves.begin(), moves.end());
+                moves.clear();
+            }
+
+            sort_move_claims(moves_);
+
+            // every target was empty at the start of the tick, so applying the winners in any order is safe
+            for (size_t move_index = 0; move_index < moves_.size(); ++move_index) {
+                const Move& move = moves_[move_index];
+                Entity<Schema> entity = database.get_entity(move.entity_index);
+
+                if (move_index > 0 && moves_[move_index - 1].target_offset == move.target_offset) {
+                    auto& body = entity.get_component<ComponentType::body>();
+                    body.velocity = I32Vec3{} - body.velocity;
+                    collisions.emit(CollisionEvent{move.entity_index, move.target});
+                    continue;
+                }
+
+                scene.move_object(entity, move.target);
+            }
+
+            size_t updated_entity_count = 0;
+            for (size_t count: thread_updated_entity_counts_) {
+                updated_entity_count += count;
+            }
+
+            return updated_entity_count;
+        }
+
+    private:
+        static constexpr size_t grain_size = 4096;
+
+        struct Move {
+            size_t  entity_index;
+            size_t  source_offset;
+            size_t  target_offset;
+            I32Vec3 target;
+        };
+
+        static size_t get_offset(const Scene& scene, I32Vec3 position) {
+            size_t z = static_cast<size_t>(position.z);
+            return static_cast<size_t>(position.x) + (static_cast<size_t>(position.y) + z * scene.get_height()) * scene.get_width();
+        }
+
+    private:
+        std::vector<std::vector<Move>> thread_moves_;
+        std::vector<size_t>            thread_updated_entity_counts_;
+        std::vector<Move>              moves_;
+    };
+
+}
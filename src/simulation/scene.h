@@ -1,90 +1,399 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include "entity/entity_database.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
+#include "util/sparse_grid.h"
 #include "schema.h"
 
 namespace entler {
 
+    // The tiles of a width x height x depth block of the world and the objects
+    // and properties on them. Tiles are kept in SparseGrids, so a scene costs
+    // memory for the tiles that hold something rather than for its bounds;
+    // levels above the first are for multi-level maps, the systems move
+    // objects within a level. Object tiles hold the index of the object's
+    // handle, which stays put while the object moves.
     class Scene : public EntityObserver<Schema> {
     public:
-        Scene(EntityDatabase<Schema>& database, size_t width, size_t height)
+        Scene(EntityDatabase<Schema>& database, size_t width, size_t height, size_t depth = 1)
+            : Scene(database, I32Vec3{}, width, height, depth)
+        {
+        }
+
+        // a scene covering the width x height x depth tiles starting at origin, e.g. one region of a sharded map
+        Scene(EntityDatabase<Schema>& database, I32Vec3 origin, size_t width, size_t height, size_t depth = 1)
             : EntityObserver<Schema>(database)
+            , database_(database)
+            , origin_(origin)
             , width_(width)
             , height_(height)
-            , objects_(new EntityHandle<Schema>[width * height])
-            , properties_(new std::vector<EntityHandle<Schema>>[width * height])
+            , depth_(depth)
+            , objects_(width, height, depth)
+            , properties_(width, height, depth)
+            , area_of_interest_(origin + I32Vec3{static_cast<int32_t>(width / 2), static_cast<int32_t>(height / 2), 0})
         {
+            tiles_with_property_count_[0] = width * height * depth;
         }
 
         void add_object(Entity<Schema> entity) {
+            ENTLER_PROFILE_ZONE("Scene::add_object");
+
             assert(entity.has_component<ComponentType::position>());
             assert(entity.has_component<ComponentType::object_type>());
 
-            auto& position = entity.get_component<ComponentType::position>();
-            auto offset = get_offset(position.value);
+            auto& position = std::as_const(entity).get_component<ComponentType::position>();
+            assert(!objects_.find(get_cell(position.value)));
 
-            assert(!objects_[offset]);
-            objects_[offset] = EntityHandle<Schema>(entity);
+            uint32_t handle_index;
+            if (free_object_handle_indexes_.empty()) {
+                handle_index = static_cast<uint32_t>(object_handles_.size());
+                object_handles_.emplace_back();
+            }
+            else {
+                handle_index = free_object_handle_indexes_.back();
+                free_object_handle_indexes_.pop_back();
+            }
+
+            object_handles_[handle_index] = EntityHandle<Schema>(entity);
+            objects_.get_or_add(get_cell(position.value)) = handle_index;
+            object_count_ += 1;
         }
 
         void add_property(Entity<Schema> entity) {
+            ENTLER_PROFILE_ZONE("Scene::add_property");
+
             assert(entity.has_component<ComponentType::position>());
             assert(entity.has_component<ComponentType::object_type>());
 
-            auto& position = entity.get_component<ComponentType::position>();
-            auto offset = get_offset(position.value);
-
-            properties_[offset].push_back(EntityHandle<Schema>(entity));
+            auto& position = std::as_const(entity).get_component<ComponentType::position>();
+            auto& properties = properties_.get_or_add(get_cell(position.value));
+            properties.push_back(EntityHandle<Schema>(entity));
+            update_property_histogram(properties.size() - 1, properties.size());
         }
 
         void move_object(Entity<Schema> entity, I32Vec3 new_position) {
+            ENTLER_PROFILE_ZONE("Scene::move_object");
+
             assert(entity.has_component<ComponentType::position>());
             assert(entity.has_component<ComponentType::object_type>());
 
             auto& position = entity.get_component<ComponentType::position>();
-            auto old_offset = get_offset(position.value);
-            auto new_offset = get_offset(new_position);
+            auto old_cell = get_cell(position.value);
+            auto new_cell = get_cell(new_position);
 
-            assert(entity.has_component<ComponentType::object_type>());
-            assert(objects_[old_offset]);
-            assert(!objects_[new_offset]);
+            auto* object = objects_.find(old_cell);
+            assert(object && object_handles_[*object]);
+            assert(!objects_.find(new_cell));
 
-            objects_[new_offset] = std::move(objects_[old_offset]);
+            uint32_t handle_index = *object;
+            objects_.erase(old_cell);
+            objects_.get_or_add(new_cell) = handle_index;
             position.value = new_position;
+            move_count_ += 1;
+
+            if (database_.get_sleeping_entity_count() > 0) {
+                wake_neighbours(new_position);
+            }
         }
 
         std::optional<Entity<Schema>> get_object(I32Vec3 position) {
-            size_t offset = get_offset(position);
-            auto& handle = objects_[offset];
-            if (handle) {
-                return *handle;
+            auto* object = objects_.find(get_cell(position));
+            if (object && object_handles_[*object]) {
+                return *object_handles_[*object];
             }
 
             return std::nullopt;
         }
 
+        // visits the objects on the tiles in [first, last), brick by brick; the visitor must
+        // not add, move or remove objects
+        template<typename Visitor>
+        void for_each_object(I32Vec3 first, I32Vec3 last, Visitor&& visitor) {
+            ENTLER_PROFILE_ZONE("Scene::for_each_object");
+
+            objects_.for_each(first - origin_, last - origin_, [&](I32Vec3, uint32_t handle_index) {
+                auto& handle = object_handles_[handle_index];
+                if (handle) {
+                    visitor(*handle);
+                }
+            });
+        }
+
+        // visits the objects on the up to 26 tiles around position
+        template<typename Visitor>
+        void for_each_neighbour(I32Vec3 position, Visitor&& visitor) {
+            I32Vec3 cell = position - origin_;
+            objects_.for_each(cell - I32Vec3{1, 1, 1}, cell + I32Vec3{2, 2, 2}, [&](I32Vec3 neighbour_cell, uint32_t handle_index) {
+                auto& handle = object_handles_[handle_index];
+                if (handle && neighbour_cell != cell) {
+                    visitor(*handle);
+                }
+            });
+        }
+
+        // Orders the database by the Morton code of the entities' tiles, see get_morton_code,
+        // so the objects and properties of a block of tiles sit next to each other in every
+        // component table; entities outside the scene go last. Vacuums the database, so
+        // entity indexes change and handles stay valid.
+        void sort_storage() {
+            ENTLER_PROFILE_ZONE("Scene::sort_storage");
+
+            auto get_storage_key = [this](Entity<Schema> entity) {
+                if (!entity.has_component<ComponentType::position>()) {
+                    return no_storage_key;
+                }
+
+                I32Vec3 position = std::as_const(entity).get_component<ComponentType::position>().value;
+                return contains(position) ? get_morton_code(get_cell(position)) : no_storage_key;
+            };
+
+            database_.vacuum(get_storage_key);
+
+            storage_keys_.clear();
+            storage_keys_.reserve(database_.get_entity_table_size());
+            for (size_t entity_index = 0; entity_index < database_.get_entity_table_size(); ++entity_index) {
+                storage_keys_.push_back(get_storage_key(database_.get_entity(entity_index)));
+            }
+
+            sorted_vacuum_count_ = database_.get_vacuum_count();
+        }
+
+        struct StorageRange {
+            size_t first_entity_index = 0;
+            size_t last_entity_index = 0;
+
+            bool empty() const {
+                return first_entity_index == last_entity_index;
+            }
+        };
+
+        // The entity indexes [first, last) that held the entities on the tiles in [first, last)
+        // when sort_storage last ran, to hand to EntityDatabase::for_each_entity. Exact for a
+        // block of 2^n tiles per side aligned to its size, e.g. a brick of the tile grids, and
+        // a superset for other blocks. Entities that moved or were removed since are not
+        // filtered out, nor are entities added since included. Empty if the database was
+        // vacuumed since.
+        StorageRange get_storage_range(I32Vec3 first, I32Vec3 last) const {
+            if (sorted_vacuum_count_ != database_.get_vacuum_count() || storage_keys_.empty()) {
+                return {};
+            }
+
+            first = I32Vec3{std::max(first.x, origin_.x), std::max(first.y, origin_.y), std::max(first.z, origin_.z)};
+            last = I32Vec3{
+                std::min(last.x, origin_.x + static_cast<int32_t>(width_)),
+                std::min(last.y, origin_.y + static_cast<int32_t>(height_)),
+                std::min(last.z, origin_.z + static_cast<int32_t>(depth_)),
+            };
+            if (first.x >= last.x || first.y >= last.y || first.z >= last.z) {
+                return {};
+            }
+
+            // codes grow along every axis, so the block's lie between those of its corners
+            auto first_key = std::lower_bound(storage_keys_.begin(), storage_keys_.end(), get_morton_code(get_cell(first)));
+            auto last_key = std::upper_bound(first_key, storage_keys_.end(), get_morton_code(get_cell(last - I32Vec3{1, 1, 1})));
+            return StorageRange {
+                .first_entity_index = static_cast<size_t>(first_key - storage_keys_.begin()),
+                .last_entity_index = static_cast<size_t>(last_key - storage_keys_.begin()),
+            };
+        }
+
+        // the entity indexes of the entities on the tile at position, see above
+        StorageRange get_storage_range(I32Vec3 position) const {
+            return get_storage_range(position, position + I32Vec3{1, 1, 1});
+        }
+
+        I32Vec3 get_origin() const {
+            return origin_;
+        }
+
+        size_t get_width() const {
+            return width_;
+        }
+
+        size_t get_height() const {
+            return height_;
+        }
+
+        size_t get_depth() const {
+            return depth_;
+        }
+
+        bool contains(I32Vec3 position) const {
+            return objects_.contains(position - origin_);
+        }
+
+        // where the player, camera or whatever the world is simulated for is; starts out
+        // in the middle of the scene. Level of detail policies update entities further
+        // away less often, see UpdatePolicy.
+        void set_area_of_interest(I32Vec3 position) {
+            area_of_interest_ = position;
+        }
+
+        I32Vec3 get_area_of_interest() const {
+            return area_of_interest_;
+        }
+
+        // Tiles start out loaded. A MapStreamer unloads the tiles of the chunks it keeps on
+        // disk; they hold no entities, and movement treats them like tiles off the map.
+        // Tiles are loaded and unloaded in columns through every level.
+        void set_loaded(I32Vec3 origin, size_t width, size_t height, bool loaded) {
+            if (unloaded_.empty()) {
+                if (loaded) {
+                    return;
+                }
+
+                unloaded_.assign(width_ * height_, 0);
+            }
+
+            for (size_t y = 0; y < height; ++y) {
+                size_t offset = get_column_offset(origin + I32Vec3{0, static_cast<int32_t>(y), 0});
+                std::fill_n(unloaded_.begin() + static_cast<ptrdiff_t>(offset), width, loaded ? 0 : 1);
+            }
+        }
+
+        bool is_loaded(I32Vec3 position) const {
+            return unloaded_.empty() || !unloaded_[get_column_offset(position)];
+        }
+
+        // reports object and property occupancy of the tiles and the memory they take; call from
+        // the thread that mutates the scene
+        void collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const {
+            std::string name(prefix);
+            auto add = [&](std::string_view suffix, auto value) {
+                snapshot.add(name + std::string(suffix), static_cast<int64_t>(value));
+            };
+
+            size_t tile_count = width_ * height_ * depth_;
+            add("tiles", tile_count);
+            add("objects", object_count_);
+            add("object_occupancy_permille", tile_count ? (object_count_ * 1000) / tile_count : 0);
+            add("properties", property_count_);
+            add("tiles_with_properties.0", tiles_with_property_count_[0]);
+            add("tiles_with_properties.1", tiles_with_property_count_[1]);
+            add("tiles_with_properties.2", tiles_with_property_count_[2]);
+            add("tiles_with_properties.3+", tiles_with_property_count_[3]);
+            add("moves", move_count_);
+            add("bricks", objects_.get_brick_count() + properties_.get_brick_count());
+            add("memory_bytes", objects_.get_memory_size() + properties_.get_memory_size() + object_handles_.capacity() * sizeof(EntityHandle<Schema>));
+        }
+
         template<typename Visitor>
         void for_each_property(I32Vec3 position, Visitor&& visitor) {
-            size_t offset = get_offset(position);
-            for (auto& handle: properties_[offset]) {
+            ENTLER_PROFILE_ZONE("Scene::for_each_property");
+
+            auto* properties = properties_.find(get_cell(position));
+            if (!properties) {
+                return;
+            }
+
+            for (auto& handle: *properties) {
                 if (handle) {
                     visitor(*handle);
                 }
             }
         }
 
+        void entity_removed(Entity<Schema> entity) override {
+            if (entity.has_component<ComponentType::position>()) {
+                remove_entity(entity);
+            }
+        }
+
+        // an entity without a position has no place in the scene
+        void component_removed(Entity<Schema> entity, ComponentType component_type) override {
+            if (component_type == ComponentType::position) {
+                remove_entity(entity);
+            }
+        }
+
     private:
-        size_t get_offset(I32Vec3 position) const {
-            return position.x + (position.y * width_);
+        // wakes the sleeping objects next to position that run a behavior, the only ones that
+        // look at their surroundings; the others would only go back to sleep
+        void wake_neighbours(I32Vec3 position) {
+            for_each_neighbour(position, [&](Entity<Schema> object) {
+                if (object.has_component<ComponentType::behavior>()) {
+                    database_.wake_entity(object);
+                }
+            });
+        }
+
+        void remove_entity(Entity<Schema> entity) {
+            auto& position = std::as_const(entity).get_component<ComponentType::position>();
+            if (!contains(position.value)) {
+                return;
+            }
+
+            auto cell = get_cell(position.value);
+            auto* object = objects_.find(cell);
+            if (object) {
+                auto& handle = object_handles_[*object];
+                if (!handle || handle.get().get_index() == entity.get_index()) {
+                    handle.reset();
+                    free_object_handle_indexes_.push_back(*object);
+                    objects_.erase(cell);
+                    object_count_ -= 1;
+                }
+            }
+
+            auto* properties = properties_.find(cell);
+            if (!properties) {
+                return;
+            }
+
+            size_t old_property_count = properties->size();
+            properties->erase(std::remove_if(properties->begin(), properties->end(), [&](EntityHandle<Schema>& handle) {
+                return !handle || handle.get().get_index() == entity.get_index();
+            }), properties->end());
+            update_property_histogram(old_property_count, properties->size());
+            if (properties->empty()) {
+                properties_.erase(cell);
+            }
+        }
+
+        I32Vec3 get_cell(I32Vec3 position) const {
+            assert(contains(position));
+            return position - origin_;
+        }
+
+        size_t get_column_offset(I32Vec3 position) const {
+            assert(contains(position));
+            return (position.x - origin_.x) + ((position.y - origin_.y) * width_);
+        }
+
+        void update_property_histogram(size_t old_property_count, size_t new_property_count) {
+            tiles_with_property_count_[std::min<size_t>(old_property_count, 3)] -= 1;
+            tiles_with_property_count_[std::min<size_t>(new_property_count, 3)] += 1;
+            property_count_ += new_property_count;
+            property_count_ -= old_property_count;
         }
 
     private:
-        size_t                                               height_;
+        static constexpr uint64_t no_storage_key = UINT64_MAX;
+
+        EntityDatabase<Schema>&                              database_;
+        I32Vec3                                              origin_;
         size_t                                               width_;
-        std::unique_ptr<EntityHandle<Schema>[]>              objects_;
-        std::unique_ptr<std::vector<EntityHandle<Schema>>[]> properties_;
+        size_t                                               height_;
+        size_t                                               depth_;
+        SparseGrid<uint32_t>                                 objects_;   // index into object_handles_
+        std::vector<EntityHandle<Schema>>                    object_handles_;
+        std::vector<uint32_t>                                free_object_handle_indexes_;
+        SparseGrid<std::vector<EntityHandle<Schema>>>        properties_;
+        size_t                                               object_count_ = 0;
+        size_t                                               property_count_ = 0;
+        size_t                                               tiles_with_property_count_[4] = {};
+        uint64_t                                             move_count_ = 0;
+        std::vector<uint8_t>                                 unloaded_;   // by column offset; empty while every tile is loaded
+        I32Vec3                                              area_of_interest_;
+        std::vector<uint64_t>                                storage_keys_;   // by entity index, as of the last sort_storage
+        uint64_t                                             sorted_vacuum_count_ = 0;
     };
 
 }
@@ -12,7 +12,12 @@ namespace entler {
         ComponentType::position,
         ComponentType::body,
         ComponentType::display,
-        ComponentType::energy
+        ComponentType::energy,
+        ComponentType::behavior,
+        ComponentType::attachment,
+        ComponentType::in_lava,
+        ComponentType::selected,
+        ComponentType::dead
     >;
 
 }
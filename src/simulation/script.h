@@ -0,0 +1,188 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include "memory/pool_allocator.h"
+#include "util/event_channel.h"
+#include "simulation.h"
+
+namespace entler {
+
+    // coroutine frames of every Script, see Script::promise_type
+    inline PoolAllocator& get_script_frame_pool() {
+        static PoolAllocator pool;
+        return pool;
+    }
+
+    // receives the events a scheduler drains for the scripts waiting on them
+    class ScriptEventSink {
+    public:
+        virtual void deliver(size_t entity_index, const void* event) = 0;
+
+    protected:
+        ~ScriptEventSink() = default;
+    };
+
+    // what a suspended script waits for; set by the awaiter it suspended on and read
+    // by the scheduler once the script is back in its hands
+    struct ScriptWait {
+        uint64_t ticks = 0;                   // 0 while waiting for an event
+        size_t   event_type_index = 0;
+        void*    event = nullptr;             // receives the event in the awaiter
+        void   (*copy_event)(void* target, const void* event) = nullptr;
+        void   (*drain_events)(Simulation& simulation, ScriptEventSink& sink) = nullptr;
+    };
+
+    // A coroutine that runs on the simulation's ticks, see ScriptSystem for
+    // how scripts are started and scheduled. A script suspends on
+    //
+    //     co_await next_tick();
+    //     co_await ticks(n);
+    //     Event event = co_await event<Event>();
+    //
+    // and ends with co_return or by falling off its end. Scripts start
+    // suspended; frames come from get_script_frame_pool(), so starting and
+    // ending scripts does not go through the heap once the pool warmed up.
+    class Script {
+    public:
+        struct promise_type {
+            ScriptWait wait;
+
+            static void* operator new(size_t size) {
+                return get_script_frame_pool().allocate(size);
+            }
+
+            static void operator delete(void* frame, size_t size) {
+                get_script_frame_pool().free(frame, size);
+            }
+
+            Script get_return_object() {
+                return Script(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            // the scheduler destroys the frame once it sees the script is done
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {
+            }
+
+            void unhandled_exception() {
+                std::terminate();
+            }
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Script(Script&& other) noexcept
+            : handle_(std::exchange(other.handle_, nullptr))
+        {
+        }
+
+        Script& operator=(Script&& rhs) noexcept {
+            if (this != &rhs) {
+                reset();
+                handle_ = std::exchange(rhs.handle_, nullptr);
+            }
+
+            return *this;
+        }
+
+        Script(const Script&) = delete;
+        Script& operator=(const Script&) = delete;
+
+        ~Script() {
+            reset();
+        }
+
+        // hands the frame over to the caller, who destroys it
+        Handle release() {
+            return std::exchange(handle_, nullptr);
+        }
+
+    private:
+        explicit Script(Handle handle)
+            : handle_(handle)
+        {
+        }
+
+        void reset() {
+            if (handle_) {
+                handle_.destroy();
+                handle_ = nullptr;
+            }
+        }
+
+    private:
+        Handle handle_;
+    };
+
+    struct TickAwaiter {
+        uint64_t ticks;
+
+        bool await_ready() const noexcept {
+            return ticks == 0;
+        }
+
+        void await_suspend(Script::Handle handle) const noexcept {
+            handle.promise().wait = ScriptWait{ .ticks = ticks };
+        }
+
+        void await_resume() const noexcept {
+        }
+    };
+
+    // Resumes with the first Event emitted for the script's entity. Event needs
+    // an entity_index member; events come from Simulation::get_event_channel.
+    template<typename Event>
+    struct EventAwaiter {
+        Event event{};
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(Script::Handle handle) noexcept {
+            handle.promise().wait = ScriptWait {
+                .event_type_index = get_event_type_index<Event>(),
+                .event = &event,
+                .copy_event = [](void* target, const void* event) {
+                    *static_cast<Event*>(target) = *static_cast<const Event*>(event);
+                },
+                .drain_events = [](Simulation& simulation, ScriptEventSink& sink) {
+                    simulation.get_event_channel<Event>().drain([&](const Event& event) {
+                        sink.deliver(event.entity_index, &event);
+                    });
+                },
+            };
+        }
+
+        Event await_resume() const noexcept {
+            return event;
+        }
+    };
+
+    // resumes at the next update of the scheduler
+    inline TickAwaiter next_tick() {
+        return TickAwaiter{1};
+    }
+
+    // resumes count ticks from now; right away for 0
+    inline TickAwaiter ticks(uint64_t count) {
+        return TickAwaiter{count};
+    }
+
+    template<typename Event>
+    EventAwaiter<Event> event() {
+        return EventAwaiter<Event>{};
+    }
+
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include "entity/entity_database.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
+#include "events.h"
+#include "script.h"
+#include "simulation.h"
+#include "system.h"
+
+namespace entler {
+
+    // What a script touches when it runs. Scripts may read and write the
+    // components of their own entity and read the scene; a script that does
+    // more, e.g. writes other entities or adds and removes entities, is
+    // exclusive.
+    struct ScriptAccess {
+        Schema::ComponentMask reads;
+        Schema::ComponentMask writes;
+        bool                  exclusive = false;
+
+        bool conflicts_with(const ScriptAccess& other) const {
+            return (writes & (other.reads | other.writes)).any() || (other.writes & reads).any();
+        }
+    };
+
+    // Runs Scripts bound to entities. Every update resumes the scripts whose
+    // wait is over in batches: a batch holds scripts of different entities,
+    // or of the same entity when their access does not conflict, and resumes
+    // them in parallel; exclusive scripts run alone on the simulation thread.
+    // Ready scripts are resumed in the order they were started, so runs do not
+    // depend on the thread count.
+    //
+    // Scripts waiting for an event get the first one emitted for their entity
+    // since the last update; the system drains the channels of the event types
+    // scripts wait for, so add it after the systems that emit them. A script
+    // is cancelled, its frame destroyed, when its entity is removed.
+    class ScriptSystem : public System, public EntityObserver<Schema>, private ScriptEventSink {
+    public:
+        explicit ScriptSystem(EntityDatabase<Schema>& database)
+            : EntityObserver<Schema>(database)
+            , database_(database)
+        {
+        }
+
+        ~ScriptSystem() override {
+            for (Slot& slot: slots_) {
+                if (slot.handle) {
+                    slot.handle.destroy();
+                }
+            }
+        }
+
+        const char* get_name() const override {
+            return "ScriptSystem";
+        }
+
+        // starts script_function(handle of entity, args...) at the next update
+        template<typename... Params, typename... Args>
+        void start(Entity<Schema> entity, ScriptAccess access, Script (*script_function)(EntityHandle<Schema>, Params...), Args&&... args) {
+            Script::Handle handle = script_function(EntityHandle<Schema>(entity), std::forward<Args>(args)...).release();
+
+            uint32_t slot_index;
+            if (free_slot_indexes_.empty()) {
+                slot_index = static_cast<uint32_t>(slots_.size());
+                slots_.emplace_back();
+            }
+            else {
+                slot_index = free_slot_indexes_.back();
+                free_slot_indexes_.pop_back();
+            }
+
+            Slot& slot = slots_[slot_index];
+            slot.handle = handle;
+            slot.entity_id = entity.get_id();
+            slot.access = access;
+            entity_slot_indexes_[slot.entity_id].push_back(slot_index);
+            ready_.push_back(SlotRef{slot_index, slot.generation});
+            script_count_ += 1;
+            started_count_ += 1;
+        }
+
+        size_t update(Simulation& simulation) override {
+            auto& job_system = simulation.get_job_system();
+            uint64_t tick = simulation.get_tick_count();
+            updating_ = true;
+
+            // events emitted since the last update
+            for (draining_type_index_ = 0; draining_type_index_ < event_waiters_.size(); ++draining_type_index_) {
+                EventWaiters& waiters = event_waiters_[draining_type_index_];
+                if (!waiters.slot_refs.empty()) {
+                    waiters.drain_events(simulation, *this);
+                }
+            }
+
+            while (!timers_.empty() && timers_.front().wake_tick <= tick) {
+                std::pop_heap(timers_.begin(), timers_.end(), is_later);
+                ready_.push_back(timers_.back().slot_ref);
+                timers_.pop_back();
+            }
+
+            std::vector<SlotRef> ready = std::move(ready_);
+            ready_.clear();
+            ready.erase(std::remove_if(ready.begin(), ready.end(), [&](SlotRef slot_ref) {
+                return !is_current(slot_ref);
+            }), ready.end());
+            std::sort(ready.begin(), ready.end(), [](SlotRef lhs, SlotRef rhs) {
+                return lhs.slot_index < rhs.slot_index;
+            });
+
+            size_t first = 0;
+            while (first < ready.size()) {
+                size_t last = get_batch_end(ready, first);
+                auto resume = [&](size_t first_ready, size_t last_ready, size_t) {
+                    // an exclusive script earlier in the update may have removed the entity
+                    for (size_t ready_index = first_ready; ready_index < last_ready; ++ready_index) {
+                        if (is_current(ready[ready_index])) {
+                            slots_[ready[ready_index].slot_index].handle.resume();
+                        }
+                    }
+                };
+
+                if (last - first > 1) {
+                    job_system.parallel_for(last - first, grain_size, [&](size_t first_ready, size_t last_ready, size_t thread_index) {
+                        resume(first + first_ready, first + last_ready, thread_index);
+                    });
+                }
+                else {
+                    resume(first, last, 0);
+                }
+
+                for (size_t ready_index = first; ready_index < last; ++ready_index) {
+                    suspended(ready[ready_index], tick);
+                }
+
+                batch_count_ += 1;
+                first = last;
+            }
+
+            updating_ = false;
+            destroy_cancelled_scripts();
+
+            resumed_count_ += ready.size();
+            ready_.reserve(ready.size());
+            return ready.size();
+        }
+
+        void entity_removed(Entity<Schema> entity) override {
+            auto it = entity_slot_indexes_.find(entity.get_id());
+            if (it == entity_slot_indexes_.end()) {
+                return;
+            }
+
+            for (uint32_t slot_index: it->second) {
+                slots_[slot_index].cancelled = true;
+                cancelled_slot_indexes_.push_back(slot_index);
+            }
+            entity_slot_indexes_.erase(it);
+            for (EventWaiters& waiters: event_waiters_) {
+                waiters.slot_refs.erase(entity.get_id());
+            }
+
+            // a script may remove entities while it runs, including its own
+            if (!updating_) {
+                destroy_cancelled_scripts();
+            }
+        }
+
+        size_t get_script_count() const {
+            return script_count_;
+        }
+
+        // call from the thread that updates the system
+        void collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const {
+            std::string name(prefix);
+            auto add = [&](std::string_view suffix, auto value) {
+                snapshot.add(name + std::string(suffix), static_cast<int64_t>(value));
+            };
+
+            add("count", script_count_);
+            add("started", started_count_);
+            add("finished", finished_count_);
+            add("cancelled", cancelled_count_);
+            add("resumed", resumed_count_);
+            add("batches", batch_count_);
+            add("timers", timers_.size());
+            add("frame_pool.frames", get_script_frame_pool().get_allocated_count());
+            add("frame_pool.pages", get_script_frame_pool().get_page_count());
+        }
+
+        // Robots that bump into something stop for a few ticks, then head off
+        // to their right. Needs a body component.
+        static Script robot_script(EntityHandle<Schema> self) {
+            while (true) {
+                co_await event<CollisionEvent>();
+
+                // the movement system bounced the robot back; stand still
+                I32Vec3 velocity = self.get().get_component<ComponentType::body>().velocity;
+                self.get().get_component<ComponentType::body>().velocity = I32Vec3{};
+                co_await ticks(robot_wait_ticks);
+
+                self.get().get_component<ComponentType::body>().velocity = I32Vec3{velocity.y, -velocity.x, velocity.z};
+            }
+        }
+
+        static ScriptAccess get_robot_script_access() {
+            constexpr auto body_mask = Schema::component_mask_v<ComponentType::body>;
+            return ScriptAccess{ .reads = body_mask, .writes = body_mask };
+        }
+
+    private:
+        static constexpr size_t   grain_size = 256;
+        static constexpr uint64_t robot_wait_ticks = 3;
+
+        struct Slot {
+            Script::Handle handle;
+            EntityId       entity_id = -1;
+            ScriptAccess   access;
+            uint32_t       generation = 0;   // bumped when the slot is freed, so stale refs can be told apart
+            bool           cancelled = false;
+        };
+
+        struct SlotRef {
+            uint32_t slot_index;
+            uint32_t generation;
+        };
+
+        struct Timer {
+            uint64_t wake_tick;
+            SlotRef  slot_ref;
+        };
+
+        struct EventWaiters {
+            void (*drain_events)(Simulation& simulation, ScriptEventSink& sink) = nullptr;
+            std::unordered_map<EntityId, std::vector<SlotRef>> slot_refs;
+        };
+
+        // orders the timer heap earliest first, ties in start order
+        static bool is_later(const Timer& lhs, const Timer& rhs) {
+            if (lhs.wake_tick != rhs.wake_tick) {
+                return lhs.wake_tick > rhs.wake_tick;
+            }
+
+            return lhs.slot_ref.slot_index > rhs.slot_ref.slot_index;
+        }
+
+        bool is_current(SlotRef slot_ref) const {
+            const Slot& slot = slots_[slot_ref.slot_index];
+            return slot.generation == slot_ref.generation && slot.handle && !slot.cancelled;
+        }
+
+        // the end of the batch that starts at ready[first]: an exclusive script runs alone,
+        // and a script that conflicts with one of its entity's scripts already in the batch
+        // starts the next one
+        size_t get_batch_end(const std::vector<SlotRef>& ready, size_t first) {
+            if (slots_[ready[first].slot_index].access.exclusive) {
+                return first + 1;
+            }
+
+            batch_accesses_.clear();
+            size_t last = first;
+            for (; last < ready.size(); ++last) {
+                const Slot& slot = slots_[ready[last].slot_index];
+                if (slot.access.exclusive) {
+                    break;
+                }
+
+                auto [it, inserted] = batch_accesses_.try_emplace(slot.entity_id, slot.access);
+                if (!inserted) {
+                    if (slot.access.conflicts_with(it->second)) {
+                        break;
+                    }
+
+                    it->second.reads |= slot.access.reads;
+                    it->second.writes |= slot.access.writes;
+                }
+            }
+
+            return last;
+        }
+
+        // files a script that just returned from resume() under what it waits for
+        void suspended(SlotRef slot_ref, uint64_t tick) {
+            Slot& slot = slots_[slot_ref.slot_index];
+            if (slot.cancelled) {
+                return;
+            }
+
+            if (slot.handle.done()) {
+                auto& slot_indexes = entity_slot_indexes_[slot.entity_id];
+                slot_indexes.erase(std::find(slot_indexes.begin(), slot_indexes.end(), slot_ref.slot_index));
+                if (slot_indexes.empty()) {
+                    entity_slot_indexes_.erase(slot.entity_id);
+                }
+
+                free_slot(slot_ref.slot_index);
+                finished_count_ += 1;
+                return;
+            }
+
+            const ScriptWait& wait = slot.handle.promise().wait;
+            if (wait.ticks) {
+                timers_.push_back(Timer{tick + wait.ticks, slot_ref});
+                std::push_heap(timers_.begin(), timers_.end(), is_later);
+                return;
+            }
+
+            if (wait.event_type_index >= event_waiters_.size()) {
+                event_waiters_.resize(wait.event_type_index + 1);
+            }
+
+            EventWaiters& waiters = event_waiters_[wait.event_type_index];
+            waiters.drain_events = wait.drain_events;
+            waiters.slot_refs[slot.entity_id].push_back(slot_ref);
+        }
+
+        // hands an event of the type being drained to the scripts of its entity waiting for one
+        void deliver(size_t entity_index, const void* event) override {
+            if (!database_.is_live(entity_index)) {
+                return;
+            }
+
+            EventWaiters& waiters = event_waiters_[draining_type_index_];
+            auto it = waiters.slot_refs.find(database_.get_entity(entity_index).get_id());
+            if (it == waiters.slot_refs.end()) {
+                return;
+            }
+
+            for (SlotRef slot_ref: it->second) {
+                if (is_current(slot_ref)) {
+                    const ScriptWait& wait = slots_[slot_ref.slot_index].handle.promise().wait;
+                    wait.copy_event(wait.event, event);
+                    ready_.push_back(slot_ref);
+                }
+            }
+
+            waiters.slot_refs.erase(it);
+        }
+
+        void destroy_cancelled_scripts() {
+            for (uint32_t slot_index: cancelled_slot_indexes_) {
+                free_slot(slot_index);
+                cancelled_count_ += 1;
+            }
+
+            cancelled_slot_indexes_.clear();
+        }
+
+        void free_slot(uint32_t slot_index) {
+            Slot& slot = slots_[slot_index];
+            slot.handle.destroy();
+            slot.handle = nullptr;
+            slot.cancelled = false;
+            slot.generation += 1;
+            free_slot_indexes_.push_back(slot_index);
+            script_count_ -= 1;
+        }
+
+    private:
+        EntityDatabase<Schema>&                             database_;
+        std::vector<Slot>                                   slots_;
+        std::vector<uint32_t>                               free_slot_indexes_;
+        std::unordered_map<EntityId, std::vector<uint32_t>> entity_slot_indexes_;
+        std::vector<SlotRef>                                ready_;    // resumed at the next update
+        std::vector<Timer>                                  timers_;   // heap ordered by is_later
+        std::vector<EventWaiters>                           event_waiters_;   // by event type index
+        size_t                                              draining_type_index_ = 0;
+        std::vector<uint32_t>                               cancelled_slot_indexes_;
+        std::unordered_map<EntityId, ScriptAccess>          batch_accesses_;
+        bool                                                updating_ = false;
+
+        size_t                                              script_count_ = 0;
+        uint64_t                                            started_count_ = 0;
+        uint64_t                                            finished_count_ = 0;
+        uint64_t                                            cancelled_count_ = 0;
+        uint64_t                                            resumed_count_ = 0;
+        uint64_t                                            batch_count_ = 0;
+    };
+
+}
@@ -0,0 +1,510 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdlib>
+#include <cassert>
+#include "entity/entity_database.h"
+#include "util/job_system.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
+#include "util/event_channel.h"
+#include "util/spsc_queue.h"
+#include "energy_system.h"
+#include "events.h"
+#include "movement_system.h"
+#include "schema.h"
+#include "scene.h"
+#include "state_hash.h"
+
+namespace entler {
+
+    // Splits the map into a grid of rectangular regions, each with its own
+    // EntityDatabase and Scene, and ticks the regions in parallel. Every region
+    // keeps a ghost halo with the occupancy of the neighbouring tiles within
+    // halo_width, so movement can be proposed without touching other regions.
+    //
+    // A tick runs in three phases separated by the job system's barrier:
+    //  1. propose: apply the ghost updates of the last tick, then claim target
+    //     tiles; claims on a neighbour's tile carry a snapshot of the entity and
+    //     are sent to the neighbour
+    //  2. resolve: every region resolves the claims on its own tiles with the
+    //     same rule as MovementSystem, adopts the entities that won a move into
+    //     it and sends a verdict back for every received claim
+    //  3. commit: remove the entities that moved away, bounce the ones that lost,
+    //     send the changed edge tiles to the neighbours' halos and sweep the
+    //     energy of the entities the region holds now
+    // Regions only talk through single-producer single-consumer queues, one per
+    // neighbour and message kind, and the result is identical to a single
+    // Simulation running MovementSystem and EnergySystem.
+    class ShardedSimulation {
+    public:
+        ShardedSimulation(size_t width, size_t height, size_t shard_columns, size_t shard_rows, size_t thread_count = 1, int32_t halo_width = 1)
+            : width_(width)
+            , height_(height)
+            , shard_columns_(shard_columns)
+            , shard_rows_(shard_rows)
+            , halo_width_(halo_width)
+            , job_system_(thread_count)
+            , tick_count_(0)
+        {
+            assert(shard_columns > 0 && shard_rows > 0);
+            assert(halo_width > 0);
+
+            // regions have to be at least as large as the halo so halos only reach adjacent regions
+            shard_width_ = width / shard_columns;
+            shard_height_ = height / shard_rows;
+            assert(shard_width_ >= static_cast<size_t>(halo_width));
+            assert(shard_height_ >= static_cast<size_t>(halo_width));
+
+            for (size_t row = 0; row < shard_rows; ++row) {
+                for (size_t column = 0; column < shard_columns; ++column) {
+                    I32Vec3 origin {
+                        static_cast<int32_t>(column * shard_width_),
+                        static_cast<int32_t>(row * shard_height_),
+                        0
+                    };
+
+                    // the last column and row take the remainder
+                    size_t shard_width = column + 1 == shard_columns ? width - column * shard_width_ : shard_width_;
+                    size_t shard_height = row + 1 == shard_rows ? height - row * shard_height_ : shard_height_;
+                    shards_.push_back(std::make_unique<Shard>(shards_.size(), column, row, origin, shard_width, shard_height, halo_width));
+                }
+            }
+
+            for (auto& shard: shards_) {
+                for (auto& other_shard: shards_) {
+                    bool adjacent =
+                        std::max(shard->column, other_shard->column) - std::min(shard->column, other_shard->column) <= 1 &&
+                        std::max(shard->row, other_shard->row) - std::min(shard->row, other_shard->row) <= 1;
+                    if (other_shard != shard && adjacent) {
+                        shard->neighbour_shard_indexes.push_back(other_shard->index);
+                    }
+                }
+            }
+
+            metrics_.add_collector([this](MetricsSnapshot& snapshot) {
+                snapshot.add("simulation.ticks", static_cast<int64_t>(tick_count_));
+                snapshot.add("sharded.shards", static_cast<int64_t>(shards_.size()));
+                for (auto& shard: shards_) {
+                    std::string prefix = "shard." + std::to_string(shard->index) + ".";
+                    snapshot.add(prefix + "migrations_in", static_cast<int64_t>(shard->migrations_in));
+                    snapshot.add(prefix + "migrations_out", static_cast<int64_t>(shard->migrations_out));
+                    snapshot.add(prefix + "ghost_updates", static_cast<int64_t>(shard->ghost_update_count));
+                    shard->database.collect_metrics(snapshot, prefix + "database.");
+                    shard->scene.collect_metrics(snapshot, prefix + "scene.");
+                }
+            });
+        }
+
+        // adds an entity to the region that owns its position and places it in that region's scene;
+        // only call between ticks
+        template<ComponentType... component_types>
+        Entity<Schema> add_object(Schema::Component<component_types>... components) {
+            static_assert(((component_types == ComponentType::position) || ...), "Objects need a position");
+
+            I32Vec3 position;
+            ([&]() {
+                if constexpr (component_types == ComponentType::position) {
+                    position = components.value;
+                }
+            }(), ...);
+
+            Shard& shard = *shards_[find_shard(position)];
+            Entity<Schema> entity = shard.database.add_entity(std::move(components)...);
+            shard.scene.add_object(entity);
+
+            for (size_t neighbour_shard_index: shard.neighbour_shard_indexes) {
+                Shard& neighbour_shard = *shards_[neighbour_shard_index];
+                if (neighbour_shard.ghost_halo.covers(position)) {
+                    neighbour_shard.ghost_halo.set_occupied(position, true);
+                }
+            }
+
+            return entity;
+        }
+
+        std::optional<Entity<Schema>> get_object(I32Vec3 position) {
+            return shards_[find_shard(position)]->scene.get_object(position);
+        }
+
+        // runs one movement and energy tick in every region; returns the number of entities updated
+        size_t tick() {
+            ENTLER_PROFILE_ZONE("ShardedSimulation::tick");
+
+            for_each_shard([&](Shard& shard) {
+                propose(shard);
+            });
+
+            for_each_shard([&](Shard& shard) {
+                resolve(shard);
+            });
+
+            for_each_shard([&](Shard& shard) {
+                commit(shard);
+            });
+
+            size_t updated_entity_count = 0;
+            for (auto& shard: shards_) {
+                updated_entity_count += shard->updated_entity_count;
+            }
+
+            tick_count_ += 1;
+            return updated_entity_count;
+        }
+
+        // equals compute_state_hash of a single database holding the same objects
+        uint64_t compute_state_hash() {
+            uint64_t state_hash = 0;
+            for (auto& shard: shards_) {
+                state_hash += entler::compute_state_hash(shard->database);
+            }
+
+            return state_hash;
+        }
+
+        uint64_t get_tick_count() const {
+            return tick_count_;
+        }
+
+        size_t get_shard_count() const {
+            return shards_.size();
+        }
+
+        size_t find_shard(I32Vec3 position) const {
+            assert(contains(position));
+            size_t column = std::min(static_cast<size_t>(position.x) / shard_width_, shard_columns_ - 1);
+            size_t row = std::min(static_cast<size_t>(position.y) / shard_height_, shard_rows_ - 1);
+            return column + row * shard_columns_;
+        }
+
+        EntityDatabase<Schema>& get_database(size_t shard_index) {
+            return shards_[shard_index]->database;
+        }
+
+        Scene& get_scene(size_t shard_index) {
+            return shards_[shard_index]->scene;
+        }
+
+        JobSystem& get_job_system() {
+            return job_system_;
+        }
+
+        MetricsRegistry& get_metrics() {
+            return metrics_;
+        }
+
+        bool contains(I32Vec3 position) const {
+            return position.x >= 0 && static_cast<size_t>(position.x) < width_ &&
+                   position.y >= 0 && static_cast<size_t>(position.y) < height_;
+        }
+
+    private:
+        static constexpr size_t min_vacuum_tombstone_count = 1024;
+
+        // occupancy of the tiles of the neighbouring regions within halo_width of a region
+        class GhostHalo {
+        public:
+            GhostHalo(I32Vec3 origin, size_t width, size_t height, int32_t halo_width)
+                : origin_(origin - I32Vec3{halo_width, halo_width, 0})
+                , inner_origin_(origin)
+                , width_(width + 2 * halo_width)
+                , height_(height + 2 * halo_width)
+                , inner_width_(width)
+                , inner_height_(height)
+                , occupied_(width_ * height_, 0)
+            {
+            }
+
+            // true for tiles in the halo, not in the region itself
+            bool covers(I32Vec3 position) const {
+                int32_t x = position.x - origin_.x;
+                int32_t y = position.y - origin_.y;
+                if (x < 0 || static_cast<size_t>(x) >= width_ || y < 0 || static_cast<size_t>(y) >= height_) {
+                    return false;
+                }
+
+                int32_t inner_x = position.x - inner_origin_.x;
+                int32_t inner_y = position.y - inner_origin_.y;
+                return inner_x < 0 || static_cast<size_t>(inner_x) >= inner_width_ || inner_y < 0 || static_cast<size_t>(inner_y) >= inner_height_;
+            }
+
+            bool is_occupied(I32Vec3 position) const {
+                assert(covers(position));
+                return occupied_[get_offset(position)] != 0;
+            }
+
+            void set_occupied(I32Vec3 position, bool occupied) {
+                assert(covers(position));
+                occupied_[get_offset(position)] = occupied;
+            }
+
+        private:
+            size_t get_offset(I32Vec3 position) const {
+                return (position.x - origin_.x) + ((position.y - origin_.y) * width_);
+            }
+
+        private:
+            I32Vec3              origin_;
+            I32Vec3              inner_origin_;
+            size_t               width_;
+            size_t               height_;
+            size_t               inner_width_;
+            size_t               inner_height_;
+            std::vector<uint8_t> occupied_;
+        };
+
+        // a move onto a tile; target_offset and source_offset are row-major on the whole map
+        struct Claim {
+            size_t  target_offset;
+            size_t  source_offset;
+            I32Vec3 target;
+            size_t  entity_index;   // in the database of the region the entity comes from
+            size_t  migration_index = SIZE_MAX;   // into Shard::migrations for claims from neighbours
+        };
+
+        struct Migration {
+            Claim                  claim;
+            size_t                 source_shard_index;
+            EntitySnapshot<Schema> entity;
+        };
+
+        struct Verdict {
+            size_t entity_index;
+            bool   accepted;
+        };
+
+        struct GhostUpdate {
+            I32Vec3 position;
+            bool    occupied;
+        };
+
+        // the queues a region receives from one neighbour
+        struct Inbox {
+            SpscQueue<Migration>   migrations;
+            SpscQueue<Verdict>     verdicts;
+            SpscQueue<GhostUpdate> ghost_updates;
+        };
+
+        struct Shard {
+            Shard(size_t index, size_t column, size_t row, I32Vec3 origin, size_t width, size_t height, int32_t halo_width)
+                : index(index)
+                , column(column)
+                , row(row)
+                , scene(database, origin, width, height)
+                , ghost_halo(origin, width, height, halo_width)
+            {
+            }
+
+            size_t                    index;
+            size_t                    column;
+            size_t                    row;
+            EntityDatabase<Schema>    database;
+            Scene                     scene;
+            GhostHalo                 ghost_halo;
+            std::vector<size_t>       neighbour_shard_indexes;
+
+            // indexed by the sender's position relative to this region, see get_inbox
+            Inbox                     inboxes[9];
+
+            std::vector<Claim>        claims;
+            std::vector<Migration>    migrations;
+            std::vector<GhostUpdate>  tile_changes;
+            EventChannel<EnergyEvent> energy_events;   // dropped at the end of the tick
+            size_t                    updated_entity_count = 0;
+            uint64_t                  migrations_in = 0;
+            uint64_t                  migrations_out = 0;
+            uint64_t                  ghost_update_count = 0;
+        };
+
+        template<typename F>
+        void for_each_shard(F&& f) {
+            job_system_.parallel_for(shards_.size(), 1, [&](size_t first, size_t last, size_t) {
+                for (size_t shard_index = first; shard_index < last; ++shard_index) {
+                    f(*shards_[shard_index]);
+                }
+            });
+        }
+
+        Inbox& get_inbox(const Shard& sender, Shard& receiver) {
+            size_t column = sender.column + 1 - receiver.column;
+            size_t row = sender.row + 1 - receiver.row;
+            assert(column < 3 && row < 3);
+            return receiver.inboxes[column + row * 3];
+        }
+
+        size_t get_offset(I32Vec3 position) const {
+            return static_cast<size_t>(position.x) + static_cast<size_t>(position.y) * width_;
+        }
+
+        void propose(Shard& shard) {
+            ENTLER_PROFILE_ZONE("ShardedSimulation::propose");
+
+            GhostUpdate ghost_update;
+            for (Inbox& inbox: shard.inboxes) {
+                while (inbox.ghost_updates.try_pop(ghost_update)) {
+                    shard.ghost_halo.set_occupied(ghost_update.position, ghost_update.occupied);
+                    shard.ghost_update_count += 1;
+                }
+            }
+
+            constexpr auto component_mask = Schema::component_mask_v<
+                ComponentType::position,
+                ComponentType::body
+            >;
+
+            shard.claims.clear();
+            shard.updated_entity_count = 0;
+            shard.database.for_each_entity(component_mask, [&](Entity<Schema> entity) {
+                auto& position = std::as_const(entity).get_component<ComponentType::position>();
+                auto& body = entity.get_component<ComponentType::body>();
+                shard.updated_entity_count += 1;
+
+                if (body.velocity == I32Vec3{}) {
+                    return;
+                }
+
+                // the halo has to reach every tile a move can target
+                assert(std::abs(body.velocity.x) <= halo_width_ && std::abs(body.velocity.y) <= halo_width_);
+
+                I32Vec3 target = position.value + body.velocity;
+                bool blocked = !contains(target);
+                if (!blocked) {
+                    blocked = shard.scene.contains(target) ? shard.scene.get_object(target).has_value() : shard.ghost_halo.is_occupied(target);
+                }
+                if (blocked) {
+                    body.velocity = I32Vec3{} - body.velocity;
+                    return;
+                }
+
+                Claim claim {
+                    .target_offset = get_offset(target),
+                    .source_offset = get_offset(position.value),
+                    .target = target,
+                    .entity_index = entity.get_index(),
+                };
+
+                if (shard.scene.contains(target)) {
+                    shard.claims.push_back(claim);
+                    return;
+                }
+
+                Shard& target_shard = *shards_[find_shard(target)];
+                get_inbox(shard, target_shard).migrations.push(Migration {
+                    .claim = claim,
+                    .source_shard_index = shard.index,
+                    .entity = shard.database.take_snapshot(entity),
+                });
+            });
+        }
+
+        void resolve(Shard& shard) {
+            ENTLER_PROFILE_ZONE("ShardedSimulation::resolve");
+
+            shard.migrations.clear();
+            Migration migration;
+            for (Inbox& inbox: shard.inboxes) {
+                while (inbox.migrations.try_pop(migration)) {
+                    migration.claim.migration_index = shard.migrations.size();
+                    shard.claims.push_back(migration.claim);
+                    shard.migrations.push_back(std::move(migration));
+                }
+            }
+
+            sort_move_claims(shard.claims);
+
+            for (size_t claim_index = 0; claim_index < shard.claims.size(); ++claim_index) {
+                const Claim& claim = shard.claims[claim_index];
+                bool accepted = claim_index == 0 || shard.claims[claim_index - 1].target_offset != claim.target_offset;
+
+                if (claim.migration_index != SIZE_MAX) {
+                    Migration& migration = shard.migrations[claim.migration_index];
+                    if (accepted) {
+                        migration.entity.get_component<ComponentType::position>().value = claim.target;
+                        shard.scene.add_object(shard.database.add_entity(migration.entity));
+                        shard.tile_changes.push_back(GhostUpdate{claim.target, true});
+                        shard.migrations_in += 1;
+                    }
+
+                    Shard& source_shard = *shards_[migration.source_shard_index];
+                    get_inbox(shard, source_shard).verdicts.push(Verdict{claim.entity_index, accepted});
+                    continue;
+                }
+
+                Entity<Schema> entity = shard.database.get_entity(claim.entity_index);
+                if (!accepted) {
+                    auto& body = entity.get_component<ComponentType::body>();
+                    body.velocity = I32Vec3{} - body.velocity;
+                    continue;
+                }
+
+                I32Vec3 source = std::as_const(entity).get_component<ComponentType::position>().value;
+                shard.scene.move_object(entity, claim.target);
+                shard.tile_changes.push_back(GhostUpdate{source, false});
+                shard.tile_changes.push_back(GhostUpdate{claim.target, true});
+            }
+        }
+
+        void commit(Shard& shard) {
+            ENTLER_PROFILE_ZONE("ShardedSimulation::commit");
+
+            Verdict verdict;
+            for (Inbox& inbox: shard.inboxes) {
+                while (inbox.verdicts.try_pop(verdict)) {
+                    Entity<Schema> entity = shard.database.get_entity(verdict.entity_index);
+                    if (verdict.accepted) {
+                        I32Vec3 source = std::as_const(entity).get_component<ComponentType::position>().value;
+                        shard.database.remove_entity(entity);
+                        shard.tile_changes.push_back(GhostUpdate{source, false});
+                        shard.migrations_out += 1;
+                    }
+                    else {
+                        auto& body = entity.get_component<ComponentType::body>();
+                        body.velocity = I32Vec3{} - body.velocity;
+                    }
+                }
+            }
+
+            // a tile changes at most once per tick: targets were empty and sources occupied at its start
+            for (const GhostUpdate& tile_change: shard.tile_changes) {
+                for (size_t neighbour_shard_index: shard.neighbour_shard_indexes) {
+                    Shard& neighbour_shard = *shards_[neighbour_shard_index];
+                    if (neighbour_shard.ghost_halo.covers(tile_change.position)) {
+                        get_inbox(shard, neighbour_shard).ghost_updates.push(tile_change);
+                    }
+                }
+            }
+            shard.tile_changes.clear();
+
+            // migrants were adopted in resolve and the entities that left are gone, so every
+            // entity is swept once, by the region it ends the tick in
+            shard.database.track_component_owners<ComponentType::energy>();
+            EnergySystem::update_slots(shard.database, 0, shard.database.get_component_table<ComponentType::energy>().size(), shard.energy_events);
+            shard.energy_events.clear();
+
+            size_t tombstone_count = shard.database.get_tombstone_count();
+            if (tombstone_count >= min_vacuum_tombstone_count && tombstone_count * 4 >= shard.database.get_entity_table_size()) {
+                shard.database.vacuum();
+            }
+
+            shard.database.swap_component_buffers();
+        }
+
+    private:
+        size_t                              width_;
+        size_t                              height_;
+        size_t                              shard_columns_;
+        size_t                              shard_rows_;
+        size_t                              shard_width_;
+        size_t                              shard_height_;
+        int32_t                             halo_width_;
+        std::vector<std::unique_ptr<Shard>> shards_;
+        JobSystem                           job_system_;
+        MetricsRegistry                     metrics_;
+        uint64_t                            tick_count_;
+    };
+
+}
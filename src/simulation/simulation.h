@@ -1,21 +1,212 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cassert>
 #include "entity/entity_database.h"
+#include "util/event_channel.h"
+#include "util/job_system.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
 #include "schema.h"
 #include "scene.h"
+#include "state_hash.h"
+#include "system.h"
+#include "update_policy.h"
 
 namespace entler {
 
     class Simulation {
     public:
-        Simulation(size_t width, size_t height)
+        Simulation(size_t width, size_t height, size_t thread_count = 1)
             : scene_(database_, width, height)
+            , job_system_(thread_count)
+            , tick_count_(0)
         {
+            metrics_.add_collector([this](MetricsSnapshot& snapshot) {
+                snapshot.add("simulation.ticks", static_cast<int64_t>(tick_count_));
+
+                uint64_t emitted_event_count = 0;
+                uint64_t dropped_event_count = 0;
+                for (auto& event_channel: event_channels_) {
+                    if (event_channel) {
+                        emitted_event_count += event_channel->get_emitted_count();
+                        dropped_event_count += event_channel->get_dropped_count();
+                    }
+                }
+                snapshot.add("simulation.events.emitted", static_cast<int64_t>(emitted_event_count));
+                snapshot.add("simulation.events.dropped", static_cast<int64_t>(dropped_event_count));
+
+                database_.collect_metrics(snapshot, "database.");
+                scene_.collect_metrics(snapshot, "scene.");
+
+                for (const ScheduledSystem& scheduled_system: systems_) {
+                    std::string name = std::string("systems.") + scheduled_system.system->get_name();
+                    snapshot.add(name + ".interval", static_cast<int64_t>(scheduled_system.interval));
+                    snapshot.add(name + ".updates", static_cast<int64_t>(scheduled_system.update_count));
+                    snapshot.add(name + ".update.last_ns", static_cast<int64_t>(scheduled_system.last_update_ns));
+                }
+            });
+        }
+
+        // systems run in the order they were added; policies that update a slice of the
+        // entities per tick need a system that can_update_slices()
+        void add_system(std::unique_ptr<System> system, UpdatePolicy policy = {}) {
+            assert(policy.interval > 0 && policy.interval <= policy.max_interval);
+            assert(!policy.slices_entities() || system->can_update_slices());
+            assert(!policy.budget_ns || policy.slices_entities());
+
+            systems_.push_back(ScheduledSystem{std::move(system), policy, policy.interval});
+        }
+
+        // runs every system that is due once; returns the number of entities they updated
+        size_t tick() {
+            ENTLER_PROFILE_ZONE("Simulation::tick");
+
+            size_t updated_entity_count = 0;
+            for (ScheduledSystem& scheduled_system: systems_) {
+                const UpdatePolicy& policy = scheduled_system.policy;
+                if (policy.schedule == UpdateSchedule::every_nth_tick && tick_count_ % scheduled_system.interval != 0) {
+                    continue;
+                }
+
+                ENTLER_PROFILE_ZONE(scheduled_system.system->get_name());
+
+                auto start = std::chrono::steady_clock::now();
+                update_filter_ = UpdateFilter(policy.schedule, scheduled_system.interval, tick_count_, scene_.get_area_of_interest(), policy.near_radius);
+                updated_entity_count += scheduled_system.system->update(*this);
+                update_filter_ = UpdateFilter();
+                auto stop = std::chrono::steady_clock::now();
+
+                scheduled_system.last_update_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+                scheduled_system.update_count += 1;
+                if (policy.budget_ns) {
+                    adapt_interval(scheduled_system);
+                }
+            }
+
+            // events refer to entity indexes, so they must not outlive the tick
+            for (auto& event_channel: event_channels_) {
+                if (event_channel) {
+                    event_channel->clear();
+                }
+            }
+
+            // compact once removed entities make up a sizable part of the tables; not while a
+            // checkpoint is being written, as vacuum would have to copy whatever it has not yet.
+            // every spatial_sort_interval ticks it compacts regardless, sorting by location
+            size_t tombstone_count = database_.get_tombstone_count();
+            if (spatial_sort_interval_ && (tick_count_ + 1) % spatial_sort_interval_ == 0 && !database_.has_checkpoint()) {
+                scene_.sort_storage();
+            }
+            else if (tombstone_count >= min_vacuum_tombstone_count && tombstone_count * 4 >= database_.get_entity_table_size() && !database_.has_checkpoint()) {
+                database_.vacuum();
+            }
+
+            database_.swap_component_buffers();
+
+            tick_count_ += 1;
+            return updated_entity_count;
+        }
+
+        // the channel for Event, created on first use; events emitted by a system can be
+        // drained by the systems after it in the same tick and are dropped at its end.
+        // Look channels up outside of parallel code and keep the reference.
+        template<typename Event>
+        EventChannel<Event>& get_event_channel() {
+            size_t event_type_index = get_event_type_index<Event>();
+            if (event_type_index >= event_channels_.size()) {
+                event_channels_.resize(event_type_index + 1);
+            }
+
+            auto& event_channel = event_channels_[event_type_index];
+            if (!event_channel) {
+                event_channel = std::make_unique<EventChannel<Event>>();
+            }
+
+            return static_cast<EventChannel<Event>&>(*event_channel);
+        }
+
+        uint64_t compute_state_hash() {
+            return entler::compute_state_hash(database_);
+        }
+
+        uint64_t get_tick_count() const {
+            return tick_count_;
+        }
+
+        // continues counting at tick_count, e.g. after restoring a checkpoint, so slices of
+        // update policies line up with the run it was taken from
+        void set_tick_count(uint64_t tick_count) {
+            tick_count_ = tick_count;
+        }
+
+        // sorts the storage by location, see Scene::sort_storage, every interval ticks; 0 never does.
+        // Systems that sweep the scene block by block then walk the tables in order.
+        void set_spatial_sort_interval(uint64_t interval) {
+            spatial_sort_interval_ = interval;
+        }
+
+        // the entities the running system should update this tick under its UpdatePolicy;
+        // outside of updates it includes every entity
+        const UpdateFilter& get_update_filter() const {
+            return update_filter_;
+        }
+
+        EntityDatabase<Schema>& get_database() {
+            return database_;
+        }
+
+        Scene& get_scene() {
+            return scene_;
+        }
+
+        JobSystem& get_job_system() {
+            return job_system_;
+        }
+
+        MetricsRegistry& get_metrics() {
+            return metrics_;
         }
 
     private:
-        EntityDatabase<Schema> database_;
-        Scene                  scene_;
+        static constexpr size_t min_vacuum_tombstone_count = 1024;
+
+        struct ScheduledSystem {
+            std::unique_ptr<System> system;
+            UpdatePolicy            policy;
+            uint32_t                interval;   // current, adapted to the budget if there is one
+            uint64_t                update_count = 0;
+            uint64_t                last_update_ns = 0;
+        };
+
+        // Updating a slice costs about 1/interval of updating every entity, so an
+        // update over budget doubles the interval. One that would still fit with
+        // room to spare at half the interval halves it; the gap between the two
+        // keeps the interval from flapping.
+        static void adapt_interval(ScheduledSystem& scheduled_system) {
+            const UpdatePolicy& policy = scheduled_system.policy;
+            uint64_t update_ns = scheduled_system.last_update_ns;
+            if (update_ns > policy.budget_ns) {
+                scheduled_system.interval = std::min(scheduled_system.interval * 2, policy.max_interval);
+            }
+            else if (update_ns * 8 < policy.budget_ns * 3) {
+                scheduled_system.interval = std::max(scheduled_system.interval / 2, policy.interval);
+            }
+        }
+
+        EntityDatabase<Schema>                         database_;
+        Scene                                          scene_;
+        JobSystem                                      job_system_;
+        MetricsRegistry                                metrics_;
+        std::vector<ScheduledSystem>                   systems_;
+        UpdateFilter                                   update_filter_;
+        std::vector<std::unique_ptr<EventChannelBase>> event_channels_;
+        uint64_t                                       tick_count_;
+        uint64_t                                       spatial_sort_interval_ = 0;
     };
 
 }
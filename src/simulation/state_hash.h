@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include "entity/entity_database.h"
+#include "schema.h"
+
+namespace entler {
+
+    namespace detail {
+
+        inline uint64_t mix_state_hash(uint64_t hash, uint64_t value) {
+            // splitmix64 finalizer over the running value
+            hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+            hash ^= hash >> 30;
+            hash *= 0xbf58476d1ce4e5b9ull;
+            hash ^= hash >> 27;
+            hash *= 0x94d049bb133111ebull;
+            hash ^= hash >> 31;
+            return hash;
+        }
+
+        inline uint64_t mix_state_hash(uint64_t hash, I32Vec3 value) {
+            hash = mix_state_hash(hash, static_cast<uint32_t>(value.x));
+            hash = mix_state_hash(hash, static_cast<uint32_t>(value.y));
+            return mix_state_hash(hash, static_cast<uint32_t>(value.z));
+        }
+
+    }
+
+    // Hashes the type, position, body, energy and behavior state of every
+    // object. Entities are combined by addition, and entity ids are left out,
+    // so databases holding the same objects in a different order, or split
+    // across shards, hash the same; sum the hashes of the shards to compare
+    // them with a single database.
+    inline uint64_t compute_state_hash(EntityDatabase<Schema>& database) {
+        constexpr auto component_mask = Schema::component_mask_v<
+            ComponentType::object_type,
+            ComponentType::position
+        >;
+
+        uint64_t state_hash = 0;
+        database.for_each_entity(component_mask, SleepingEntities::include, [&](Entity<Schema> entity) {
+            const Entity<Schema>& const_entity = entity;
+
+            uint64_t hash = 0;
+            hash = detail::mix_state_hash(hash, static_cast<uint64_t>(const_entity.get_component<ComponentType::object_type>().type));
+            hash = detail::mix_state_hash(hash, const_entity.get_component<ComponentType::position>().value);
+            if (const_entity.has_component<ComponentType::body>()) {
+                auto& body = const_entity.get_component<ComponentType::body>();
+                hash = detail::mix_state_hash(hash, body.velocity);
+                hash = detail::mix_state_hash(hash, body.momentum);
+            }
+            if (const_entity.has_component<ComponentType::energy>()) {
+                auto& energy = const_entity.get_component<ComponentType::energy>();
+                hash = detail::mix_state_hash(hash, static_cast<uint32_t>(energy.value));
+                hash = detail::mix_state_hash(hash, static_cast<uint32_t>(energy.capacity));
+                hash = detail::mix_state_hash(hash, static_cast<uint32_t>(energy.recharge_rate));
+            }
+            if (const_entity.has_component<ComponentType::behavior>()) {
+                auto& behavior = const_entity.get_component<ComponentType::behavior>();
+                hash = detail::mix_state_hash(hash, behavior.tree_index);
+                hash = detail::mix_state_hash(hash, behavior.state.running_node);
+                hash = detail::mix_state_hash(hash, behavior.state.running_ticks);
+            }
+
+            state_hash += hash;
+        });
+
+        return state_hash;
+    }
+
+}
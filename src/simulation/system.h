@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace entler {
+
+    class Simulation;
+
+    class System {
+    public:
+        virtual ~System() = default;
+
+        // used to label the system in traces and reports
+        virtual const char* get_name() const = 0;
+
+        // runs one tick of the system; returns the number of entities it updated
+        virtual size_t update(Simulation& simulation) = 0;
+
+        // whether update() skips the entities Simulation::get_update_filter() leaves out,
+        // which round_robin and distance_lod policies need
+        virtual bool can_update_slices() const {
+            return false;
+        }
+    };
+
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <optional>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+#include "entity/entity_database.h"
+#include "util/profiler.h"
+#include "scene.h"
+
+namespace entler {
+
+    // Draws a viewport of the scene to an ANSI terminal, two columns per tile,
+    // using the display component of the object (or else the first property)
+    // on each tile. Only cells that changed since the previous frame are sent:
+    // writes to position and display components are tracked like an index
+    // would track them, and mark the tiles the entity left and entered. Each
+    // frame is assembled in memory and written with a single fwrite, and frames
+    // are dropped when they come faster than the frame rate cap; changes made
+    // in between are drawn by the next frame.
+    class TerminalRenderer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        TerminalRenderer(EntityDatabase<Schema>& database, Scene& scene, FILE* output, double max_frames_per_second)
+            : database_(database)
+            , scene_(scene)
+            , output_(output)
+            , min_frame_interval_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / max_frames_per_second)))
+            , position_tracker_(*this, ComponentType::position)
+            , display_tracker_(*this, ComponentType::display)
+        {
+            assert(max_frames_per_second > 0);
+            set_viewport(scene.get_origin(), scene.get_width(), scene.get_height());
+        }
+
+        // shows the tiles starting at origin, cropped to the scene
+        void set_viewport(I32Vec3 origin, size_t width, size_t height) {
+            I32Vec3 scene_origin = scene_.get_origin();
+            origin.x = std::clamp(origin.x, scene_origin.x, scene_origin.x + static_cast<int32_t>(scene_.get_width()) - 1);
+            origin.y = std::clamp(origin.y, scene_origin.y, scene_origin.y + static_cast<int32_t>(scene_.get_height()) - 1);
+
+            viewport_origin_ = origin;
+            viewport_width_ = std::min<size_t>(width, scene_.get_width() - static_cast<size_t>(origin.x - scene_origin.x));
+            viewport_height_ = std::min<size_t>(height, scene_.get_height() - static_cast<size_t>(origin.y - scene_origin.y));
+            needs_full_redraw_ = true;
+        }
+
+        // draws a frame unless the last one was less than a frame interval ago; returns whether it drew
+        bool render(Clock::time_point now = Clock::now()) {
+            if (frame_count_ > 0 && now - last_frame_time_ < min_frame_interval_) {
+                return false;
+            }
+
+            ENTLER_PROFILE_ZONE("TerminalRenderer::render");
+
+            last_frame_time_ = now;
+            frame_count_ += 1;
+
+            frame_.clear();
+            if (needs_full_redraw_) {
+                start_full_redraw();
+            }
+
+            // brings in the position and display writes since the last update
+            position_tracker_.update();
+
+            std::sort(dirty_cells_.begin(), dirty_cells_.end());
+            for (size_t cell_index: dirty_cells_) {
+                dirty_[cell_index] = 0;
+                draw_cell(cell_index);
+            }
+            dirty_cells_.clear();
+
+            // park the cursor below the viewport so other output does not overwrite it
+            move_cursor(viewport_height_, 0);
+            frame_ += "\x1b[0m";
+            color_ = default_color;
+
+            std::fwrite(frame_.data(), 1, frame_.size(), output_);
+            std::fflush(output_);
+            written_byte_count_ += frame_.size();
+            return true;
+        }
+
+        uint64_t get_frame_count() const {
+            return frame_count_;
+        }
+
+        uint64_t get_drawn_cell_count() const {
+            return drawn_cell_count_;
+        }
+
+        uint64_t get_written_byte_count() const {
+            return written_byte_count_;
+        }
+
+    private:
+        static constexpr size_t no_cell_index = SIZE_MAX;
+        static constexpr int    default_color = 0;
+        static constexpr int    unknown_color = -1;
+
+        struct Cell {
+            char name[2];
+            int  color;
+
+            bool operator==(const Cell& rhs) const = default;
+        };
+
+        // hands changes of one component type to the renderer
+        class ChangeTracker : public ComponentIndex<Schema> {
+        public:
+            ChangeTracker(TerminalRenderer& renderer, ComponentType component_type)
+                : ComponentIndex<Schema>(renderer.database_, component_type)
+                , renderer_(renderer)
+            {
+            }
+
+            void update() {
+                update_component_indexes();
+            }
+
+        protected:
+            void component_added(Entity<Schema> entity) override {
+                renderer_.entity_changed(entity, true);
+            }
+
+            void component_removed(Entity<Schema> entity) override {
+                renderer_.entity_changed(entity, false);
+            }
+
+            void component_changed(Entity<Schema> entity) override {
+                renderer_.entity_changed(entity, true);
+            }
+
+            void entities_moved(const std::vector<size_t>& live_entity_indexes, size_t entity_table_size) override {
+                // both trackers are told; the position tracker moves the cells
+                if (get_component_type() == ComponentType::position) {
+                    renderer_.entities_moved(live_entity_indexes, entity_table_size);
+                }
+            }
+
+        private:
+            TerminalRenderer& renderer_;
+        };
+
+        // marks the cell the entity was last seen in and, unless it is going away, the one it is in now
+        void entity_changed(Entity<Schema> entity, bool present) {
+            size_t entity_index = entity.get_index();
+            if (entity_index >= entity_cells_.size()) {
+                entity_cells_.resize(entity_index + 1, no_cell_index);
+            }
+
+            size_t& entity_cell_index = entity_cells_[entity_index];
+            mark_dirty(entity_cell_index);
+            entity_cell_index = no_cell_index;
+
+            if (present && entity.has_component<ComponentType::position>()) {
+                entity_cell_index = find_cell(std::as_const(entity).get_component<ComponentType::position>().value);
+                mark_dirty(entity_cell_index);
+            }
+        }
+
+        void entities_moved(const std::vector<size_t>& live_entity_indexes, size_t entity_table_size) {
+            std::vector<size_t> live_entity_cells(entity_table_size, no_cell_index);
+            for (size_t entity_index = 0; entity_index < entity_cells_.size(); ++entity_index) {
+                size_t live_entity_index = live_entity_indexes[entity_index];
+                if (live_entity_index != EntityDatabase<Schema>::no_entity_index) {
+                    live_entity_cells[live_entity_index] = entity_cells_[entity_index];
+                }
+            }
+
+            entity_cells_ = std::move(live_entity_cells);
+        }
+
+        size_t find_cell(I32Vec3 position) const {
+            int32_t x = position.x - viewport_origin_.x;
+            int32_t y = position.y - viewport_origin_.y;
+            if (x < 0 || static_cast<size_t>(x) >= viewport_width_ || y < 0 || static_cast<size_t>(y) >= viewport_height_) {
+                return no_cell_index;
+            }
+
+            return static_cast<size_t>(x) + static_cast<size_t>(y) * viewport_width_;
+        }
+
+        void mark_dirty(size_t cell_index) {
+            if (cell_index != no_cell_index && !dirty_[cell_index]) {
+                dirty_[cell_index] = 1;
+                dirty_cells_.push_back(cell_index);
+            }
+        }
+
+        void start_full_redraw() {
+            size_t cell_count = viewport_width_ * viewport_height_;
+            back_buffer_.assign(cell_count, Cell{{' ', ' '}, unknown_color});
+            dirty_.assign(cell_count, 1);
+            dirty_cells_.resize(cell_count);
+            for (size_t cell_index = 0; cell_index < cell_count; ++cell_index) {
+                dirty_cells_[cell_index] = cell_index;
+            }
+
+            // cells are about to be drawn from the scene, which forgets where entities were seen
+            entity_cells_.assign(entity_cells_.size(), no_cell_index);
+
+            frame_ += "\x1b[0m\x1b[2J";
+            cursor_row_ = SIZE_MAX;
+            color_ = default_color;
+            needs_full_redraw_ = false;
+        }
+
+        void draw_cell(size_t cell_index) {
+            size_t row = cell_index / viewport_width_;
+            size_t column = cell_index % viewport_width_;
+            I32Vec3 position = viewport_origin_ + I32Vec3{static_cast<int32_t>(column), static_cast<int32_t>(row), 0};
+
+            Cell cell = read_cell(position);
+            if (cell == back_buffer_[cell_index]) {
+                return;
+            }
+
+            back_buffer_[cell_index] = cell;
+            drawn_cell_count_ += 1;
+
+            move_cursor(row, column * 2);
+            if (cell.color != color_) {
+                frame_ += cell.color > 0 ? "\x1b[3" + std::to_string(cell.color % 8) + "m" : std::string("\x1b[39m");
+                color_ = cell.color;
+            }
+
+            frame_ += cell.name[0] ? cell.name[0] : ' ';
+            frame_ += cell.name[1] ? cell.name[1] : ' ';
+            cursor_column_ += 2;
+        }
+
+        Cell read_cell(I32Vec3 position) {
+            auto read_display = [](const Entity<Schema>& entity) {
+                if (!entity.has_component<ComponentType::display>()) {
+                    return Cell{{'?', '?'}, default_color};
+                }
+
+                auto& display = entity.get_component<ComponentType::display>();
+                return Cell{{display.name[0], display.name[1]}, display.color};
+            };
+
+            if (auto object = scene_.get_object(position)) {
+                seen_entity(*object, position);
+                return read_display(*object);
+            }
+
+            std::optional<Cell> property_cell;
+            scene_.for_each_property(position, [&](const Entity<Schema>& property) {
+                if (!property_cell && property.has_component<ComponentType::display>()) {
+                    seen_entity(property, position);
+                    property_cell = read_display(property);
+                }
+            });
+
+            return property_cell.value_or(Cell{{' ', ' '}, default_color});
+        }
+
+        void seen_entity(const Entity<Schema>& entity, I32Vec3 position) {
+            size_t entity_index = entity.get_index();
+            if (entity_index >= entity_cells_.size()) {
+                entity_cells_.resize(entity_index + 1, no_cell_index);
+            }
+
+            entity_cells_[entity_index] = find_cell(position);
+        }
+
+        // moves the cursor with an escape sequence unless it already is there
+        void move_cursor(size_t row, size_t column) {
+            if (row == cursor_row_ && column == cursor_column_) {
+                return;
+            }
+
+            frame_ += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(column + 1) + "H";
+            cursor_row_ = row;
+            cursor_column_ = column;
+        }
+
+    private:
+        EntityDatabase<Schema>& database_;
+        Scene&                  scene_;
+        FILE*                   output_;
+        Clock::duration         min_frame_interval_;
+        Clock::time_point       last_frame_time_;
+
+        I32Vec3                 viewport_origin_;
+        size_t                  viewport_width_ = 0;
+        size_t                  viewport_height_ = 0;
+        bool                    needs_full_redraw_ = true;
+
+        std::vector<Cell>       back_buffer_;    // what the terminal shows, by cell index
+        std::vector<uint8_t>    dirty_;          // by cell index
+        std::vector<size_t>     dirty_cells_;
+        std::vector<size_t>     entity_cells_;   // the cell each entity was last seen in, by entity index
+
+        std::string             frame_;
+        size_t                  cursor_row_ = SIZE_MAX;
+        size_t                  cursor_column_ = 0;
+        int                     color_ = default_color;
+
+        uint64_t                frame_count_ = 0;
+        uint64_t                drawn_cell_count_ = 0;
+        uint64_t                written_byte_count_ = 0;
+
+        ChangeTracker           position_tracker_;
+        ChangeTracker           display_tracker_;
+    };
+
+}
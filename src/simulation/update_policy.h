@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "entity/entity_database.h"
+#include "schema.h"
+
+namespace entler {
+
+    enum class UpdateSchedule {
+        every_tick,       // every entity, every tick
+        every_nth_tick,   // every entity, every interval-th tick
+        round_robin,      // 1/interval of the entities per tick, each one every interval ticks
+        distance_lod,     // every tick near the area of interest, every interval ticks further out or without a position
+    };
+
+    // How often Simulation runs a system and which of its entities it updates.
+    // Slices are assigned by entity id and tick count, which survive vacuum and
+    // checkpoints, so a run is as deterministic as it is without a policy;
+    // entity j is updated on tick t when j % interval == t % interval. A budget
+    // makes Simulation adapt the interval to the time the system takes, which
+    // gives up determinism.
+    struct UpdatePolicy {
+        UpdateSchedule schedule = UpdateSchedule::every_tick;
+        uint32_t       interval = 1;       // also the lowest interval a budget may pick
+        uint32_t       near_radius = 0;    // distance_lod: tiles around the area of interest updated every tick
+        uint64_t       budget_ns = 0;      // round_robin and distance_lod: target update time, 0 for a fixed interval
+        uint32_t       max_interval = 64;  // highest interval a budget may pick
+
+        static UpdatePolicy every_nth_tick(uint32_t interval) {
+            return UpdatePolicy{ .schedule = UpdateSchedule::every_nth_tick, .interval = interval };
+        }
+
+        static UpdatePolicy round_robin(uint32_t interval, uint64_t budget_ns = 0) {
+            return UpdatePolicy{ .schedule = UpdateSchedule::round_robin, .interval = interval, .budget_ns = budget_ns };
+        }
+
+        static UpdatePolicy distance_lod(uint32_t near_radius, uint32_t interval, uint64_t budget_ns = 0) {
+            return UpdatePolicy{ .schedule = UpdateSchedule::distance_lod, .interval = interval, .near_radius = near_radius, .budget_ns = budget_ns };
+        }
+
+        // whether only some of the entities are updated on a tick, which the system has to support
+        bool slices_entities() const {
+            return schedule == UpdateSchedule::round_robin || schedule == UpdateSchedule::distance_lod;
+        }
+    };
+
+    // The entities a system updates on the current tick, see
+    // Simulation::get_update_filter. Copy it into jobs; includes() may be
+    // called from any thread.
+    class UpdateFilter {
+    public:
+        UpdateFilter() = default;
+
+        UpdateFilter(UpdateSchedule schedule, uint32_t interval, uint64_t tick, I32Vec3 area_of_interest, uint32_t near_radius)
+            : schedule_(interval > 1 ? schedule : UpdateSchedule::every_tick)
+            , interval_(interval)
+            , phase_(tick % interval)
+            , area_of_interest_(area_of_interest)
+            , near_radius_(near_radius)
+        {
+        }
+
+        bool includes_all() const {
+            return schedule_ == UpdateSchedule::every_tick || schedule_ == UpdateSchedule::every_nth_tick;
+        }
+
+        bool includes(const Entity<Schema>& entity) const {
+            switch (schedule_) {
+                case UpdateSchedule::every_tick:
+                case UpdateSchedule::every_nth_tick:
+                    return true;
+
+                case UpdateSchedule::round_robin:
+                    return is_in_slice(entity);
+
+                case UpdateSchedule::distance_lod: {
+                    if (!entity.has_component<ComponentType::position>()) {
+                        return is_in_slice(entity);
+                    }
+
+                    I32Vec3 position = entity.get_component<ComponentType::position>().value;
+                    uint32_t distance = static_cast<uint32_t>(std::max(std::abs(position.x - area_of_interest_.x), std::abs(position.y - area_of_interest_.y)));
+                    return distance <= near_radius_ || is_in_slice(entity);
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        bool is_in_slice(const Entity<Schema>& entity) const {
+            return static_cast<uint64_t>(entity.get_id()) % interval_ == phase_;
+        }
+
+    private:
+        UpdateSchedule schedule_ = UpdateSchedule::every_tick;
+        uint32_t       interval_ = 1;
+        uint64_t       phase_ = 0;
+        I32Vec3        area_of_interest_;
+        uint32_t       near_radius_ = 0;
+    };
+
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include "entity/entity_database.h"
+#include "util/metrics.h"
+#include "util/profiler.h"
+#include "util/shared_memory.h"
+#include "schema.h"
+#include "scene.h"
+
+namespace entler {
+
+    // The layout of a world export segment, shared by WorldExporter and
+    // WorldExportReader. The segment holds a header and two frames; a frame has
+    // one row per exported entity (its id, its component mask and one packed
+    // column per exported component type, rows in the same order in every
+    // column) and the scene's occupancy grid, which holds the row of the object
+    // on each tile plus one, or 0 for empty tiles. The writer fills the frame
+    // readers are not pointed at and then publishes it, so it never waits for
+    // a reader. Each frame is guarded by a sequence number that is odd while
+    // the frame is written: readers work on the frame in place and only trust
+    // what they read if the sequence number did not change meanwhile, which
+    // only happens when a reader takes longer than a whole tick.
+    namespace world_export {
+
+        inline constexpr uint32_t magic = 0x58454c45;   // "ELEX"
+        inline constexpr uint32_t version = 2;
+        inline constexpr size_t   alignment = 64;
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "Atomics in shared memory have to be lock free");
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "Atomics in shared memory have to be lock free");
+
+        struct Column {
+            uint32_t component_type = 0;
+            uint32_t element_size = 0;
+            uint64_t offset = 0;   // from the start of a frame
+        };
+
+        struct alignas(alignment) Frame {
+            std::atomic<uint64_t> sequence;
+            uint64_t              tick;
+            int64_t               publish_time_ns;   // steady clock
+            uint32_t              entity_count;
+            uint32_t              truncated;         // more entities than capacity; the rest were left out
+        };
+
+        struct Header {
+            uint32_t              magic;
+            uint32_t              version;
+            uint32_t              capacity;          // rows per frame
+            uint32_t              column_count;
+            int32_t               origin_x;
+            int32_t               origin_y;
+            int32_t               origin_z;
+            uint32_t              width;
+            uint32_t              height;
+            uint32_t              depth;
+            uint64_t              frame_size;
+            uint64_t              frame_offsets[2];
+            uint64_t              entity_id_offset;        // int64_t per row
+            uint64_t              component_mask_offset;   // uint64_t per row
+            uint64_t              occupancy_offset;        // uint32_t per tile, x fastest, then y, then z
+            Column                columns[Schema::component_type_count()];
+
+            alignas(alignment) std::atomic<uint32_t> latest_frame;
+            std::atomic<uint64_t> published_count;
+        };
+
+        inline size_t align(size_t size) {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        // the occupancy grid entry of a tile within the exported bounds
+        inline size_t get_tile_offset(const Header& header, I32Vec3 position) {
+            size_t x = static_cast<size_t>(position.x - header.origin_x);
+            size_t y = static_cast<size_t>(position.y - header.origin_y);
+            size_t z = static_cast<size_t>(position.z - header.origin_z);
+            return x + (y + z * header.height) * header.width;
+        }
+
+        inline int64_t get_time_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // calls f(std::integral_constant<size_t, component_type_index>) for every component type
+        template<typename F>
+        void for_each_component_type(F&& f) {
+            [&]<size_t... component_type_indexes>(std::index_sequence<component_type_indexes...>) {
+                (f(std::integral_constant<size_t, component_type_indexes>{}), ...);
+            }(std::make_index_sequence<Schema::component_type_count()>{});
+        }
+
+    }
+
+    // Publishes the entities that have a position, a chosen set of their
+    // components and the scene's occupancy grid to a named shared memory
+    // segment once per call to publish. See world_export for the protocol.
+    class WorldExporter {
+    public:
+        WorldExporter(EntityDatabase<Schema>& database, Scene& scene)
+            : database_(database)
+            , scene_(scene)
+        {
+        }
+
+        // creates the segment with room for capacity entities and a column for each of component_types
+        bool create(const std::string& name, std::initializer_list<ComponentType> component_types, size_t capacity) {
+            using namespace world_export;
+
+            typename Schema::ComponentMask column_mask = Schema::make_component_mask(component_types);
+
+            Header header = {};
+            header.magic = magic;
+            header.version = version;
+            header.capacity = static_cast<uint32_t>(capacity);
+            header.origin_x = scene_.get_origin().x;
+            header.origin_y = scene_.get_origin().y;
+            header.origin_z = scene_.get_origin().z;
+            header.width = static_cast<uint32_t>(scene_.get_width());
+            header.height = static_cast<uint32_t>(scene_.get_height());
+            header.depth = static_cast<uint32_t>(scene_.get_depth());
+
+            size_t frame_size = align(sizeof(Frame));
+            header.entity_id_offset = frame_size;
+            frame_size += align(capacity * sizeof(int64_t));
+            header.component_mask_offset = frame_size;
+            frame_size += align(capacity * sizeof(uint64_t));
+
+            for_each_component_type([&](auto component_type_index) {
+                using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                static_assert(std::is_trivially_copyable_v<Component>, "Exported components are copied as raw bytes");
+
+                if constexpr (!std::is_empty_v<Component>) {
+                    if (column_mask.test(component_type_index)) {
+                        header.columns[header.column_count++] = Column {
+                            .component_type = static_cast<uint32_t>(Schema::get_component_type(component_type_index)),
+                            .element_size = sizeof(Component),
+                            .offset = frame_size,
+                        };
+                        frame_size += align(capacity * sizeof(Component));
+                    }
+                }
+            });
+
+            header.occupancy_offset = frame_size;
+            frame_size += align(scene_.get_width() * scene_.get_height() * scene_.get_depth() * sizeof(uint32_t));
+
+            header.frame_size = frame_size;
+            header.frame_offsets[0] = align(sizeof(Header));
+            header.frame_offsets[1] = header.frame_offsets[0] + frame_size;
+
+            if (!memory_.create(name, header.frame_offsets[1] + frame_size)) {
+                return false;
+            }
+
+            // the segment is zero filled, so both sequence numbers start even and nothing is published
+            std::memcpy(memory_.get_data(), &header, sizeof(header));
+            return true;
+        }
+
+        // writes the current state into the frame readers are not looking at and points them to it
+        void publish(uint64_t tick) {
+            using namespace world_export;
+
+            ENTLER_PROFILE_ZONE("WorldExporter::publish");
+
+            auto* base = static_cast<uint8_t*>(memory_.get_data());
+            auto& header = *reinterpret_cast<Header*>(base);
+            uint32_t frame_index = header.published_count.load(std::memory_order_relaxed) == 0
+                ? 0
+                : 1 - header.latest_frame.load(std::memory_order_relaxed);
+            uint8_t* frame_data = base + header.frame_offsets[frame_index];
+            auto& frame = *reinterpret_cast<Frame*>(frame_data);
+
+            uint64_t sequence = frame.sequence.load(std::memory_order_relaxed);
+            frame.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            uint8_t* columns[Schema::component_type_count()] = {};
+            for (uint32_t column_index = 0; column_index < header.column_count; ++column_index) {
+                const Column& column = header.columns[column_index];
+                columns[*Schema::find_component_type(static_cast<ComponentType>(column.component_type))] = frame_data + column.offset;
+            }
+
+            auto* entity_ids = reinterpret_cast<int64_t*>(frame_data + header.entity_id_offset);
+            auto* component_masks = reinterpret_cast<uint64_t*>(frame_data + header.component_mask_offset);
+            auto* occupancy = reinterpret_cast<uint32_t*>(frame_data + header.occupancy_offset);
+            std::memset(occupancy, 0, static_cast<size_t>(header.width) * header.height * header.depth * sizeof(uint32_t));
+
+            // one pass that writes every column of a row, so each entity is looked up once
+            size_t row = 0;
+            bool truncated = false;
+            database_.for_each_entity(Schema::component_mask_v<ComponentType::position>, SleepingEntities::include, [&](Entity<Schema> entity) {
+                if (row == header.capacity) {
+                    truncated = true;
+                    return;
+                }
+
+                const Entity<Schema>& const_entity = entity;
+                typename Schema::ComponentMask component_mask = const_entity.get_component_mask();
+                entity_ids[row] = const_entity.get_id();
+                component_masks[row] = component_mask.to_ullong();
+
+                // rows without a component keep whatever was there before; readers check the mask
+                for_each_component_type([&](auto component_type_index) {
+                    using Component = std::tuple_element_t<component_type_index, typename Schema::ComponentValues>;
+                    if constexpr (!std::is_empty_v<Component>) {
+                        if (columns[component_type_index] && component_mask.test(component_type_index)) {
+                            const Component& component = const_entity.get_component<Schema::get_component_type(component_type_index)>();
+                            std::memcpy(columns[component_type_index] + row * sizeof(Component), &component, sizeof(Component));
+                        }
+                    }
+                });
+
+                I32Vec3 position = const_entity.get_component<ComponentType::position>().value;
+                if (scene_.contains(position)) {
+                    auto object = scene_.get_object(position);
+                    if (object && object->get_index() == entity.get_index()) {
+                        occupancy[get_tile_offset(header, position)] = static_cast<uint32_t>(row + 1);
+                    }
+                }
+
+                row += 1;
+            });
+
+            frame.tick = tick;
+            frame.publish_time_ns = get_time_ns();
+            frame.entity_count = static_cast<uint32_t>(row);
+            frame.truncated = truncated;
+            frame.sequence.store(sequence + 2, std::memory_order_release);
+
+            header.latest_frame.store(frame_index, std::memory_order_release);
+            header.published_count.store(header.published_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+            publish_count_ += 1;
+            truncated_frame_count_ += truncated;
+        }
+
+        void collect_metrics(MetricsSnapshot& snapshot, std::string_view prefix) const {
+            std::string name(prefix);
+            snapshot.add(name + "publishes", static_cast<int64_t>(publish_count_));
+            snapshot.add(name + "truncated_frames", static_cast<int64_t>(truncated_frame_count_));
+            snapshot.add(name + "segment_bytes", static_cast<int64_t>(memory_.get_size()));
+        }
+
+    private:
+        EntityDatabase<Schema>& database_;
+        Scene&                  scene_;
+        SharedMemory            memory_;
+        uint64_t                publish_count_ = 0;
+        uint64_t                truncated_frame_count_ = 0;
+    };
+
+    // A consistent frame of a world export, valid inside WorldExportReader::read.
+    class WorldExportView {
+    public:
+        WorldExportView(const world_export::Header& header, const uint8_t* frame_data)
+            : header_(header)
+            , frame_data_(frame_data)
+            , frame_(*reinterpret_cast<const world_export::Frame*>(frame_data))
+        {
+        }
+
+        uint64_t get_tick() const {
+            return frame_.tick;
+        }
+
+        // when the writer finished the frame, on the steady clock
+        int64_t get_publish_time_ns() const {
+            return frame_.publish_time_ns;
+        }
+
+        size_t get_entity_count() const {
+            return frame_.entity_count;
+        }
+
+        bool is_truncated() const {
+            return frame_.truncated != 0;
+        }
+
+        I32Vec3 get_origin() const {
+            return I32Vec3{header_.origin_x, header_.origin_y, header_.origin_z};
+        }
+
+        size_t get_width() const {
+            return header_.width;
+        }
+
+        size_t get_height() const {
+            return header_.height;
+        }
+
+        size_t get_depth() const {
+            return header_.depth;
+        }
+
+        EntityId get_entity_id(size_t row) const {
+            return reinterpret_cast<const int64_t*>(frame_data_ + header_.entity_id_offset)[row];
+        }
+
+        template<ComponentType component_type>
+        bool has_component(size_t row) const {
+            uint64_t component_mask = reinterpret_cast<const uint64_t*>(frame_data_ + header_.component_mask_offset)[row];
+            return (component_mask >> Schema::component_type_index_v<component_type>) & 1;
+        }
+
+        // the column of component_type, indexed by row, or nullptr if it is not exported;
+        // only rows that have the component hold a value
+        template<ComponentType component_type>
+        const Schema::Component<component_type>* get_column() const {
+            for (uint32_t column_index = 0; column_index < header_.column_count; ++column_index) {
+                const world_export::Column& column = header_.columns[column_index];
+                if (column.component_type == static_cast<uint32_t>(component_type)) {
+                    return reinterpret_cast<const Schema::Component<component_type>*>(frame_data_ + column.offset);
+                }
+            }
+
+            return nullptr;
+        }
+
+        // the row of the object on a tile
+        std::optional<size_t> find_object_row(I32Vec3 position) const {
+            int32_t x = position.x - header_.origin_x;
+            int32_t y = position.y - header_.origin_y;
+            int32_t z = position.z - header_.origin_z;
+            if (x < 0 || static_cast<uint32_t>(x) >= header_.width || y < 0 || static_cast<uint32_t>(y) >= header_.height ||
+                z < 0 || static_cast<uint32_t>(z) >= header_.depth) {
+                return std::nullopt;
+            }
+
+            uint32_t row = reinterpret_cast<const uint32_t*>(frame_data_ + header_.occupancy_offset)[world_export::get_tile_offset(header_, position)];
+            if (row == 0 || row > frame_.entity_count) {
+                return std::nullopt;
+            }
+
+            return row - 1;
+        }
+
+    private:
+        const world_export::Header& header_;
+        const uint8_t*              frame_data_;
+        const world_export::Frame&  frame_;
+    };
+
+    // Reads the frames a WorldExporter publishes, in this or another process.
+    class WorldExportReader {
+    public:
+        // fails if there is no segment of that name or it was written by a different build
+        bool open(const std::string& name) {
+            using namespace world_export;
+
+            if (!memory_.open(name) || memory_.get_size() < sizeof(Header)) {
+                memory_.close();
+                return false;
+            }
+
+            const Header& header = get_header();
+            bool valid = header.magic == magic && header.version == version &&
+                         header.column_count <= Schema::component_type_count() &&
+                         header.frame_offsets[1] + header.frame_size <= memory_.get_size();
+
+            for (uint32_t column_index = 0; valid && column_index < header.column_count; ++column_index) {
+                const Column& column = header.columns[column_index];
+                std::optional<size_t> component_type_index = Schema::find_component_type(static_cast<ComponentType>(column.component_type));
+                valid = component_type_index && column.element_size == get_component_size(*component_type_index);
+            }
+
+            if (!valid) {
+                memory_.close();
+                return false;
+            }
+
+            return true;
+        }
+
+        uint64_t get_published_count() const {
+            return get_header().published_count.load(std::memory_order_acquire);
+        }
+
+        // Calls f(const WorldExportView&) on the latest frame and returns true once a call saw
+        // the frame stay untouched, or false when nothing is published yet or max_attempts calls
+        // were overtaken by the writer. f may see a torn frame in calls that are retried, so it
+        // should only gather results, and only keep the ones of a successful read.
+        template<typename F>
+        bool read(F&& f, size_t max_attempts = 8) const {
+            using namespace world_export;
+
+            const Header& header = get_header();
+            if (header.published_count.load(std::memory_order_acquire) == 0) {
+                return false;
+            }
+
+            for (size_t attempt = 0; attempt < max_attempts; ++attempt) {
+                uint32_t frame_index = header.latest_frame.load(std::memory_order_acquire);
+                const uint8_t* frame_data = static_cast<const uint8_t*>(memory_.get_data()) + header.frame_offsets[frame_index];
+                const auto& frame = *reinterpret_cast<const Frame*>(frame_data);
+
+                uint64_t sequence = frame.sequence.load(std::memory_order_acquire);
+                if (sequence & 1) {
+                    continue;
+                }
+
+                f(WorldExportView(header, frame_data));
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (frame.sequence.load(std::memory_order_relaxed) == sequence) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        const world_export::Header& get_header() const {
+            return *static_cast<const world_export::Header*>(memory_.get_data());
+        }
+
+        static size_t get_component_size(size_t component_type_index) {
+            size_t component_size = 0;
+            world_export::for_each_component_type([&](auto index) {
+                using Component = std::tuple_element_t<index, typename Schema::ComponentValues>;
+                if (index == component_type_index) {
+                    component_size = std::is_empty_v<Component> ? 0 : sizeof(Component);
+                }
+            });
+
+            return component_size;
+        }
+
+    private:
+        SharedMemory memory_;
+    };
+
+}
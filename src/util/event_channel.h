@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "thread_index.h"
+
+namespace entler {
+
+    class EventChannelBase {
+    public:
+        virtual ~EventChannelBase() = default;
+
+        // drops the events nobody drained
+        virtual void clear() = 0;
+
+        virtual uint64_t get_emitted_count() const = 0;
+        virtual uint64_t get_dropped_count() const = 0;
+    };
+
+    // Events of one type sent from any number of threads to a single
+    // consumer. Each thread appends to its own cache line aligned segment,
+    // so emitting is a plain vector push without atomics; threads beyond
+    // segment_count share a locked overflow segment. The consumer drains
+    // every segment in one batch once the producers are done, e.g. after the
+    // parallel_for that emitted them. Segments keep their capacity, so once
+    // they grew to the peak event count emitting no longer allocates.
+    //
+    // Events are drained segment by segment in thread index order; the order
+    // within a segment is the emission order.
+    template<typename Event>
+    class EventChannel : public EventChannelBase {
+    public:
+        static constexpr size_t segment_count = 64;
+
+        // may be called from any thread, but not while the channel is drained
+        void emit(const Event& event) {
+            size_t thread_index = get_thread_index();
+            if (thread_index < segment_count) {
+                segments_[thread_index].events.push_back(event);
+                return;
+            }
+
+            std::lock_guard lock(overflow_mutex_);
+            overflow_segment_.events.push_back(event);
+        }
+
+        // calls visitor(const Event&) for every emitted event and empties the channel;
+        // call from the consumer once no thread emits anymore
+        template<typename Visitor>
+        void drain(Visitor&& visitor) {
+            for (Segment& segment: segments_) {
+                drain_segment(segment, visitor);
+            }
+
+            drain_segment(overflow_segment_, visitor);
+        }
+
+        bool empty() const {
+            for (const Segment& segment: segments_) {
+                if (!segment.events.empty()) {
+                    return false;
+                }
+            }
+
+            return overflow_segment_.events.empty();
+        }
+
+        void clear() override {
+            for (Segment& segment: segments_) {
+                dropped_count_ += segment.events.size();
+                emitted_count_ += segment.events.size();
+                segment.events.clear();
+            }
+
+            dropped_count_ += overflow_segment_.events.size();
+            emitted_count_ += overflow_segment_.events.size();
+            overflow_segment_.events.clear();
+        }
+
+        // counts events once they were drained or dropped
+        uint64_t get_emitted_count() const override {
+            return emitted_count_;
+        }
+
+        uint64_t get_dropped_count() const override {
+            return dropped_count_;
+        }
+
+    private:
+        struct alignas(64) Segment {
+            std::vector<Event> events;
+        };
+
+        template<typename Visitor>
+        void drain_segment(Segment& segment, Visitor& visitor) {
+            for (const Event& event: segment.events) {
+                visitor(event);
+            }
+
+            emitted_count_ += segment.events.size();
+            segment.events.clear();
+        }
+
+    private:
+        Segment    segments_[segment_count];
+        std::mutex overflow_mutex_;
+        Segment    overflow_segment_;
+        uint64_t   emitted_count_ = 0;
+        uint64_t   dropped_count_ = 0;
+    };
+
+    namespace detail {
+
+        inline size_t allocate_event_type_index() {
+            static std::atomic<size_t> next_event_type_index = 0;
+            return next_event_type_index.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    }
+
+    // a dense index per event type, to look channels up without hashing
+    template<typename Event>
+    size_t get_event_type_index() {
+        static const size_t event_type_index = detail::allocate_event_type_index();
+        return event_type_index;
+    }
+
+}
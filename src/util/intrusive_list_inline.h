@@ -54,11 +54,14 @@ inline IntrusiveListNode::IntrusiveListNode()
 }
 
 inline IntrusiveListNode::IntrusiveListNode(IntrusiveListNode&& other)
-        : next_{other.next_}
-        , prev_{other.prev_}
+        : next_{nullptr}
+        , prev_{nullptr}
 {
-    other.prev_ = nullptr;
-    other.next_ = nullptr;
+    // take over the position of other in its list
+    if(other.is_linked()) {
+        link(&other);
+        other.unlink();
+    }
 }
 
 inline IntrusiveListNode::~IntrusiveListNode()
@@ -71,11 +74,11 @@ inline IntrusiveListNode& IntrusiveListNode::operator=(IntrusiveListNode&& rhs)
     if(this != &rhs) {
         unlink();
 
-        next_ = rhs.next_;
-        prev_ = rhs.prev_;
-
-        rhs.next_ = nullptr;
-        rhs.prev_ = nullptr;
+        // take over the position of rhs in its list
+        if(rhs.is_linked()) {
+            link(&rhs);
+            rhs.unlink();
+        }
     }
 
     return *this;
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+namespace entler {
+
+    // A fixed pool of worker threads that cooperatively run one parallel_for at
+    // a time. The calling thread participates as thread index 0, workers are
+    // numbered 1..thread_count-1.
+    class JobSystem {
+    public:
+        explicit JobSystem(size_t thread_count = 1)
+            : thread_count_(std::max<size_t>(thread_count, 1))
+        {
+            for (size_t thread_index = 1; thread_index < thread_count_; ++thread_index) {
+                workers_.emplace_back([this, thread_index]() {
+                    run_worker(thread_index);
+                });
+            }
+        }
+
+        JobSystem(JobSystem&&) = delete;
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(JobSystem&&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        ~JobSystem() {
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+
+            wake_condition_.notify_all();
+            for (std::thread& worker: workers_) {
+                worker.join();
+            }
+        }
+
+        size_t thread_count() const {
+            return thread_count_;
+        }
+
+        // splits [0, count) into chunks of grain_size and calls
+        // f(first, last, thread_index) for each of them; blocks until all chunks are done
+        template<typename F>
+        void parallel_for(size_t count, size_t grain_size, F&& f) {
+            grain_size = std::max<size_t>(grain_size, 1);
+            if (thread_count_ == 1 || count <= grain_size) {
+                if (count) {
+                    f(size_t{0}, count, size_t{0});
+                }
+
+                return;
+            }
+
+            Batch batch;
+            batch.count = count;
+            batch.grain_size = grain_size;
+            batch.function = &f;
+            batch.invoke = [](void* function, size_t first, size_t last, size_t thread_index) {
+                (*static_cast<std::remove_reference_t<F>*>(function))(first, last, thread_index);
+            };
+
+            {
+                std::lock_guard lock(mutex_);
+                batch_ = &batch;
+                batch_generation_ += 1;
+            }
+
+            wake_condition_.notify_all();
+            run_batch(batch, 0);
+
+            // wait for the workers that picked up the batch to leave it
+            std::unique_lock lock(mutex_);
+            batch_ = nullptr;
+            done_condition_.wait(lock, [&]() {
+                return batch.active_workers == 0;
+            });
+        }
+
+    private:
+        struct Batch {
+            size_t              count = 0;
+            size_t              grain_size = 0;
+            void*               function = nullptr;
+            void              (*invoke)(void*, size_t, size_t, size_t) = nullptr;
+            std::atomic<size_t> next_index = 0;
+            size_t              active_workers = 0; // guarded by mutex_
+        };
+
+        static void run_batch(Batch& batch, size_t thread_index) {
+            while (true) {
+                size_t first = batch.next_index.fetch_add(batch.grain_size, std::memory_order_relaxed);
+                if (first >= batch.count) {
+                    break;
+                }
+
+                size_t last = std::min(first + batch.grain_size, batch.count);
+                batch.invoke(batch.function, first, last, thread_index);
+            }
+        }
+
+        void run_worker(size_t thread_index) {
+            uint64_t seen_generation = 0;
+
+            std::unique_lock lock(mutex_);
+            while (true) {
+                wake_condition_.wait(lock, [&]() {
+                    return stopping_ || (batch_ && batch_generation_ != seen_generation);
+                });
+                if (stopping_) {
+                    break;
+                }
+
+                Batch& batch = *batch_;
+                seen_generation = batch_generation_;
+                batch.active_workers += 1;
+                lock.unlock();
+
+                run_batch(batch, thread_index);
+
+                lock.lock();
+                batch.active_workers -= 1;
+                if (batch.active_workers == 0) {
+                    done_condition_.notify_one();
+                }
+            }
+        }
+
+    private:
+        size_t                   thread_count_;
+        std::vector<std::thread> workers_;
+        std::mutex               mutex_;
+        std::condition_variable  wake_condition_;
+        std::condition_variable  done_condition_;
+        Batch*                   batch_ = nullptr;
+        uint64_t                 batch_generation_ = 0;
+        bool                     stopping_ = false;
+    };
+
+}
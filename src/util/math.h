@@ -23,17 +23,17 @@ namespace entler {
 
         friend Vec3 operator-(const Vec3& lhs, const Vec3& rhs) {
             return Vec3 {
-                .x = lhs.x + rhs.x,
-                .y = lhs.y + rhs.y,
-                .z = lhs.z + rhs.z,
+                .x = lhs.x - rhs.x,
+                .y = lhs.y - rhs.y,
+                .z = lhs.z - rhs.z,
             };
         }
 
         friend Vec3 operator*(const Vec3& lhs, const T& rhs) {
             return Vec3 {
-                .x = lhs.x + rhs,
-                .y = lhs.y + rhs,
-                .z = lhs.z + rhs,
+                .x = lhs.x * rhs,
+                .y = lhs.y * rhs,
+                .z = lhs.z * rhs,
             };
         }
 
@@ -42,11 +42,11 @@ namespace entler {
         }
 
         Vec3& operator-=(const Vec3& rhs) {
-            return (*this = operator+(*this, rhs));
+            return (*this = operator-(*this, rhs));
         }
 
-        Vec3& operator*=(const Vec3& rhs) {
-            return (*this = operator+(*this, rhs));
+        Vec3& operator*=(const T& rhs) {
+            return (*this = operator*(*this, rhs));
         }
     };
 
@@ -55,4 +55,21 @@ namespace entler {
     using F32Vec3 = Vec3<float>;
     using F64Vec3 = Vec3<double>;
 
+    // Interleaves the low 21 bits of x, y and z, x lowest, so that cells close to each
+    // other mostly get close codes; the cells of an aligned cube of 2^n cells per side
+    // get consecutive codes. Coordinates must not be negative.
+    inline uint64_t get_morton_code(I32Vec3 cell) {
+        auto spread = [](uint64_t bits) {
+            bits &= 0x1fffff;
+            bits = (bits | (bits << 32)) & 0x1f00000000ffff;
+            bits = (bits | (bits << 16)) & 0x1f0000ff0000ff;
+            bits = (bits | (bits << 8)) & 0x100f00f00f00f00f;
+            bits = (bits | (bits << 4)) & 0x10c30c30c30c30c3;
+            bits = (bits | (bits << 2)) & 0x1249249249249249;
+            return bits;
+        };
+
+        return spread(static_cast<uint32_t>(cell.x)) | (spread(static_cast<uint32_t>(cell.y)) << 1) | (spread(static_cast<uint32_t>(cell.z)) << 2);
+    }
+
 }
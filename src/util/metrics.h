@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "thread_index.h"
+
+namespace entler {
+
+    // A counter split into cache line sized shards so threads bumping it
+    // concurrently do not contend, and the first shard_count threads can
+    // update their shard without a locked instruction; any further threads
+    // share an overflow shard they update atomically. Reads sum the shards
+    // and are only as consistent as relaxed loads allow.
+    class ShardedCounter {
+    public:
+        static constexpr size_t shard_count = 32;
+
+        void add(int64_t value) {
+            size_t thread_index = get_thread_index();
+            if (thread_index < shard_count) {
+                // thread indexes are unique among running threads, so this thread is the only writer
+                auto& shard_value = shards_[thread_index].value;
+                shard_value.store(shard_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+            else {
+                overflow_shard_.value.fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+
+        void increment() {
+            add(1);
+        }
+
+        void decrement() {
+            add(-1);
+        }
+
+        int64_t load() const {
+            int64_t value = overflow_shard_.value.load(std::memory_order_relaxed);
+            for (const Shard& shard: shards_) {
+                value += shard.value.load(std::memory_order_relaxed);
+            }
+
+            return value;
+        }
+
+    private:
+        struct alignas(64) Shard {
+            std::atomic<int64_t> value = 0;
+        };
+
+        Shard shards_[shard_count];
+        Shard overflow_shard_;   // of the threads past the first shard_count
+    };
+
+    struct Metric {
+        std::string name;
+        int64_t     value;
+    };
+
+    class MetricsSnapshot {
+    public:
+        void add(std::string name, int64_t value) {
+            metrics_.push_back(Metric{std::move(name), value});
+        }
+
+        std::optional<int64_t> find(std::string_view name) const {
+            for (const Metric& metric: metrics_) {
+                if (metric.name == name) {
+                    return metric.value;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        const std::vector<Metric>& get_metrics() const {
+            return metrics_;
+        }
+
+        // one "name value" pair per line
+        void write(std::ostream& stream) const {
+            for (const Metric& metric: metrics_) {
+                stream << metric.name << ' ' << metric.value << '\n';
+            }
+        }
+
+        std::string to_string() const {
+            std::ostringstream stream;
+            write(stream);
+            return stream.str();
+        }
+
+    private:
+        std::vector<Metric> metrics_;
+    };
+
+    // Owns free standing counters and the collectors that report the state of
+    // other objects. Collectors run on whichever thread takes the snapshot.
+    class MetricsRegistry {
+    public:
+        using Collector = std::function<void(MetricsSnapshot&)>;
+
+        // counters are created on first use and live as long as the registry
+        ShardedCounter& get_counter(std::string name) {
+            std::lock_guard lock(mutex_);
+            for (auto& counter: counters_) {
+                if (counter->name == name) {
+                    return counter->counter;
+                }
+            }
+
+            counters_.push_back(std::make_unique<NamedCounter>());
+            counters_.back()->name = std::move(name);
+            return counters_.back()->counter;
+        }
+
+        void add_collector(Collector collector) {
+            std::lock_guard lock(mutex_);
+            collectors_.push_back(std::move(collector));
+        }
+
+        MetricsSnapshot snapshot() const {
+            std::lock_guard lock(mutex_);
+
+            MetricsSnapshot snapshot;
+            for (const Collector& collector: collectors_) {
+                collector(snapshot);
+            }
+            for (const auto& counter: counters_) {
+                snapshot.add(counter->name, counter->counter.load());
+            }
+
+            return snapshot;
+        }
+
+    private:
+        struct NamedCounter {
+            std::string    name;
+            ShardedCounter counter;
+        };
+
+        mutable std::mutex                         mutex_;
+        std::vector<std::unique_ptr<NamedCounter>> counters_;
+        std::vector<Collector>                     collectors_;
+    };
+
+}
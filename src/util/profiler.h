@@ -0,0 +1,199 @@
+#pragma once
+
+// Scoped profiling zones, compiled in with -DENTLER_PROFILING=1 (the
+// ENTLER_PROFILING cmake option). Each thread records finished zones into its
+// own ring buffer; the oldest zones are overwritten when a buffer wraps.
+// Profiler::write_chrome_trace exports what is left as Chrome trace-event
+// JSON (chrome://tracing, Perfetto).
+
+#ifndef ENTLER_PROFILING
+#define ENTLER_PROFILING 0
+#endif
+
+#if ENTLER_PROFILING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace entler {
+
+    inline uint64_t read_timestamp() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    struct ProfileEvent {
+        const char* name;
+        uint64_t    begin;
+        uint64_t    end;
+    };
+
+    // Single producer ring buffer. Only the owning thread writes; readers copy
+    // events out and discard anything the writer may have lapped meanwhile.
+    class ProfileBuffer {
+    public:
+        static constexpr size_t capacity = size_t{1} << 16;
+
+        explicit ProfileBuffer(uint32_t thread_id)
+            : thread_id_(thread_id)
+            , events_(new ProfileEvent[capacity])
+        {
+        }
+
+        uint32_t get_thread_id() const {
+            return thread_id_;
+        }
+
+        void push(const char* name, uint64_t begin, uint64_t end) {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            events_[head & (capacity - 1)] = ProfileEvent{name, begin, end};
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        template<typename Visitor>
+        void for_each_event(Visitor&& visitor) const {
+            uint64_t head = head_.load(std::memory_order_acquire);
+            uint64_t tail = head > capacity ? head - capacity : 0;
+
+            std::vector<ProfileEvent> events;
+            events.reserve(head - tail);
+            for (uint64_t index = tail; index < head; ++index) {
+                events.push_back(events_[index & (capacity - 1)]);
+            }
+
+            // drop events that were overwritten while they were being copied
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t new_head = head_.load(std::memory_order_relaxed);
+            uint64_t valid_tail = new_head > capacity ? new_head - capacity : 0;
+            for (uint64_t index = std::max(tail, valid_tail); index < head; ++index) {
+                visitor(events[index - tail]);
+            }
+        }
+
+    private:
+        uint32_t                        thread_id_;
+        std::unique_ptr<ProfileEvent[]> events_;
+        std::atomic<uint64_t>           head_ = 0;
+    };
+
+    class Profiler {
+    public:
+        static Profiler& get_instance() {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        // the fast path only touches a thread local; the profiler itself is reached once per thread
+        static ProfileBuffer& get_thread_buffer() {
+            if (!thread_buffer_) {
+                thread_buffer_ = &get_instance().register_thread();
+            }
+
+            return *thread_buffer_;
+        }
+
+        void write_chrome_trace(std::ostream& stream) {
+            double ns_per_tick = get_ns_per_tick();
+
+            std::lock_guard lock(mutex_);
+            stream << "{\"traceEvents\":[";
+
+            bool first = true;
+            for (auto& buffer: buffers_) {
+                buffer->for_each_event([&](const ProfileEvent& event) {
+                    double begin_us = static_cast<double>(event.begin - origin_ticks_) * ns_per_tick / 1000.0;
+                    double duration_us = static_cast<double>(event.end - event.begin) * ns_per_tick / 1000.0;
+
+                    stream << (first ? "\n" : ",\n");
+                    stream << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1"
+                           << ",\"tid\":" << buffer->get_thread_id()
+                           << ",\"ts\":" << begin_us
+                           << ",\"dur\":" << duration_us << "}";
+                    first = false;
+                });
+            }
+
+            stream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+        }
+
+    private:
+        Profiler()
+            : origin_time_(std::chrono::steady_clock::now())
+            , origin_ticks_(read_timestamp())
+        {
+        }
+
+        ProfileBuffer& register_thread() {
+            std::lock_guard lock(mutex_);
+            buffers_.push_back(std::make_unique<ProfileBuffer>(static_cast<uint32_t>(buffers_.size())));
+            return *buffers_.back();
+        }
+
+        // calibrates timestamps against the steady clock over the lifetime of the profiler
+        double get_ns_per_tick() const {
+            auto elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - origin_time_).count();
+            auto elapsed_ticks = static_cast<double>(read_timestamp() - origin_ticks_);
+            return elapsed_ticks > 0 ? elapsed_ns / elapsed_ticks : 1.0;
+        }
+
+    private:
+        std::chrono::steady_clock::time_point       origin_time_;
+        uint64_t                                    origin_ticks_;
+        std::mutex                                  mutex_;
+        std::vector<std::unique_ptr<ProfileBuffer>> buffers_;
+
+        static inline thread_local ProfileBuffer*   thread_buffer_ = nullptr;
+    };
+
+    class ProfileZone {
+    public:
+        explicit ProfileZone(const char* name)
+            : buffer_(Profiler::get_thread_buffer())
+            , name_(name)
+            , begin_(read_timestamp())
+        {
+        }
+
+        ProfileZone(ProfileZone&&) = delete;
+        ProfileZone(const ProfileZone&) = delete;
+        ProfileZone& operator=(ProfileZone&&) = delete;
+        ProfileZone& operator=(const ProfileZone&) = delete;
+
+        ~ProfileZone() {
+            buffer_.push(name_, begin_, read_timestamp());
+        }
+
+    private:
+        ProfileBuffer& buffer_;
+        const char*    name_;
+        uint64_t       begin_;
+    };
+
+}
+
+#define ENTLER_PROFILE_CONCAT_(lhs, rhs) lhs##rhs
+#define ENTLER_PROFILE_CONCAT(lhs, rhs) ENTLER_PROFILE_CONCAT_(lhs, rhs)
+
+// name must be a string with static storage duration
+#define ENTLER_PROFILE_ZONE(name) ::entler::ProfileZone ENTLER_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+
+#else
+
+#define ENTLER_PROFILE_ZONE(name) ((void)0)
+
+#endif
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace entler {
+
+    // A named shared memory segment mapped into this process: POSIX shm_open
+    // and mmap, or a pagefile backed file mapping on Windows. The process that
+    // creates a segment owns the name and removes it again when the segment is
+    // destroyed; other processes open it by name, read only, and keep their
+    // mapping alive until they let go of it.
+    class SharedMemory {
+    public:
+        SharedMemory() = default;
+
+        SharedMemory(SharedMemory&& other) noexcept {
+            *this = std::move(other);
+        }
+
+        SharedMemory& operator=(SharedMemory&& other) noexcept {
+            std::swap(name_, other.name_);
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(owner_, other.owner_);
+#if defined(_WIN32)
+            std::swap(mapping_, other.mapping_);
+#endif
+            return *this;
+        }
+
+        SharedMemory(const SharedMemory&) = delete;
+        SharedMemory& operator=(const SharedMemory&) = delete;
+
+        ~SharedMemory() {
+            close();
+        }
+
+        // creates a zero filled, writable segment of size bytes, replacing any left over segment of that name
+        bool create(const std::string& name, size_t size) {
+            close();
+
+#if defined(_WIN32)
+            mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), get_os_name(name).c_str());
+            if (!mapping_) {
+                return false;
+            }
+
+            data_ = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+            std::string os_name = get_os_name(name);
+            shm_unlink(os_name.c_str());
+
+            int fd = shm_open(os_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+            if (fd < 0) {
+                return false;
+            }
+
+            if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+                data_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (data_ == MAP_FAILED) {
+                    data_ = nullptr;
+                }
+            }
+
+            ::close(fd);
+            if (!data_) {
+                shm_unlink(os_name.c_str());
+            }
+#endif
+
+            name_ = name;
+            size_ = size;
+            owner_ = true;
+            if (!data_) {
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        // maps an existing segment read only
+        bool open(const std::string& name) {
+            close();
+
+#if defined(_WIN32)
+            mapping_ = OpenFileMappingA(FILE_MAP_READ, FALSE, get_os_name(name).c_str());
+            if (!mapping_) {
+                return false;
+            }
+
+            data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+            MEMORY_BASIC_INFORMATION info;
+            if (data_ && VirtualQuery(data_, &info, sizeof(info)) == sizeof(info)) {
+                size_ = info.RegionSize;
+            }
+#else
+            int fd = shm_open(get_os_name(name).c_str(), O_RDONLY, 0);
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat status;
+            if (fstat(fd, &status) == 0 && status.st_size > 0) {
+                size_ = static_cast<size_t>(status.st_size);
+                data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+                if (data_ == MAP_FAILED) {
+                    data_ = nullptr;
+                }
+            }
+
+            ::close(fd);
+#endif
+
+            name_ = name;
+            owner_ = false;
+            if (!data_) {
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        void close() {
+#if defined(_WIN32)
+            if (data_) {
+                UnmapViewOfFile(data_);
+            }
+
+            if (mapping_) {
+                CloseHandle(mapping_);
+                mapping_ = nullptr;
+            }
+#else
+            if (data_) {
+                munmap(data_, size_);
+            }
+
+            if (owner_) {
+                shm_unlink(get_os_name(name_).c_str());
+            }
+#endif
+
+            name_.clear();
+            data_ = nullptr;
+            size_ = 0;
+            owner_ = false;
+        }
+
+        bool is_open() const {
+            return data_ != nullptr;
+        }
+
+        void* get_data() {
+            return data_;
+        }
+
+        const void* get_data() const {
+            return data_;
+        }
+
+        // rounded up to whole pages when opened on Windows
+        size_t get_size() const {
+            return size_;
+        }
+
+    private:
+        // POSIX names start with a single slash; Windows names live in the session namespace
+        static std::string get_os_name(const std::string& name) {
+#if defined(_WIN32)
+            return "Local\\" + name;
+#else
+            return "/" + name;
+#endif
+        }
+
+    private:
+        std::string name_;
+        void*       data_ = nullptr;
+        size_t      size_ = 0;
+        bool        owner_ = false;
+#if defined(_WIN32)
+        HANDLE      mapping_ = nullptr;
+#endif
+    };
+
+}
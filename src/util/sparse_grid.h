@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include "math.h"
+
+namespace entler {
+
+    // A width x height x depth grid of Values that only stores the cells that
+    // hold one, laid out like a shallow VDB tree: a dense root of nodes
+    // covering 64^3 cells each, nodes of 8^3 bricks, and bricks of 8^3 cells.
+    // Nodes and bricks are allocated when their first cell is set and freed
+    // with their last one; a brick packs the values of its set cells in cell
+    // order behind an occupancy mask. Memory therefore follows the occupied
+    // volume, plus a pointer per 64^3 cells of the bounds for the root.
+    //
+    // Cells are addressed by coordinates within [0, width) x [0, height) x
+    // [0, depth). find() may be called from several threads as long as no
+    // thread adds or erases cells.
+    template<typename Value>
+    class SparseGrid {
+    public:
+        static constexpr size_t brick_size = 8;
+        static constexpr size_t node_size = brick_size * brick_size;
+
+        SparseGrid(size_t width, size_t height, size_t depth)
+            : width_(width)
+            , height_(height)
+            , depth_(depth)
+            , root_width_((width + node_size - 1) / node_size)
+            , root_height_((height + node_size - 1) / node_size)
+            , root_(root_width_ * root_height_ * ((depth + node_size - 1) / node_size))
+        {
+        }
+
+        SparseGrid(SparseGrid&&) = default;
+        SparseGrid& operator=(SparseGrid&&) = default;
+
+        size_t get_width() const {
+            return width_;
+        }
+
+        size_t get_height() const {
+            return height_;
+        }
+
+        size_t get_depth() const {
+            return depth_;
+        }
+
+        bool contains(I32Vec3 cell) const {
+            return cell.x >= 0 && static_cast<size_t>(cell.x) < width_ &&
+                   cell.y >= 0 && static_cast<size_t>(cell.y) < height_ &&
+                   cell.z >= 0 && static_cast<size_t>(cell.z) < depth_;
+        }
+
+        // nullptr when the cell holds no value
+        Value* find(I32Vec3 cell) {
+            return const_cast<Value*>(std::as_const(*this).find(cell));
+        }
+
+        const Value* find(I32Vec3 cell) const {
+            assert(contains(cell));
+
+            const Node* node = root_[get_node_index(cell)].get();
+            if (!node) {
+                return nullptr;
+            }
+
+            const Brick* brick = node->bricks[get_brick_index(cell)].get();
+            if (!brick) {
+                return nullptr;
+            }
+
+            size_t cell_index = get_cell_index(cell);
+            if (!brick->is_set(cell_index)) {
+                return nullptr;
+            }
+
+            return &brick->values[brick->get_rank(cell_index)];
+        }
+
+        // the value of cell, default constructed if the cell held none
+        Value& get_or_add(I32Vec3 cell) {
+            assert(contains(cell));
+
+            auto& node = root_[get_node_index(cell)];
+            if (!node) {
+                node = std::make_unique<Node>();
+                node_count_ += 1;
+            }
+
+            auto& brick = node->bricks[get_brick_index(cell)];
+            if (!brick) {
+                brick = std::make_unique<Brick>();
+                brick_count_ += 1;
+                node->brick_count += 1;
+            }
+
+            size_t cell_index = get_cell_index(cell);
+            size_t rank = brick->get_rank(cell_index);
+            if (brick->is_set(cell_index)) {
+                return brick->values[rank];
+            }
+
+            brick->set(cell_index, true);
+            value_count_ += 1;
+            return *brick->values.emplace(brick->values.begin() + static_cast<ptrdiff_t>(rank));
+        }
+
+        // returns whether the cell held a value
+        bool erase(I32Vec3 cell) {
+            assert(contains(cell));
+
+            auto& node = root_[get_node_index(cell)];
+            if (!node) {
+                return false;
+            }
+
+            auto& brick = node->bricks[get_brick_index(cell)];
+            size_t cell_index = get_cell_index(cell);
+            if (!brick || !brick->is_set(cell_index)) {
+                return false;
+            }
+
+            brick->values.erase(brick->values.begin() + static_cast<ptrdiff_t>(brick->get_rank(cell_index)));
+            brick->set(cell_index, false);
+            value_count_ -= 1;
+
+            if (brick->values.empty()) {
+                brick.reset();
+                brick_count_ -= 1;
+                node->brick_count -= 1;
+                if (node->brick_count == 0) {
+                    node.reset();
+                    node_count_ -= 1;
+                }
+            }
+            else if (brick->values.capacity() > 2 * brick->values.size() + 4) {
+                brick->values.shrink_to_fit();
+            }
+
+            return true;
+        }
+
+        // visits (cell, value) for the set cells in [first, last), brick by brick;
+        // whole nodes and bricks without a set cell are skipped. The visitor must
+        // not add or erase cells.
+        template<typename Visitor>
+        void for_each(I32Vec3 first, I32Vec3 last, Visitor&& visitor) {
+            first = I32Vec3{std::max(first.x, 0), std::max(first.y, 0), std::max(first.z, 0)};
+            last = I32Vec3{
+                std::min(last.x, static_cast<int32_t>(width_)),
+                std::min(last.y, static_cast<int32_t>(height_)),
+                std::min(last.z, static_cast<int32_t>(depth_)),
+            };
+            if (first.x >= last.x || first.y >= last.y || first.z >= last.z) {
+                return;
+            }
+
+            constexpr int32_t brick_extent = static_cast<int32_t>(brick_size);
+            for (int32_t brick_z = first.z / brick_extent; brick_z <= (last.z - 1) / brick_extent; ++brick_z) {
+                for (int32_t brick_y = first.y / brick_extent; brick_y <= (last.y - 1) / brick_extent; ++brick_y) {
+                    for (int32_t brick_x = first.x / brick_extent; brick_x <= (last.x - 1) / brick_extent; ++brick_x) {
+                        I32Vec3 brick_origin{brick_x * brick_extent, brick_y * brick_extent, brick_z * brick_extent};
+                        Node* node = root_[get_node_index(brick_origin)].get();
+                        if (!node) {
+                            // the rest of this row of bricks in the node is empty too
+                            brick_x |= static_cast<int32_t>(brick_size - 1);
+                            continue;
+                        }
+
+                        Brick* brick = node->bricks[get_brick_index(brick_origin)].get();
+                        if (brick) {
+                            visit_brick(*brick, brick_origin, first, last, visitor);
+                        }
+                    }
+                }
+            }
+        }
+
+        // cells holding a value
+        size_t size() const {
+            return value_count_;
+        }
+
+        size_t get_node_count() const {
+            return node_count_;
+        }
+
+        size_t get_brick_count() const {
+            return brick_count_;
+        }
+
+        // bytes held by the tree, not counting what values allocate themselves
+        size_t get_memory_size() const {
+            size_t value_capacity = 0;
+            for (const auto& node: root_) {
+                if (node) {
+                    for (const auto& brick: node->bricks) {
+                        if (brick) {
+                            value_capacity += brick->values.capacity();
+                        }
+                    }
+                }
+            }
+
+            return root_.size() * sizeof(std::unique_ptr<Node>) +
+                   node_count_ * sizeof(Node) +
+                   brick_count_ * sizeof(Brick) +
+                   value_capacity * sizeof(Value);
+        }
+
+    private:
+        static constexpr size_t brick_cell_count = brick_size * brick_size * brick_size;
+        static constexpr size_t mask_word_count = brick_cell_count / 64;
+        static constexpr int    brick_shift = std::countr_zero(brick_size);
+        static constexpr int    node_shift = std::countr_zero(node_size);
+
+        static_assert(std::has_single_bit(brick_size), "Cells are located with shifts");
+
+        struct Brick {
+            uint64_t           mask[mask_word_count] = {};
+            uint16_t           word_ranks[mask_word_count] = {};   // set cells in the words before
+            std::vector<Value> values;                              // of the set cells, in cell order
+
+            bool is_set(size_t cell_index) const {
+                return (mask[cell_index / 64] >> (cell_index % 64)) & 1;
+            }
+
+            // index into values of cell_index, whether it is set or not
+            size_t get_rank(size_t cell_index) const {
+                uint64_t lower_bits = (uint64_t(1) << (cell_index % 64)) - 1;
+                return word_ranks[cell_index / 64] + static_cast<size_t>(std::popcount(mask[cell_index / 64] & lower_bits));
+            }
+
+            void set(size_t cell_index, bool added) {
+                size_t word_index = cell_index / 64;
+                mask[word_index] ^= uint64_t(1) << (cell_index % 64);
+                for (size_t later_word_index = word_index + 1; later_word_index < mask_word_count; ++later_word_index) {
+                    word_ranks[later_word_index] += added ? 1 : -1;
+                }
+            }
+        };
+
+        struct Node {
+            std::unique_ptr<Brick> bricks[brick_cell_count];
+            size_t                 brick_count = 0;
+        };
+
+        size_t get_node_index(I32Vec3 cell) const {
+            size_t x = static_cast<size_t>(cell.x) >> node_shift;
+            size_t y = static_cast<size_t>(cell.y) >> node_shift;
+            size_t z = static_cast<size_t>(cell.z) >> node_shift;
+            return x + (y + z * root_height_) * root_width_;
+        }
+
+        static size_t get_brick_index(I32Vec3 cell) {
+            constexpr size_t mask = brick_size - 1;
+            size_t x = (static_cast<size_t>(cell.x) >> brick_shift) & mask;
+            size_t y = (static_cast<size_t>(cell.y) >> brick_shift) & mask;
+            size_t z = (static_cast<size_t>(cell.z) >> brick_shift) & mask;
+            return x + (y + z * brick_size) * brick_size;
+        }
+
+        static size_t get_cell_index(I32Vec3 cell) {
+            constexpr size_t mask = brick_size - 1;
+            size_t x = static_cast<size_t>(cell.x) & mask;
+            size_t y = static_cast<size_t>(cell.y) & mask;
+            size_t z = static_cast<size_t>(cell.z) & mask;
+            return x + (y + z * brick_size) * brick_size;
+        }
+
+        // A mask word holds a z slice of 8 x 8 cells, so the part of the box in the brick
+        // is the same row mask in the words of the slices the box covers.
+        template<typename Visitor>
+        static void visit_brick(Brick& brick, I32Vec3 brick_origin, I32Vec3 first, I32Vec3 last, Visitor& visitor) {
+            static_assert(brick_size * brick_size == 64, "A mask word is a z slice of the brick");
+
+            constexpr int32_t brick_extent = static_cast<int32_t>(brick_size);
+            I32Vec3 brick_first = first - brick_origin;
+            I32Vec3 brick_last = last - brick_origin;
+            int32_t first_x = std::max(brick_first.x, 0);
+            int32_t last_x = std::min(brick_last.x, brick_extent);
+            int32_t first_y = std::max(brick_first.y, 0);
+            int32_t last_y = std::min(brick_last.y, brick_extent);
+            int32_t first_z = std::max(brick_first.z, 0);
+            int32_t last_z = std::min(brick_last.z, brick_extent);
+
+            uint64_t row_mask = ((uint64_t(1) << last_x) - 1) & ~((uint64_t(1) << first_x) - 1);
+            uint64_t slice_mask = 0;
+            for (int32_t y = first_y; y < last_y; ++y) {
+                slice_mask |= row_mask << (y * brick_extent);
+            }
+
+            for (int32_t z = first_z; z < last_z; ++z) {
+                uint64_t word = brick.mask[z];
+                for (uint64_t bits = word & slice_mask; bits; bits &= bits - 1) {
+                    int bit = std::countr_zero(bits);
+                    size_t rank = brick.word_ranks[z] + static_cast<size_t>(std::popcount(word & ((uint64_t(1) << bit) - 1)));
+                    I32Vec3 cell = brick_origin + I32Vec3{bit % brick_extent, bit / brick_extent, z};
+                    visitor(cell, brick.values[rank]);
+                }
+            }
+        }
+
+    private:
+        size_t                             width_;
+        size_t                             height_;
+        size_t                             depth_;
+        size_t                             root_width_;
+        size_t                             root_height_;
+        std::vector<std::unique_ptr<Node>> root_;
+        size_t                             node_count_ = 0;
+        size_t                             brick_count_ = 0;
+        size_t                             value_count_ = 0;
+    };
+
+}
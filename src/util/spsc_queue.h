@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <cassert>
+
+namespace entler {
+
+    // An unbounded lock-free queue for exactly one producer and one consumer
+    // thread. Items live in a linked list of fixed size blocks; the producer
+    // only allocates when it fills a block, and the consumer hands the block
+    // it finished back through a single spare slot so steady traffic does not
+    // allocate at all.
+    template<typename T, size_t block_size = 64>
+    class SpscQueue {
+    public:
+        SpscQueue()
+            : head_block_(new Block)
+            , tail_block_(head_block_)
+        {
+        }
+
+        SpscQueue(SpscQueue&&) = delete;
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(SpscQueue&&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        ~SpscQueue() {
+            T value;
+            while (try_pop(value)) {
+            }
+
+            Block* block = head_block_;
+            while (block) {
+                Block* next = block->next.load(std::memory_order_relaxed);
+                delete block;
+                block = next;
+            }
+
+            delete spare_block_.load(std::memory_order_relaxed);
+        }
+
+        // producer only
+        void push(T value) {
+            if (tail_index_ == block_size) {
+                Block* block = spare_block_.exchange(nullptr, std::memory_order_acquire);
+                if (block) {
+                    block->committed.store(0, std::memory_order_relaxed);
+                    block->next.store(nullptr, std::memory_order_relaxed);
+                }
+                else {
+                    block = new Block;
+                }
+
+                tail_block_->next.store(block, std::memory_order_release);
+                tail_block_ = block;
+                tail_index_ = 0;
+            }
+
+            new (tail_block_->get_item(tail_index_)) T(std::move(value));
+            tail_index_ += 1;
+            tail_block_->committed.store(tail_index_, std::memory_order_release);
+        }
+
+        // consumer only; returns false when the queue is empty
+        bool try_pop(T& value) {
+            if (head_index_ == block_size) {
+                Block* next = head_block_->next.load(std::memory_order_acquire);
+                if (!next) {
+                    return false;
+                }
+
+                // the producer moved on, so the finished block can be handed back
+                delete spare_block_.exchange(head_block_, std::memory_order_acq_rel);
+                head_block_ = next;
+                head_index_ = 0;
+            }
+
+            if (head_index_ == head_block_->committed.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            T* item = head_block_->get_item(head_index_);
+            value = std::move(*item);
+            item->~T();
+            head_index_ += 1;
+            return true;
+        }
+
+    private:
+        struct Block {
+            alignas(T) unsigned char storage[sizeof(T) * block_size];
+            std::atomic<size_t>      committed = 0;
+            std::atomic<Block*>      next = nullptr;
+
+            T* get_item(size_t index) {
+                assert(index < block_size);
+                return std::launder(reinterpret_cast<T*>(storage) + index);
+            }
+        };
+
+    private:
+        // consumer side
+        alignas(64) Block*  head_block_;
+        size_t              head_index_ = 0;
+
+        // producer side
+        alignas(64) Block*  tail_block_;
+        size_t              tail_index_ = 0;
+
+        alignas(64) std::atomic<Block*> spare_block_ = nullptr;
+    };
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace entler {
+
+    namespace detail {
+
+        class ThreadIndexAllocator {
+        public:
+            static ThreadIndexAllocator& get_instance() {
+                static ThreadIndexAllocator allocator;
+                return allocator;
+            }
+
+            size_t allocate() {
+                std::lock_guard lock(mutex_);
+                if (free_indexes_.empty()) {
+                    return next_index_++;
+                }
+
+                size_t index = free_indexes_.back();
+                free_indexes_.pop_back();
+                return index;
+            }
+
+            void free(size_t index) {
+                std::lock_guard lock(mutex_);
+                free_indexes_.push_back(index);
+            }
+
+        private:
+            std::mutex          mutex_;
+            std::vector<size_t> free_indexes_;
+            size_t              next_index_ = 0;
+        };
+
+        struct ThreadIndex {
+            size_t value;
+
+            ThreadIndex()
+                : value(ThreadIndexAllocator::get_instance().allocate())
+            {
+            }
+
+            ~ThreadIndex() {
+                ThreadIndexAllocator::get_instance().free(value);
+            }
+        };
+
+    }
+
+    // a small index that is unique among the running threads; indexes of
+    // threads that exited are handed out again so they stay dense
+    inline size_t get_thread_index() {
+        // the cached copy is trivially destructible, which keeps the fast path free of tls guards
+        thread_local size_t cached_thread_index = SIZE_MAX;
+        if (cached_thread_index == SIZE_MAX) {
+            thread_local detail::ThreadIndex thread_index;
+            cached_thread_index = thread_index.value;
+        }
+
+        return cached_thread_index;
+    }
+
+}
@@ -0,0 +1,146 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <cstdio>
+
+#include "simulation/world_export.h"
+
+using namespace entler;
+
+namespace {
+
+    struct Options {
+        std::string name = "entler";
+        size_t reads = 10;
+        size_t interval_ms = 1000;
+    };
+
+    void print_usage(const char* program) {
+        std::cerr
+            << "usage: " << program << " [options]\n"
+            << "  --name=NAME          segment published by entler --export=NAME (default entler)\n"
+            << "  --reads=N            frames to read before exiting, 0 to keep reading (default 10)\n"
+            << "  --interval-ms=N      time between reads (default 1000)\n";
+    }
+
+    bool parse_options(int argc, char** argv, Options& options) {
+        for (int arg_index = 1; arg_index < argc; ++arg_index) {
+            std::string arg = argv[arg_index];
+            size_t separator = arg.find('=');
+            if (arg.rfind("--", 0) != 0 || separator == std::string::npos) {
+                return false;
+            }
+
+            std::string name = arg.substr(2, separator - 2);
+            std::string text = arg.substr(separator + 1);
+            if (name == "name") {
+                options.name = text;
+                continue;
+            }
+
+            size_t value = 0;
+            try {
+                value = std::stoull(text);
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+
+            if (name == "reads") {
+                options.reads = value;
+            }
+            else if (name == "interval-ms") {
+                options.interval_ms = value;
+            }
+            else {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // what one read gathers from a frame; only printed once the read is known to be consistent
+    struct FrameSummary {
+        uint64_t tick = 0;
+        int64_t  publish_time_ns = 0;
+        size_t   entity_count = 0;
+        size_t   object_counts[4] = {};   // indexed by ObjectType
+        size_t   occupied_tile_count = 0;
+        bool     truncated = false;
+    };
+
+}
+
+// Attaches to the world a running entler publishes with --export and prints a
+// summary of the latest frame every interval, straight from shared memory.
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    WorldExportReader reader;
+    if (!reader.open(options.name)) {
+        std::cerr << "no world export named " << options.name << std::endl;
+        return 1;
+    }
+
+    for (size_t read_index = 0; options.reads == 0 || read_index < options.reads; ++read_index) {
+        if (read_index > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.interval_ms));
+        }
+
+        FrameSummary summary;
+        auto start = std::chrono::steady_clock::now();
+        bool consistent = reader.read([&](const WorldExportView& view) {
+            summary = FrameSummary{};
+            summary.tick = view.get_tick();
+            summary.publish_time_ns = view.get_publish_time_ns();
+            summary.entity_count = view.get_entity_count();
+            summary.truncated = view.is_truncated();
+
+            if (const auto* object_types = view.get_column<ComponentType::object_type>()) {
+                for (size_t row = 0; row < view.get_entity_count(); ++row) {
+                    auto object_type = static_cast<size_t>(object_types[row].type);
+                    if (view.has_component<ComponentType::object_type>(row) && object_type < 4) {
+                        summary.object_counts[object_type] += 1;
+                    }
+                }
+            }
+
+            for (int32_t z = 0; z < static_cast<int32_t>(view.get_depth()); ++z) {
+                for (int32_t y = 0; y < static_cast<int32_t>(view.get_height()); ++y) {
+                    for (int32_t x = 0; x < static_cast<int32_t>(view.get_width()); ++x) {
+                        summary.occupied_tile_count += view.find_object_row(view.get_origin() + I32Vec3{x, y, z}).has_value();
+                    }
+                }
+            }
+        });
+        auto stop = std::chrono::steady_clock::now();
+
+        if (!consistent) {
+            std::printf("no consistent frame (published %llu)\n", static_cast<unsigned long long>(reader.get_published_count()));
+            continue;
+        }
+
+        double age_ms = static_cast<double>(world_export::get_time_ns() - summary.publish_time_ns) / 1e6;
+        double read_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+        std::printf("tick %llu: entities=%zu%s robots=%zu rocks=%zu balls=%zu blocks=%zu occupied_tiles=%zu age=%.3fms read=%.3fms\n",
+            static_cast<unsigned long long>(summary.tick),
+            summary.entity_count,
+            summary.truncated ? " (truncated)" : "",
+            summary.object_counts[static_cast<size_t>(ObjectType::robot)],
+            summary.object_counts[static_cast<size_t>(ObjectType::rock)],
+            summary.object_counts[static_cast<size_t>(ObjectType::ball)],
+            summary.object_counts[static_cast<size_t>(ObjectType::block)],
+            summary.occupied_tile_count,
+            age_ms,
+            read_ms);
+        std::fflush(stdout);
+    }
+
+    return 0;
+}